@@ -0,0 +1,35 @@
+#ifndef BENCHCOMMON_HPP
+#define BENCHCOMMON_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace Bench {
+    using Clock = std::chrono::steady_clock;
+
+    // Seconds elapsed since start
+    inline double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Human readable size label, e.g. "1 KB" or "1 GB"
+    inline std::string sizeLabel(size_t bytes) {
+        const char* units[] = { "B", "KB", "MB", "GB" };
+        int unit = 0;
+        while (unit < 3 && bytes >= 1024 && bytes % 1024 == 0) {
+            bytes /= 1024;
+            unit++;
+        }
+        return std::to_string(bytes) + " " + units[unit];
+    }
+
+    inline void report(const std::string& name, size_t bytes, double seconds) {
+        double mbps = seconds > 0 ? (double)bytes / (1024.0 * 1024.0) / seconds : 0.0;
+        std::printf("%-40s %10s %10.3f ms %10.1f MB/s\n",
+            name.c_str(), sizeLabel(bytes).c_str(), seconds * 1000.0, mbps);
+    }
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include "benchCommon.hpp"
+#include "cipherSession.hpp"
+#include "encrypt.hpp"
+#include "decrypt.hpp"
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+// Per-message latency for many short secrets, with a fresh context per
+// message versus one CipherSession that only rewinds its IV.
+int main() {
+    const string key(32, 'k');
+    const string iv(16, 'i');
+    const int messages = 200000;
+    const size_t sizes[] = { 16, 64, 256 };
+
+    for (size_t size : sizes) {
+        string secret(size, 's');
+        size_t total = 0;
+
+        auto start = Bench::Clock::now();
+        for (int i = 0; i < messages; ++i) {
+            total += Encrypt::encryptAES(secret, key, iv).size();
+        }
+        double oneShot = Bench::secondsSince(start);
+
+        CipherSession session(key, iv);
+        start = Bench::Clock::now();
+        for (int i = 0; i < messages; ++i) {
+            total += Encrypt::encryptAES(session, secret).size();
+        }
+        double cached = Bench::secondsSince(start);
+
+        string ciphertext = Encrypt::encryptAES(secret, key, iv);
+        start = Bench::Clock::now();
+        for (int i = 0; i < messages; ++i) {
+            total += Decrypt::decryptAES(ciphertext, key, iv).size();
+        }
+        double oneShotDecrypt = Bench::secondsSince(start);
+
+        start = Bench::Clock::now();
+        for (int i = 0; i < messages; ++i) {
+            total += Decrypt::decryptAES(session, ciphertext).size();
+        }
+        double cachedDecrypt = Bench::secondsSince(start);
+
+        printf("%4zu B  encrypt: %8.1f ns/msg without session, %8.1f ns/msg with session\n",
+            size, oneShot * 1e9 / messages, cached * 1e9 / messages);
+        printf("%4zu B  decrypt: %8.1f ns/msg without session, %8.1f ns/msg with session\n",
+            size, oneShotDecrypt * 1e9 / messages, cachedDecrypt * 1e9 / messages);
+        if (total == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "benchCommon.hpp"
+#include "directoryCrypt.hpp"
+#include "keyManager.hpp"
+#include "substitutionTable.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+// Directory tree encryption from 1 thread up to the core count, on a tree of
+// 20000 small files plus one 512 MB file (the case a plain per-file pool
+// handles worst: one worker stuck on the big file).
+int main(int argc, char* argv[]) {
+    fs::path root = (argc > 1) ? fs::path(argv[1]) : fs::temp_directory_path() / "xcreeptor-directory-bench";
+    fs::path input = root / "in";
+    fs::path output = root / "out";
+    unsigned cores = max(1u, thread::hardware_concurrency());
+
+    fs::remove_all(root);
+    fs::create_directories(input);
+
+    mt19937 gen(42);
+    vector<char> data(64 * 1024);
+    for (char& c : data) {
+        c = (char)gen();
+    }
+    for (int i = 0; i < 20000; ++i) {
+        fs::path dir = input / ("d" + to_string(i % 100));
+        fs::create_directories(dir);
+        ofstream out(dir / ("f" + to_string(i)), ios::binary);
+        out.write(data.data(), gen() % data.size());
+    }
+    {
+        ofstream out(input / "large.bin", ios::binary);
+        for (size_t written = 0; written < 512UL * 1024 * 1024; written += data.size()) {
+            out.write(data.data(), data.size());
+        }
+    }
+
+    SubstitutionTable table = SubstitutionTable(KeyManager::generateKey()).withPassthrough();
+    const string key(32, 'k');
+    const string iv(16, 'i');
+
+    for (unsigned threads = 1; threads <= cores; threads *= 2) {
+        fs::remove_all(output);
+        DirectoryCrypt::Stats stats = DirectoryCrypt::encryptTree(table, key, iv, CipherMode::AES_256_CTR,
+            input.string(), output.string(), threads);
+        Bench::report("DirectoryCrypt CTR " + to_string(threads) + " thread(s)", stats.bytesRead, stats.seconds);
+
+        if (!stats.errors.empty()) {
+            fprintf(stderr, "%zu files failed, first: %s\n", stats.errors.size(), stats.errors[0].c_str());
+            return 1;
+        }
+        if (threads < cores && threads * 2 > cores) {
+            threads = cores / 2;
+        }
+    }
+
+    fs::remove_all(root);
+    return 0;
+}
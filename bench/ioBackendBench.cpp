@@ -0,0 +1,71 @@
+#include "benchCommon.hpp"
+#include "batchIo.hpp"
+#include "directoryCrypt.hpp"
+#include "keyManager.hpp"
+#include "substitutionTable.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+// Directory encryption of many small files (100k of 512 B - 8 KB by default)
+// with the POSIX and io_uring backends: throughput and I/O syscalls made.
+//
+//   ioBackendBench [file count] [scratch directory]
+int main(int argc, char* argv[]) {
+    size_t fileCount = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 100000;
+    fs::path root = (argc > 2) ? fs::path(argv[2]) : fs::temp_directory_path() / "xcreeptor-io-bench";
+    fs::path input = root / "in";
+    fs::path output = root / "out";
+
+    fs::remove_all(root);
+    mt19937 gen(42);
+    vector<char> data(8 * 1024);
+    for (char& c : data) {
+        c = (char)gen();
+    }
+    for (size_t i = 0; i < fileCount; ++i) {
+        fs::path dir = input / ("d" + to_string(i % 256));
+        if (i < 256) {
+            fs::create_directories(dir);
+        }
+        ofstream out(dir / ("f" + to_string(i)), ios::binary);
+        out.write(data.data(), 512 + gen() % (data.size() - 512));
+    }
+
+    SubstitutionTable table = SubstitutionTable(KeyManager::generateKey()).withPassthrough();
+    const string key(32, 'k');
+    const string iv(16, 'i');
+
+    vector<BatchIo::Backend> backends = { BatchIo::Backend::POSIX };
+    if (BatchIo::uringAvailable()) {
+        backends.push_back(BatchIo::Backend::URING);
+    }
+    else {
+        printf("io_uring not available, only measuring the POSIX backend\n");
+    }
+
+    for (BatchIo::Backend backend : backends) {
+        fs::remove_all(output);
+        DirectoryCrypt::Stats stats = DirectoryCrypt::encryptTree(table, key, iv, CipherMode::AES_256_CTR,
+            input.string(), output.string(), 0, backend);
+        if (!stats.errors.empty()) {
+            fprintf(stderr, "%zu files failed, first: %s\n", stats.errors.size(), stats.errors[0].c_str());
+            return 1;
+        }
+
+        Bench::report(stats.ioBackend, stats.bytesRead, stats.seconds);
+        printf("%-40s %10zu files %10.0f files/s %10llu I/O syscalls (%.2f per file)\n", "",
+            stats.files, stats.files / stats.seconds, (unsigned long long)stats.ioSyscalls,
+            (double)stats.ioSyscalls / stats.files);
+    }
+
+    fs::remove_all(root);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "benchCommon.hpp"
+#include "cipherStream.hpp"
+#include "parallelCtr.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// AES-256-CTR throughput for 1 thread up to the core count, checking that
+// every thread count produces the single-threaded output.
+int main() {
+    const string key(32, 'k');
+    const string iv(16, 'i');
+    const size_t size = 1024UL * 1024 * 1024;
+    unsigned cores = max(1u, thread::hardware_concurrency());
+
+    vector<unsigned char> input(size, 'p');
+    vector<unsigned char> reference(size + EVP_MAX_BLOCK_LENGTH);
+    vector<unsigned char> output(size);
+
+    CipherStream stream;
+    stream.init(CipherStream::Direction::ENCRYPT, key, iv, CipherMode::AES_256_CTR);
+    auto start = Bench::Clock::now();
+    stream.update(input.data(), size, reference.data());
+    Bench::report("CipherStream AES-256-CTR", size, Bench::secondsSince(start));
+
+    for (unsigned threads = 1; threads <= cores; threads *= 2) {
+        start = Bench::Clock::now();
+        ParallelCtr::apply(key, iv, input.data(), output.data(), size, threads);
+        Bench::report("ParallelCtr " + to_string(threads) + " thread(s)", size, Bench::secondsSince(start));
+
+        if (memcmp(output.data(), reference.data(), size) != 0) {
+            fprintf(stderr, "Output with %u threads differs from single-threaded CTR\n", threads);
+            return 1;
+        }
+        if (threads < cores && threads * 2 > cores) {
+            threads = cores / 2;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "benchCommon.hpp"
+#include "keyManager.hpp"
+#include "substitutionTable.hpp"
+#include <map>
+#include <random>
+#include <string>
+
+using namespace std;
+
+// Previous implementation of Encrypt::encryptString, kept as the baseline
+static string encryptWithMap(const map<char, char>& charMapping, const string& input) {
+    string encrypted;
+    for (char c : input) {
+        encrypted += charMapping.at(c);
+    }
+    return encrypted;
+}
+
+// Previous implementation of Decrypt::decryptString, a linear scan per byte
+static string decryptWithScan(const map<char, char>& charMapping, const string& encrypted) {
+    string decrypted;
+    for (char c : encrypted) {
+        for (const auto& pair : charMapping) {
+            if (pair.second == c) {
+                decrypted += pair.first;
+                break;
+            }
+        }
+    }
+    return decrypted;
+}
+
+static string randomText(const map<char, char>& charMapping, size_t length) {
+    string alphabet;
+    for (const auto& pair : charMapping) {
+        alphabet.push_back(pair.first);
+    }
+    mt19937 gen(42);
+    uniform_int_distribution<size_t> dist(0, alphabet.size() - 1);
+
+    string text(length, '\0');
+    for (char& c : text) {
+        c = alphabet[dist(gen)];
+    }
+    return text;
+}
+
+int main() {
+    const size_t size = 100 * 1024 * 1024;
+    map<char, char> charMapping = KeyManager::generateKey();
+    SubstitutionTable table(charMapping);
+    string text = randomText(charMapping, size);
+
+    auto start = Bench::Clock::now();
+    string viaMap = encryptWithMap(charMapping, text);
+    Bench::report("encryptString (std::map)", size, Bench::secondsSince(start));
+
+    start = Bench::Clock::now();
+    string viaTable = table.encrypt(text);
+    Bench::report("encryptString (SubstitutionTable)", size, Bench::secondsSince(start));
+
+    start = Bench::Clock::now();
+    string scanned = decryptWithScan(charMapping, viaTable);
+    Bench::report("decryptString (linear scan)", size, Bench::secondsSince(start));
+
+    start = Bench::Clock::now();
+    string inverted = table.decrypt(viaTable);
+    Bench::report("decryptString (inverse table)", size, Bench::secondsSince(start));
+
+    bool consistent = viaMap == viaTable && scanned == text && inverted == text;
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#include "benchCommon.hpp"
+#include "keyManager.hpp"
+#include "substitutionKernels.hpp"
+#include "substitutionTable.hpp"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Throughput of each substitution kernel the CPU supports, on a cache-resident
+// block (kernel speed) and on a large buffer (memory bound).
+int main() {
+    map<char, char> charMapping = KeyManager::generateKey();
+    SubstitutionTable table(charMapping);
+
+    string alphabet;
+    for (const auto& pair : charMapping) {
+        alphabet.push_back(pair.first);
+    }
+
+    const size_t sizes[] = { 256 * 1024, 256 * 1024 * 1024 };
+    const SubstitutionKernels::Isa kernels[] = {
+        SubstitutionKernels::Isa::SCALAR,
+        SubstitutionKernels::Isa::SSSE3,
+        SubstitutionKernels::Isa::AVX2,
+        SubstitutionKernels::Isa::AVX512_VBMI
+    };
+
+    printf("Detected kernel: %s\n", SubstitutionKernels::name(SubstitutionKernels::detect()));
+
+    for (size_t size : sizes) {
+        vector<uint8_t> plain(size), cipher(size), back(size);
+        mt19937 gen(7);
+        for (uint8_t& c : plain) {
+            c = alphabet[gen() % alphabet.size()];
+        }
+        // Hot caches and fault in the pages before timing
+        table.encrypt(plain.data(), cipher.data(), size);
+        table.decrypt(cipher.data(), back.data(), size);
+
+        size_t rounds = max((size_t)1, (size_t)(1024 * 1024 * 1024) / size);
+        for (SubstitutionKernels::Isa isa : kernels) {
+            if (!SubstitutionKernels::isSupported(isa)) {
+                continue;
+            }
+            string label = string(SubstitutionKernels::name(isa));
+
+            auto start = Bench::Clock::now();
+            for (size_t r = 0; r < rounds; ++r) {
+                SubstitutionKernels::translate(isa, table.forwardTable().data(), plain.data(), cipher.data(), size);
+            }
+            Bench::report(label + " encrypt", size, Bench::secondsSince(start) / rounds);
+
+            start = Bench::Clock::now();
+            for (size_t r = 0; r < rounds; ++r) {
+                SubstitutionKernels::translate(isa, table.inverseTable().data(), cipher.data(), back.data(), size);
+            }
+            Bench::report(label + " decrypt", size, Bench::secondsSince(start) / rounds);
+
+            if (back != plain) {
+                fprintf(stderr, "%s kernel produced wrong output\n", label.c_str());
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include "benchCommon.hpp"
+#include "account.hpp"
+#include "cipherSession.hpp"
+#include "decrypt.hpp"
+#include "encrypt.hpp"
+#include "envmgr.hpp"
+#include "keyManager.hpp"
+#include "substitutionTable.hpp"
+#include "substitutionKernels.hpp"
+#include "base64.hpp"
+#include "utils.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+// Full benchmark suite over every crypto layer and utility.
+//
+//   suiteBench [--json <file>] [--max-size <bytes>] [--filter <substring>]
+//
+// Each case runs across payload sizes from 16 B up to 1 GB (or --max-size)
+// and is repeated until it has run for at least MIN_SECONDS. The JSON file
+// holds one result per line so two releases can be compared with a plain diff.
+
+namespace {
+    const double MIN_SECONDS = 0.2;
+    const size_t MAX_ITERATIONS = 1000000;
+
+    struct Result {
+        string name;
+        size_t size;
+        size_t iterations;
+        double seconds;
+    };
+
+    struct Settings {
+        string jsonPath;
+        size_t maxSize = 1024UL * 1024 * 1024;
+        string filter;
+    };
+
+    vector<size_t> payloadSizes(size_t limit) {
+        vector<size_t> sizes;
+        for (size_t size = 16; size <= limit && size <= 1024UL * 1024 * 1024; size *= 16) {
+            sizes.push_back(size);
+        }
+        if (limit >= 1024UL * 1024 * 1024) {
+            sizes.push_back(1024UL * 1024 * 1024);
+        }
+        return sizes;
+    }
+
+    // Silences the debug output some functions write to stdout
+    struct QuietStdout {
+        ostringstream sink;
+        streambuf* previous;
+        QuietStdout() : previous(cout.rdbuf(sink.rdbuf())) {}
+        ~QuietStdout() { cout.rdbuf(previous); }
+    };
+
+    Result measure(const string& name, size_t size, const function<void()>& operation) {
+        size_t iterations = 0;
+        auto start = Bench::Clock::now();
+        double elapsed = 0;
+        do {
+            operation();
+            iterations++;
+            elapsed = Bench::secondsSince(start);
+        } while (elapsed < MIN_SECONDS && iterations < MAX_ITERATIONS);
+        return { name, size, iterations, elapsed };
+    }
+
+    string alphabetText(const map<char, char>& charMapping, size_t length) {
+        string alphabet;
+        for (const auto& pair : charMapping) {
+            alphabet.push_back(pair.first);
+        }
+        string text(length, '\0');
+        for (size_t i = 0; i < length; ++i) {
+            text[i] = alphabet[(i * 7919) % alphabet.size()];
+        }
+        return text;
+    }
+
+    void printResult(const Result& r) {
+        double perOp = r.seconds / r.iterations;
+        double mbps = r.size ? (double)r.size * r.iterations / (1024.0 * 1024.0) / r.seconds : 0.0;
+        printf("%-32s %10s %10zu iters %14.1f ns/op %10.1f MB/s\n",
+            r.name.c_str(), r.size ? Bench::sizeLabel(r.size).c_str() : "-", r.iterations, perOp * 1e9, mbps);
+        fflush(stdout);
+    }
+
+    void writeJson(const string& path, const vector<Result>& results) {
+        ofstream out(path);
+        out << "{\n";
+        out << "  \"schema\": 1,\n";
+        out << "  \"substitution_kernel\": \"" << SubstitutionKernels::name(SubstitutionKernels::detect()) << "\",\n";
+        out << "  \"base64_kernel\": \"" << Base64::kernelName() << "\",\n";
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            double nsPerOp = r.seconds / r.iterations * 1e9;
+            double mbps = r.size ? (double)r.size * r.iterations / (1024.0 * 1024.0) / r.seconds : 0.0;
+            char line[256];
+            snprintf(line, sizeof(line),
+                "    {\"name\": \"%s\", \"size\": %zu, \"iterations\": %zu, \"ns_per_op\": %.1f, \"mb_per_s\": %.1f}%s\n",
+                r.name.c_str(), r.size, r.iterations, nsPerOp, mbps, i + 1 < results.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+    }
+
+    bool parseArgs(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (i + 1 >= argc) {
+                return false;
+            }
+            if (arg == "--json") {
+                settings.jsonPath = argv[++i];
+            }
+            else if (arg == "--max-size") {
+                settings.maxSize = strtoull(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--filter") {
+                settings.filter = argv[++i];
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!parseArgs(argc, argv, settings)) {
+        fprintf(stderr, "Usage: %s [--json <file>] [--max-size <bytes>] [--filter <substring>]\n", argv[0]);
+        return 2;
+    }
+
+    vector<Result> results;
+    auto run = [&](const string& name, size_t size, const function<void()>& operation) {
+        if (!settings.filter.empty() && name.find(settings.filter) == string::npos) {
+            return;
+        }
+        results.push_back(measure(name, size, operation));
+        printResult(results.back());
+    };
+
+    const string aesKey(32, 'k');
+    const string iv(16, 'i');
+    map<char, char> charMapping = KeyManager::generateKey();
+    SubstitutionTable table(charMapping);
+    CipherSession session(aesKey, iv);
+    vector<size_t> sizes = payloadSizes(settings.maxSize);
+
+    // Crypto layers, each with its Decrypt counterpart
+    for (size_t size : sizes) {
+        string plain = alphabetText(charMapping, size);
+
+        string substituted = Encrypt::encryptString(charMapping, plain);
+        run("Encrypt::encryptString", size, [&] { Encrypt::encryptString(charMapping, plain); });
+        run("Decrypt::decryptString", size, [&] { Decrypt::decryptString(charMapping, substituted); });
+
+        string aes = Encrypt::encryptAES(plain, aesKey, iv);
+        run("Encrypt::encryptAES", size, [&] { Encrypt::encryptAES(plain, aesKey, iv); });
+        run("Decrypt::decryptAES", size, [&] { Decrypt::decryptAES(aes, aesKey, iv); });
+        aes.clear();
+        aes.shrink_to_fit();
+
+        string encoded = Encrypt::base64Encode(plain);
+        run("Encrypt::base64Encode", size, [&] { Encrypt::base64Encode(plain); });
+        run("Decrypt::base64Decode", encoded.size(), [&] { Decrypt::base64Decode(encoded); });
+        encoded.clear();
+        encoded.shrink_to_fit();
+
+        string layered = Encrypt::encryptLayered(charMapping, plain, aesKey, iv);
+        run("Encrypt::encryptLayered", size, [&] { Encrypt::encryptLayered(charMapping, plain, aesKey, iv); });
+        run("Decrypt::decryptLayered", size, [&] { Decrypt::decryptLayered(charMapping, layered, aesKey, iv); });
+        layered.clear();
+        layered.shrink_to_fit();
+
+        // The same layers with the other final encodings
+        for (Encoding encoding : { Encoding::RAW, Encoding::BASE64URL, Encoding::HEX }) {
+            string suffix = string("/") + TextEncoding::name(encoding);
+            string output = Encrypt::encryptLayered(table, plain, session, encoding);
+            run("Encrypt::encryptLayered" + suffix, size, [&] { Encrypt::encryptLayered(table, plain, session, encoding); });
+            run("Decrypt::decryptLayered" + suffix, size, [&] { Decrypt::decryptLayered(table, output, session, encoding); });
+        }
+
+        // Compression ahead of the other layers; random alphabet text only shrinks by about a fifth
+        string packed = Encrypt::encryptLayered(table, plain, session, Encoding::RAW, Compression::ZLIB);
+        run("Encrypt::encryptLayered/raw+zlib", size, [&] { Encrypt::encryptLayered(table, plain, session, Encoding::RAW, Compression::ZLIB); });
+        run("Decrypt::decryptLayered/raw+zlib", size, [&] { Decrypt::decryptLayered(table, packed, session, Encoding::RAW); });
+    }
+
+    // Password generation draws one value per character; capped at 16 MB
+    for (size_t size : sizes) {
+        if (size > 16 * 1024 * 1024) {
+            break;
+        }
+        run("Utils::generateRandomString", size, [&] { Utils::generateRandomString((int)size); });
+    }
+
+    // Fixed-size operations
+    run("KeyManager::generateKey", 0, [] { KeyManager::generateKey(); });
+    {
+        QuietStdout quiet;
+        run("hashPin", 0, [] { hashPin("123456"); });
+    }
+
+    fs::path scratch = fs::temp_directory_path() / "xcreeptor-bench";
+    fs::create_directories(scratch);
+
+    string keyFile = (scratch / "key.dat").string();
+    KeyManager::saveKeyToFile(charMapping, keyFile, "bench-password");
+    run("KeyManager::readKeyFile", 0, [&] { KeyManager::readKeyFile(keyFile, "bench-password"); });
+
+    // EnvManager::load over .env files of growing line counts (size = file bytes)
+    for (size_t lines = 16; lines <= 4096; lines *= 16) {
+        fs::path envFile = scratch / ("bench-" + to_string(lines) + ".env");
+        {
+            ofstream out(envFile);
+            for (size_t i = 0; i < lines; ++i) {
+                out << "XCREEPTOR_BENCH_" << i << "=\"value-" << i << "\"\n";
+            }
+        }
+        string envPath = envFile.string();
+        run("EnvManager::load", fs::file_size(envFile), [&] { EnvManager::load(envPath.c_str()); });
+    }
+    fs::remove_all(scratch);
+
+    if (!settings.jsonPath.empty()) {
+        writeJson(settings.jsonPath, results);
+        printf("Results written to %s\n", settings.jsonPath.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "benchCommon.hpp"
+#include "keyDerivation.hpp"
+#include "tenantKeyStore.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+// TenantKeyStore with many tenants and a cache far smaller than the tenant
+// count: creating the key files, opening the store (its one key derivation),
+// cold loads, and hot lookups from 1 thread up to the core count.
+//
+//   tenantKeyStoreBench [tenants] [directory]
+namespace {
+    const size_t CAPACITY = 4096;
+    const size_t LOOKUPS_PER_THREAD = 2000000;
+
+    string tenantId(size_t i) {
+        return "tenant-" + to_string(i);
+    }
+
+    void reportRate(const string& name, size_t operations, double seconds) {
+        printf("%-40s %10zu ops %10.1f ns/op\n", name.c_str(), operations, seconds * 1e9 / (double)operations);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t tenants = (argc > 1) ? (size_t)strtoull(argv[1], nullptr, 10) : 100000;
+    fs::path root = (argc > 2) ? fs::path(argv[2]) : fs::temp_directory_path() / "xcreeptor-tenant-bench";
+    unsigned cores = max(1u, thread::hardware_concurrency());
+
+    fs::remove_all(root);
+    TenantKeyStore::Options options;
+    options.capacity = CAPACITY;
+
+    {
+        TenantKeyStore store(root.string(), "bench-password", options);
+        auto start = Bench::Clock::now();
+        for (size_t i = 0; i < tenants; ++i) {
+            store.create(tenantId(i));
+        }
+        reportRate("TenantKeyStore::create", tenants, Bench::secondsSince(start));
+    }
+
+    // As a new process would: the store key is derived from the password again
+    KeyDerivation::clearCache();
+    auto start = Bench::Clock::now();
+    TenantKeyStore store(root.string(), "bench-password", options);
+    printf("%-40s %10.1f ms\n", "TenantKeyStore open", Bench::secondsSince(start) * 1e3);
+
+    // Fresh store: every tenant is a miss, and the cache stays at its capacity
+    start = Bench::Clock::now();
+    for (size_t i = 0; i < tenants; ++i) {
+        store.get(tenantId(i));
+    }
+    reportRate("TenantKeyStore::get (cold)", tenants, Bench::secondsSince(start));
+    TenantKeyStore::Stats stats = store.stats();
+    printf("  cached %zu of %zu tenants, %llu evictions\n", stats.cached, tenants, (unsigned long long)stats.evictions);
+
+    // Hot working set that fits the cache, looked up from every thread
+    size_t hot = min(tenants, CAPACITY / 2);
+    vector<string> ids;
+    for (size_t i = 0; i < hot; ++i) {
+        ids.push_back(tenantId(i));
+        store.get(ids.back());
+    }
+    for (unsigned threads = 1; threads <= cores; threads *= 2) {
+        atomic<size_t> sink(0);
+        vector<thread> workers;
+        start = Bench::Clock::now();
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                mt19937 gen(t);
+                size_t generations = 0;
+                for (size_t i = 0; i < LOOKUPS_PER_THREAD; ++i) {
+                    generations += store.get(ids[gen() % ids.size()])->generations().size();
+                }
+                sink += generations;
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        double seconds = Bench::secondsSince(start);
+        // Per lookup as seen by one thread
+        reportRate("TenantKeyStore::get (hot) " + to_string(threads) + " thread(s)", LOOKUPS_PER_THREAD,
+            seconds);
+        if (sink.load() != threads * LOOKUPS_PER_THREAD) {
+            fprintf(stderr, "Unexpected ring contents\n");
+            return 1;
+        }
+        if (threads < cores && threads * 2 > cores) {
+            threads = cores / 2;
+        }
+    }
+
+    fs::remove_all(root);
+    return 0;
+}
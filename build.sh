@@ -2,6 +2,7 @@
 
 # pake array karna akan diiterasi. Kalo mau nambah subfolder tambahin aja
 SRC_DIRS=("src" 
+          "src/cli" 
           "src/core/crypto" 
           "src/core/utils" 
           "src/ui")
@@ -19,11 +20,12 @@ WNO="-Wno-unused-parameter
 
 CFLAGS="$WNO
         -Iinclude 
+        -Iinclude/cli
         -Iinclude/core/crypto
         -Iinclude/core/utils
         -Iinclude/ui
         -Ilib/raylib/include"
-LDFLAGS="lib/raylib/lib/libraylib.a -lopengl32 -lgdi32 -lwinmm -lcrypto -lssl"
+LDFLAGS="lib/raylib/lib/libraylib.a -lopengl32 -lgdi32 -lwinmm -lcrypto -lssl -lz -pthread"
 OBJECT_FILES=()
 
 # Biar CLI nya cakep
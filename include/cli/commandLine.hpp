@@ -0,0 +1,73 @@
+#ifndef COMMANDLINE_HPP
+#define COMMANDLINE_HPP
+
+#include "cipherStream.hpp"
+#include "layeredPipeline.hpp"
+#include "textEncoding.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class KeyRing;
+class SubstitutionTable;
+
+/**
+ * Headless front end: xcreeptor enc|dec|genpass|keygen|rotate|rekey
+ *
+ * Runs without creating a window, so it can be used in scripts and
+ * pipelines. Data is streamed in fixed-size blocks, stdin/stdout by default.
+ */
+class CommandLine {
+public:
+    // Don't allow instantiation
+    CommandLine() = delete;
+
+    /**
+     * Run a command
+     *
+     * @return Process exit code (0 success, 1 failure, 2 usage error)
+     */
+    static int run(int argc, char* argv[]);
+
+private:
+    struct Options {
+        std::string command;
+        std::string input;
+        std::string output;
+        std::string keyFile;
+        std::string mode;
+        std::string encoding;
+        std::string io;
+        std::string range;
+        std::string keyId;
+        std::vector<std::string> positional;
+        bool force;
+        bool recursive;
+        bool container;
+        bool compress;
+        bool resume;
+        unsigned threads;
+        size_t queueDepth;
+        double rate;
+        double cpuPercent;
+        bool stats;
+    };
+
+    // Size of the chunks passed between the read/crypto/write stages
+    static const size_t IO_BLOCK_SIZE = 1024 * 1024;
+
+    static bool parseArgs(int argc, char* argv[], Options& options);
+    static void printUsage();
+
+    static int runCrypt(const Options& options, bool encrypt);
+    static int runContainer(const Options& options, bool encrypt, const KeyRing& ring, uint32_t keyId,
+        const std::string& aesKey, CipherMode mode);
+    static int runCryptTree(const Options& options, bool encrypt, const SubstitutionTable& table,
+        const std::string& aesKey, const std::string& iv, CipherMode mode, Encoding encoding, Compression compression);
+    static int runGeneratePassword(const Options& options);
+    static int runKeygen(const Options& options);
+    static int runRotate(const Options& options);
+    static int runRekey(const Options& options);
+};
+
+#endif
@@ -1,6 +1,9 @@
 #pragma once
 #include <string>
 
+// SHA-256 of the PIN as lowercase hex
+std::string hashPin(const std::string& pin);
+
 class Account {
 public:
     static bool verifyAccount(const std::string& username, const std::string& pin);
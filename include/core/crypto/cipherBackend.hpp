@@ -0,0 +1,46 @@
+#ifndef CIPHERBACKEND_HPP
+#define CIPHERBACKEND_HPP
+
+#include "cipherStream.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Names, stable ids and runtime selection of the cipher layer's backends.
+ *
+ * Every backend is an OpenSSL EVP cipher behind CipherStream, so the
+ * layered format, containers and directory trees run on any of them.
+ * "auto" picks between AES-256-GCM and ChaCha20-Poly1305 with a short
+ * microbenchmark on the first call: with AES instructions GCM wins, on
+ * CPUs where they are missing or masked by the hypervisor ChaCha20 does.
+ */
+namespace CipherBackend {
+    // Bytes encrypted per candidate by fastest()
+    const size_t PROBE_SIZE = 256 * 1024;
+
+    // "cbc", "ctr", "gcm" or "chacha20"
+    const char* name(CipherMode mode);
+
+    /**
+     * Look up a backend by name; "auto" resolves to fastest() and an empty
+     * name to AES_256_CBC, the historical default
+     *
+     * @return false for unknown names
+     */
+    bool parse(const std::string& name, CipherMode& mode);
+
+    // Faster of the authenticated backends on this CPU (measured once, then cached)
+    CipherMode fastest();
+
+    // Single-thread encryption throughput of mode in MB/s over bytes of data
+    double measure(CipherMode mode, size_t bytes = PROBE_SIZE);
+
+    // Stable one-byte id stored in containers and authenticated messages
+    uint8_t id(CipherMode mode);
+
+    // @return false if id names no backend
+    bool fromId(uint8_t id, CipherMode& mode);
+}
+
+#endif
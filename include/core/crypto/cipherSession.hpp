@@ -0,0 +1,41 @@
+#ifndef CIPHERSESSION_HPP
+#define CIPHERSESSION_HPP
+
+#include "cipherStream.hpp"
+#include <string>
+
+/**
+ * Long-lived cipher state for one key.
+ *
+ * Keeps an encrypt and a decrypt context whose key schedule is expanded
+ * once; each new message only resets the IV. A session is not thread-safe,
+ * use one per thread.
+ */
+class CipherSession {
+public:
+    CipherSession(const std::string& key, const std::string& iv, CipherMode mode = CipherMode::AES_256_CBC);
+
+    CipherSession(const CipherSession&) = delete;
+    CipherSession& operator=(const CipherSession&) = delete;
+
+    // IV used for subsequent messages
+    void setIV(const std::string& iv);
+    const std::string& getIV() const;
+    CipherMode getMode() const;
+
+    // Context positioned at the start of a new message under the current IV
+    CipherStream& encryptor();
+    CipherStream& decryptor();
+
+private:
+    std::string key;
+    std::string iv;
+    CipherMode mode;
+
+    CipherStream encryptStream;
+    CipherStream decryptStream;
+    bool encryptReady;
+    bool decryptReady;
+};
+
+#endif
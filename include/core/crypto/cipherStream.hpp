@@ -0,0 +1,124 @@
+#ifndef CIPHERSTREAM_HPP
+#define CIPHERSTREAM_HPP
+
+#include <openssl/evp.h>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class CipherMode {
+    AES_256_CBC,
+    // Counter mode: no padding and seekable, so segments can be processed in parallel
+    AES_256_CTR,
+    // Authenticated counter mode with a 12-byte IV; the tag is stored next to the message
+    AES_256_GCM,
+    // Authenticated stream cipher with a 12-byte IV, fast without AES instructions
+    CHACHA20_POLY1305
+};
+
+/**
+ * Streaming wrapper around an EVP cipher context.
+ *
+ * Input of any size is fed to EVP in CHUNK_SIZE slices and every slice of
+ * output is handed to a sink, so memory use stays bounded regardless of the
+ * payload size.
+ */
+class CipherStream {
+public:
+    enum class Direction {
+        ENCRYPT,
+        DECRYPT
+    };
+
+    // Size of the slices passed to EVP per update call
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    // Authentication tag of the AEAD modes
+    static const size_t TAG_SIZE = 16;
+
+    using Sink = std::function<void(const unsigned char* data, size_t length)>;
+
+    CipherStream();
+    ~CipherStream();
+
+    CipherStream(const CipherStream&) = delete;
+    CipherStream& operator=(const CipherStream&) = delete;
+
+    /**
+     * Set up the context for a new message
+     *
+     * @param direction Encrypt or decrypt
+     * @param key Cipher key, zero-padded or truncated to the mode's key length
+     * @param iv Initialization vector, zero-padded or truncated to the mode's IV length
+     * @param mode Cipher to use
+     */
+    void init(Direction direction, const std::string& key, const std::string& iv, CipherMode mode = CipherMode::AES_256_CBC);
+
+    /**
+     * Start a new message with the cipher and key from the last init,
+     * keeping the expanded key schedule
+     *
+     * @param iv Initialization vector for the new message
+     */
+    void reset(const std::string& iv);
+
+    /**
+     * Process the next part of the message
+     *
+     * @param data Input bytes
+     * @param length Number of input bytes
+     * @param sink Receives the produced output, possibly several times
+     */
+    void update(const unsigned char* data, size_t length, const Sink& sink);
+
+    /**
+     * Process the next part of the message into a caller-provided buffer
+     *
+     * @param output Must hold length + EVP_MAX_BLOCK_LENGTH bytes; may equal data in CTR mode
+     * @return Number of bytes written
+     */
+    size_t update(const unsigned char* data, size_t length, unsigned char* output);
+
+    /**
+     * Flush the final block
+     *
+     * @param sink Receives the remaining output
+     * @return false if the cipher rejected the message (e.g. bad padding)
+     */
+    bool final(const Sink& sink);
+
+    /**
+     * Authenticated modes only: data covered by the tag but not encrypted.
+     * Call after init/reset and before the first update.
+     */
+    void addAad(const unsigned char* data, size_t length);
+
+    // Authenticated modes only: tag of the message just encrypted, valid after final
+    void getTag(unsigned char* tag);
+
+    // Authenticated modes only: expected tag, set before final when decrypting
+    void setTag(const unsigned char* tag);
+
+    // Mode of the last init
+    CipherMode getMode() const;
+
+    // AES_256_GCM and CHACHA20_POLY1305, whose messages carry a tag
+    static bool isAuthenticated(CipherMode mode);
+
+    // Size of the ciphertext produced for a plaintext of the given length
+    static size_t ciphertextLength(CipherMode mode, size_t plaintextLength);
+
+    static size_t keyLength(CipherMode mode);
+    static size_t ivLength(CipherMode mode);
+
+private:
+    EVP_CIPHER_CTX* ctx;
+    CipherMode mode;
+    std::vector<unsigned char> outbuf;
+
+    static const EVP_CIPHER* cipherFor(CipherMode mode);
+    static std::string fitToLength(const std::string& value, size_t length);
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef CONTAINER_HPP
+#define CONTAINER_HPP
+
+#include "cipherStream.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MappedFile;
+class SubstitutionTable;
+
+/**
+ * Fixed-size header at the start of every container.
+ *
+ * Container layout (all integers little-endian):
+ *
+ *   header      SIZE bytes, see serialize()
+ *   chunk 0..n  u32 stored length, then the chunk's ciphertext (and tag)
+ *   seal        authenticated modes only: 16-byte tag, see below
+ *   index       one INDEX_ENTRY_SIZE entry per chunk
+ *   footer      u64 index offset, u64 chunk count, u64 plaintext size, "XCRI", u32 0
+ *
+ * Every chunk holds chunkSize plaintext bytes (the last one may hold fewer)
+ * and is encrypted on its own, so any byte range can be decrypted by
+ * reading only the chunks it overlaps.
+ *
+ * In the authenticated modes (AES_256_GCM, CHACHA20_POLY1305) every chunk's tag covers the header and the chunk's
+ * index, so altered, swapped or foreign chunks are rejected before any of
+ * their plaintext is substituted back or returned. The seal is a tag over
+ * the header, chunk count and plaintext size alone; readers check it when
+ * opening, so a wrong key or an edited header or footer fails at once
+ * instead of after decrypting the data.
+ */
+struct ContainerHeader {
+    static const size_t SIZE = 48;
+    static const uint16_t VERSION = 1;
+
+    // Layer flags
+    static const uint8_t LAYER_SUBSTITUTION = 1 << 0;
+
+    uint16_t version = VERSION;
+    CipherMode mode = CipherMode::AES_256_GCM;
+    uint8_t layers = LAYER_SUBSTITUTION;
+    uint32_t keyId = 0;
+    uint32_t chunkSize = 0;
+    // Random per container; chunk IVs are derived from it
+    std::array<uint8_t, 16> nonce{};
+
+    void serialize(unsigned char* output) const;
+
+    /**
+     * @throws std::runtime_error if data does not start with a supported header
+     */
+    static ContainerHeader parse(const unsigned char* data, size_t length);
+
+    // Whether data starts with the container magic
+    static bool matches(const unsigned char* data, size_t length);
+
+    /**
+     * IV of a chunk. CBC and CTR advance the nonce by the blocks of all
+     * chunks before it; the authenticated modes add index to the low 64
+     * bits of the nonce's first 12 bytes.
+     */
+    std::string chunkIV(uint64_t index) const;
+
+    // Bytes a chunk of plainLength takes up after its length prefix
+    size_t storedLength(size_t plainLength) const;
+};
+
+/**
+ * Streams plaintext into a container, one chunk at a time.
+ */
+class ContainerWriter {
+public:
+    static const uint32_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+
+    struct Options {
+        CipherMode mode = CipherMode::AES_256_GCM;
+        uint32_t chunkSize = DEFAULT_CHUNK_SIZE;
+        uint32_t keyId = 0;
+        bool substitution = true;
+    };
+
+    /**
+     * @param table Substitution layer, ignored when options.substitution is false
+     * @param sink Receives the container bytes in order
+     */
+    ContainerWriter(const SubstitutionTable& table, const std::string& key, const Options& options,
+        const CipherStream::Sink& sink);
+    ContainerWriter(const SubstitutionTable& table, const std::string& key, const CipherStream::Sink& sink);
+
+    /**
+     * Continue a container whose header and first chunkCount (full) chunks
+     * were already written. The sink receives the bytes after them.
+     */
+    ContainerWriter(const SubstitutionTable& table, const std::string& key, const ContainerHeader& header,
+        uint64_t chunkCount, const CipherStream::Sink& sink);
+
+    ContainerWriter(const ContainerWriter&) = delete;
+    ContainerWriter& operator=(const ContainerWriter&) = delete;
+
+    void write(const unsigned char* data, size_t length);
+
+    // Flush the last chunk and write the index and footer
+    void finish();
+
+    const ContainerHeader& header() const;
+
+    // Complete chunks written so far; a partial last chunk is still buffered
+    uint64_t committedChunks() const;
+
+    // Container bytes up to the end of committedChunks()
+    uint64_t committedSize() const;
+
+    // Container size after the header and count full chunks
+    static uint64_t sizeAfter(const ContainerHeader& header, uint64_t count);
+
+private:
+    const SubstitutionTable& table;
+    std::string key;
+    CipherStream::Sink sink;
+    ContainerHeader head;
+    CipherStream stream;
+    bool streamReady;
+
+    std::vector<unsigned char> pending;
+    std::vector<unsigned char> work;
+    std::vector<unsigned char> record;
+    std::vector<unsigned char> index;
+    uint64_t offset;
+    uint64_t plaintextSize;
+    uint64_t chunkCount;
+    bool finished;
+
+    void start(const Options& options);
+    void startCipher(const std::string& iv);
+    void emit(const unsigned char* data, size_t length);
+    void writeChunk(const unsigned char* data, size_t length);
+};
+
+/**
+ * Random access to a container held in memory or in a (memory mapped) file.
+ */
+class ContainerReader {
+public:
+    struct Chunk {
+        uint64_t offset;
+        uint32_t storedLength;
+        uint32_t plainLength;
+    };
+
+    /**
+     * @throws std::runtime_error if the container is malformed, or for
+     *         an authenticated mode if the key is wrong or the header or footer was altered
+     */
+    ContainerReader(const SubstitutionTable& table, const std::string& key, const std::string& path);
+    // data must stay valid for the reader's lifetime
+    ContainerReader(const SubstitutionTable& table, const std::string& key, const unsigned char* data, size_t length);
+
+    /**
+     * Reader over the first chunkCount chunks of a container that is still
+     * being written and has no index or footer yet
+     *
+     * @throws std::runtime_error if data is shorter than those chunks
+     */
+    ContainerReader(const SubstitutionTable& table, const std::string& key, const unsigned char* data, size_t length,
+        const ContainerHeader& header, uint64_t chunkCount);
+    ~ContainerReader();
+
+    ContainerReader(const ContainerReader&) = delete;
+    ContainerReader& operator=(const ContainerReader&) = delete;
+
+    const ContainerHeader& header() const;
+    uint64_t size() const;
+    size_t chunkCount() const;
+    const Chunk& chunk(size_t index) const;
+
+    /**
+     * Decrypt plaintext bytes [offset, offset + length) into output,
+     * touching only the chunks the range overlaps
+     *
+     * @return Bytes written, fewer than length only at the end of the data
+     * @throws std::out_of_range if offset lies beyond the end
+     * @throws std::runtime_error if a chunk fails to decrypt or to authenticate
+     */
+    size_t read(uint64_t offset, size_t length, unsigned char* output);
+    std::string read(uint64_t offset, size_t length);
+
+private:
+    const SubstitutionTable& table;
+    std::string key;
+    std::unique_ptr<MappedFile> file;
+    const unsigned char* data;
+    size_t length;
+
+    ContainerHeader head;
+    std::vector<Chunk> chunks;
+    uint64_t plaintextSize;
+    CipherStream stream;
+    bool streamReady;
+    std::vector<unsigned char> work;
+    // Authenticated chunk whose plaintext is in work, SIZE_MAX if none
+    size_t cachedChunk;
+
+    void parse();
+    void startCipher(const std::string& iv);
+    size_t readChunk(size_t index, size_t from, size_t count, unsigned char* output);
+};
+
+#endif
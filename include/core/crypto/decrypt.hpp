@@ -1,15 +1,39 @@
 #ifndef DECRYPT_HPP
 #define DECRYPT_HPP
 
+#include "cipherStream.hpp"
+#include "textEncoding.hpp"
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <map>
 
+class CipherSession;
+class KeyRing;
+class SubstitutionTable;
+
 class Decrypt {
 public:
     static std::string decryptString(const std::map<char, char>& charMapping, const std::string& encrypted);
+    static std::string decryptString(const SubstitutionTable& table, const std::string& encrypted);
     static std::string decryptAES(const std::string& ciphertext, const std::string& key, const std::string& iv);
+    static std::string decryptAES(CipherSession& session, const std::string& ciphertext);
+    // Reverse of Encrypt::encryptAESParallel; throws std::invalid_argument if the IV is cut short
+    static std::string decryptAESParallel(const std::string& ciphertext, const std::string& key, unsigned threads = 0);
     static std::string base64Decode(const std::string& input);
-    static std::string decryptLayered(const std::map<char, char>& charMapping, const std::string& encrypted, const std::string& aesKey, const std::string& iv);
+    // With an authenticated mode, either authenticated backend is accepted: the message names its own
+    static std::string decryptLayered(const std::map<char, char>& charMapping, const std::string& encrypted, const std::string& aesKey, const std::string& iv,
+        CipherMode mode = CipherMode::AES_256_CBC);
+    // Under the generation the message's prefix names (0 without one); throws std::runtime_error if the ring lacks it
+    static std::string decryptLayered(const KeyRing& ring, const std::string& encrypted, const std::string& aesKey, const std::string& iv,
+        CipherMode mode = CipherMode::AES_256_CBC);
+    static std::string decryptLayered(const SubstitutionTable& table, const std::string& encrypted, CipherSession& session);
+    // Compressed messages are recognized and inflated automatically
+    static std::string decryptLayered(const SubstitutionTable& table, const std::string& encrypted, CipherSession& session, Encoding encoding);
+    static std::string decryptContainer(const SubstitutionTable& table, const std::string& container, const std::string& aesKey);
+    // Plaintext bytes [offset, offset + length) of a container, decrypting only the chunks they fall in
+    static std::string decryptRange(const SubstitutionTable& table, const std::string& container, const std::string& aesKey, uint64_t offset, size_t length);
+    static std::string decryptRangeFromFile(const SubstitutionTable& table, const std::string& path, const std::string& aesKey, uint64_t offset, size_t length);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,95 @@
+#ifndef DIRECTORYCRYPT_HPP
+#define DIRECTORYCRYPT_HPP
+
+#include "batchIo.hpp"
+#include "cipherStream.hpp"
+#include "layeredPipeline.hpp"
+#include "textEncoding.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SubstitutionTable;
+
+/**
+ * Layered encryption of a whole directory tree on a work-stealing pool.
+ *
+ * Every regular file becomes one job, written to the same relative path
+ * under the output directory. In CTR mode files above SPLIT_THRESHOLD are
+ * further split into CHUNK_SIZE jobs that each substitute, encrypt and
+ * encode their own range and write it at its final offset, so one huge file
+ * is spread over all workers instead of holding one of them up. Files up to
+ * SMALL_FILE_SIZE are handled BATCH_FILES at a time through BatchIo, so
+ * with io_uring a whole batch is opened, read, written and closed with a
+ * handful of syscalls.
+ *
+ * With compression every file is encrypted whole, since its output size is
+ * only known once it has been compressed. Decryption detects compressed
+ * files on its own and routes them the same way.
+ *
+ * In CTR and the authenticated modes each file starts with a
+ * LayeredPipeline frame head holding a random nonce that serves as its IV,
+ * so neither two files nor two encryptions of one file share a keystream.
+ * Split files write the same head before their first chunk. CBC files are
+ * unframed and use an IV derived from the configured IV and the file's
+ * relative path, so they must be decrypted under the same relative path
+ * they were encrypted with.
+ */
+class DirectoryCrypt {
+public:
+    // Don't allow instantiation
+    DirectoryCrypt() = delete;
+
+    // Multiple of 48, so chunks hold whole AES blocks and whole base64 groups
+    static const size_t CHUNK_SIZE = 6 * 1024 * 1024;
+    static const size_t SPLIT_THRESHOLD = 2 * CHUNK_SIZE;
+
+    static const size_t SMALL_FILE_SIZE = 64 * 1024;
+    static const size_t BATCH_FILES = 32;
+
+    struct Stats {
+        size_t files = 0;
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        double seconds = 0;
+        // One "path: reason" entry per file that could not be processed
+        std::vector<std::string> errors;
+        // Backend used for small files and the syscalls it made
+        std::string ioBackend;
+        uint64_t ioSyscalls = 0;
+
+        double megabytesPerSecond() const;
+    };
+
+    /**
+     * Encrypt or decrypt every file below inputDir into outputDir. A failing
+     * file is reported in Stats::errors and does not stop the others.
+     *
+     * @param threads Worker count, 0 uses std::thread::hardware_concurrency
+     * @param io I/O backend for small files
+     * @param encoding Final layer of the encrypted files
+     * @param compression Applied to every file before encryption
+     * @throws std::invalid_argument if inputDir is not a directory or
+     *         outputDir lies inside it
+     * @throws std::runtime_error if io is URING and io_uring is unavailable
+     */
+    static Stats encryptTree(const SubstitutionTable& table, const std::string& key, const std::string& iv,
+        CipherMode mode, const std::string& inputDir, const std::string& outputDir, unsigned threads = 0,
+        BatchIo::Backend io = BatchIo::Backend::AUTO, Encoding encoding = Encoding::BASE64,
+        Compression compression = Compression::NONE);
+    static Stats decryptTree(const SubstitutionTable& table, const std::string& key, const std::string& iv,
+        CipherMode mode, const std::string& inputDir, const std::string& outputDir, unsigned threads = 0,
+        BatchIo::Backend io = BatchIo::Backend::AUTO, Encoding encoding = Encoding::BASE64);
+
+    // IV the file at relativePath starts from: SHA-256(iv, path) cut to 16 bytes. Framed modes replace it with their nonce
+    static std::string fileIV(const std::string& iv, const std::string& relativePath);
+
+private:
+    static Stats processTree(CipherStream::Direction direction, const SubstitutionTable& table,
+        const std::string& key, const std::string& iv, CipherMode mode,
+        const std::string& inputDir, const std::string& outputDir, unsigned threads, BatchIo::Backend io,
+        Encoding encoding, Compression compression);
+};
+
+#endif
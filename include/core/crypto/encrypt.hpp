@@ -1,15 +1,35 @@
 #ifndef ENCRYPT_HPP
 #define ENCRYPT_HPP
 
+#include "layeredPipeline.hpp"
+#include "textEncoding.hpp"
 #include <string>
 #include <map>
 
+class CipherSession;
+class KeyRing;
+class SubstitutionTable;
+
 class Encrypt {
 public:
     static std::string encryptString(const std::map<char, char>& charMapping, const std::string& input);
+    static std::string encryptString(const SubstitutionTable& table, const std::string& input);
     static std::string encryptAES(const std::string& plaintext, const std::string& key, const std::string& iv);
+    static std::string encryptAES(CipherSession& session, const std::string& plaintext);
+    // AES-256-CTR across threads under a random IV, which is put in front of the ciphertext
+    static std::string encryptAESParallel(const std::string& plaintext, const std::string& key, unsigned threads = 0);
     static std::string base64Encode(const std::string& input);
-    static std::string encryptLayered(const std::map<char, char>& charMapping, const std::string& input, const std::string& aesKey, const std::string& iv);
+    static std::string encryptLayered(const std::map<char, char>& charMapping, const std::string& input, const std::string& aesKey, const std::string& iv,
+        CipherMode mode = CipherMode::AES_256_CBC);
+    // Under the ring's active generation, prefixed with its key id; aesKey is used by a legacy generation
+    static std::string encryptLayered(const KeyRing& ring, const std::string& input, const std::string& aesKey, const std::string& iv,
+        CipherMode mode = CipherMode::AES_256_CBC);
+    static std::string encryptLayered(const SubstitutionTable& table, const std::string& input, CipherSession& session);
+    // Same layers with a different final stage (e.g. Encoding::RAW for binary output) and optional compression first
+    static std::string encryptLayered(const SubstitutionTable& table, const std::string& input, CipherSession& session, Encoding encoding,
+        Compression compression = Compression::NONE);
+    // Binary container (see ContainerHeader) with AES-256-GCM and 1 MB chunks
+    static std::string encryptContainer(const SubstitutionTable& table, const std::string& input, const std::string& aesKey);
 };
 
 #endif
\ No newline at end of file
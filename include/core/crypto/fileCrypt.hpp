@@ -0,0 +1,63 @@
+#ifndef FILECRYPT_HPP
+#define FILECRYPT_HPP
+
+#include "cipherStream.hpp"
+#include "layeredPipeline.hpp"
+#include "textEncoding.hpp"
+#include <cstddef>
+#include <string>
+
+class SubstitutionTable;
+
+/**
+ * Layered encryption of files of any size.
+ *
+ * The input is memory mapped and pushed through LayeredPipeline one chunk at
+ * a time; each chunk's pages are released once processed and the output is
+ * streamed, so resident memory stays around CHUNK_SIZE however large the
+ * file is.
+ *
+ * The table should normally come from SubstitutionTable::withPassthrough(),
+ * since files hold bytes outside the key's alphabet.
+ */
+class FileCrypt {
+public:
+    // Don't allow instantiation
+    FileCrypt() = delete;
+
+    // Part of the mapping processed (and then released) per step
+    static const size_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+    /**
+     * Run the layered pipeline over a file, sending the output to sink
+     *
+     * @param stream Cipher layer, already initialized for this message
+     * @param encoding Final layer of the output (encrypt) or input (decrypt)
+     * @param compression Applied when encrypting; detected when decrypting
+     * @throws std::runtime_error if the file cannot be mapped or decryption fails
+     */
+    static void process(CipherStream::Direction direction, const SubstitutionTable& table, CipherStream& stream,
+        const std::string& inputPath, const CipherStream::Sink& sink, Encoding encoding = Encoding::BASE64,
+        Compression compression = Compression::NONE);
+
+    /**
+     * Encrypt or decrypt inputPath into outputPath. The output is written to
+     * "<outputPath>.part" and renamed into place only once complete, so a
+     * failure never leaves a truncated file behind.
+     *
+     * @return Number of bytes written
+     * @throws std::runtime_error on I/O or decryption failure
+     * @throws std::invalid_argument if both paths name the same file
+     */
+    static size_t encryptFile(const SubstitutionTable& table, CipherStream& stream,
+        const std::string& inputPath, const std::string& outputPath, Encoding encoding = Encoding::BASE64,
+        Compression compression = Compression::NONE);
+    static size_t decryptFile(const SubstitutionTable& table, CipherStream& stream,
+        const std::string& inputPath, const std::string& outputPath, Encoding encoding = Encoding::BASE64);
+
+private:
+    static size_t processToFile(CipherStream::Direction direction, const SubstitutionTable& table, CipherStream& stream,
+        const std::string& inputPath, const std::string& outputPath, Encoding encoding, Compression compression);
+};
+
+#endif
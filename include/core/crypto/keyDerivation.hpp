@@ -0,0 +1,133 @@
+#ifndef KEYDERIVATION_HPP
+#define KEYDERIVATION_HPP
+
+#include "lockedBuffer.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Password-based derivation of the key that encrypts key files.
+ *
+ * Either PBKDF2-HMAC-SHA256 or scrypt from OpenSSL, with the cost stored
+ * next to the salt in every key file so files written under different
+ * settings all stay readable. A derived key is computed once per process:
+ * it is cached in a LockedBuffer together with its parameters and salt, and
+ * a key file written later by the same process reuses that salt, so a high
+ * work factor costs one slow derivation at startup instead of one per key
+ * operation. Each key file still gets its own random IV.
+ */
+class KeyDerivation {
+public:
+    // Don't allow instantiation
+    KeyDerivation() = delete;
+    ~KeyDerivation() = delete;
+
+    // Stored in key files, do not renumber
+    enum class Algorithm : uint8_t {
+        PBKDF2_SHA256 = 1,
+        SCRYPT = 2
+    };
+
+    struct Params {
+        Algorithm algorithm = Algorithm::SCRYPT;
+        // PBKDF2 iterations, or log2 of the scrypt cost N
+        uint32_t cost = DEFAULT_SCRYPT_LOG_N;
+        // scrypt block size r and parallelism p, unused by PBKDF2
+        uint8_t blockSize = 8;
+        uint8_t parallelism = 1;
+
+        bool operator==(const Params& other) const;
+    };
+
+    static const size_t KEY_SIZE = 32;
+    static const size_t SALT_SIZE = 16;
+    static const uint32_t DEFAULT_PBKDF2_ITERATIONS = 600000;
+    static const uint32_t DEFAULT_SCRYPT_LOG_N = 15;
+    static const uint32_t MIN_PBKDF2_ITERATIONS = 10000;
+    static const uint32_t MIN_SCRYPT_LOG_N = 10;
+    // Bounds that keep a hostile key file from stalling or exhausting the process
+    static const uint32_t MAX_PBKDF2_ITERATIONS = 100000000;
+    static const uint32_t MAX_SCRYPT_LOG_N = 24;
+    static const uint64_t MAX_SCRYPT_MEMORY = 1024ull * 1024 * 1024;
+
+    // Derived key with the inputs needed to derive it again
+    class Key {
+    public:
+        Key(const Params& params, const uint8_t* salt);
+
+        const Params& params() const;
+        const uint8_t* salt() const;
+        // KEY_SIZE bytes, in locked memory that is wiped once the last holder lets go
+        const uint8_t* data() const;
+        bool isLocked() const;
+
+    private:
+        friend class KeyDerivation;
+
+        Params derivedWith;
+        std::array<uint8_t, SALT_SIZE> saltBytes;
+        // The key, then a digest of salt and password to recognize the password by
+        LockedBuffer secret;
+    };
+
+    // "pbkdf2" or "scrypt"; @return false for unknown names
+    static bool parse(const std::string& name, Algorithm& algorithm);
+    static const char* name(Algorithm algorithm);
+
+    // Recommended cost of algorithm
+    static Params defaults(Algorithm algorithm);
+
+    /**
+     * Parameters for new key files from XCREEPTOR_KDF ("scrypt" or "pbkdf2",
+     * default scrypt) and XCREEPTOR_KDF_COST (iterations, or log2 N for
+     * scrypt; default per algorithm). Call EnvManager::load() first.
+     *
+     * @throws std::invalid_argument if either variable is invalid
+     */
+    static Params configured();
+
+    /**
+     * @throws std::invalid_argument if the cost is below the minimum or above the bounds
+     */
+    static void validate(const Params& params);
+
+    /**
+     * Key derived from password and salt, computed on the first call and
+     * served from the process-wide cache afterwards. Threads asking for the
+     * same key wait for one derivation; different keys derive in parallel.
+     *
+     * @param salt SALT_SIZE bytes
+     * @throws std::invalid_argument if params are not valid
+     * @throws std::runtime_error if the derivation fails
+     */
+    static std::shared_ptr<const Key> derive(const std::string& password, const Params& params, const uint8_t* salt);
+
+    /**
+     * Key for writing a key file: a cached key for this password and params
+     * if there is one, otherwise one derived under a fresh random salt
+     */
+    static std::shared_ptr<const Key> forWriting(const std::string& password, const Params& params);
+
+    // Forget every cached key (their memory is wiped once no caller holds them)
+    static void clearCache();
+
+private:
+    // Least recently used keys go first; each holds one locked page
+    static const size_t MAX_CACHED_KEYS = 64;
+
+    static void passwordDigest(const std::string& password, const uint8_t* salt, uint8_t* digest);
+    static bool matches(const Key& key, const std::string& password);
+    // Fill in the key bytes of key, whose params and salt are set
+    static void compute(Key& key, const std::string& password);
+    /**
+     * Cached key for password and params under salt, or under any salt if salt
+     * is nullptr, derived (under a fresh salt if none is given) on a miss
+     */
+    static std::shared_ptr<const Key> lookup(const std::string& password, const Params& params, const uint8_t* salt);
+    static uint64_t scryptMemory(const Params& params);
+};
+
+#endif
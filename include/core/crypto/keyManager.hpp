@@ -1,18 +1,108 @@
 #ifndef KEYMANAGER_HPP
 #define KEYMANAGER_HPP
 
+#include "keyRing.hpp"
+#include "substitutionTable.hpp"
+#include <cstddef>
+#include <cstdint>
 #include <map>
 #include <string>
 
+class CipherSession;
+class LockedBuffer;
+
+/**
+ * Key files.
+ *
+ * A key file starts with a 48-byte header: 0x89 "XCK", u16 format version,
+ * u16 zero, the key derivation (u8 algorithm, u8 scrypt r, u8 scrypt p,
+ * u8 zero, u32 cost), a 16-byte salt and a 16-byte IV. After it comes the
+ * AES-256-CBC encryption of the serialized key ring and its SHA-256, under a
+ * key KeyDerivation derives from the password. The ring holds every
+ * generation's substitution tables ready to use, so loading is one read, one
+ * decrypt and a checksum, with nothing to rebuild.
+ *
+ * A key file can instead be under a wrapping key the caller holds: the
+ * algorithm byte is then 0, salt and cost are zero, and the KEY_SIZE
+ * wrapping key encrypts the ring directly. Loading such a file involves no
+ * key derivation at all. TenantKeyStore keeps its tenants this way, with
+ * the wrapping key itself in a password-protected file (openWrappingKey).
+ *
+ * Older files are still read: format 2 (an 8-byte header) and the base64
+ * text before it, both encrypted under the password padded with 'x'. The
+ * first header byte is outside the base64 alphabet, which tells them apart.
+ * They are rewritten in the current format on the next save.
+ */
 class KeyManager {
 public:
+    static const uint16_t KEY_FILE_VERSION = 3;
+
     static void saveKeyToFile(const std::map<char, char>& key, const std::string& filename, const std::string& password);
-    static std::map<char, char> loadKeyFromFile(const std::string& filename, const std::string& password);
+    // Loads the active key and throws if it cannot be read, leaving the file untouched
+    static SubstitutionTable readKeyFile(const std::string& filename, const std::string& password);
     static std::map<char, char> generateKey();
+
+    // Under wrappingKey if given, otherwise under a key derived from password
+    static void saveKeyRing(const KeyRing& ring, const std::string& filename, const std::string& password,
+        const LockedBuffer* wrappingKey = nullptr);
+    /**
+     * Loads the ring (a legacy key file becomes generation 0) and throws if
+     * it cannot be read, leaving the file untouched. Files under a wrapping
+     * key need wrappingKey; all others are read with password.
+     */
+    static KeyRing readKeyRing(const std::string& filename, const std::string& password,
+        const LockedBuffer* wrappingKey = nullptr);
+
+    /**
+     * Add a generation with a fresh mapping and AES key, make it the active
+     * one and save the ring. Only the key file is rewritten; data under older
+     * generations stays readable.
+     *
+     * Read, rotate and write happen under an advisory lock on
+     * "<filename>.lock", and the ring rotated is the one in the file (ring
+     * itself only if there is no file yet), so concurrent rotations in other
+     * threads or processes each add their generation. ring is replaced by
+     * the saved result.
+     *
+     * @throws std::runtime_error if the existing file cannot be read; it is then left untouched
+     */
+    static const KeyRing::Generation& rotateKey(KeyRing& ring, const std::string& filename, const std::string& password,
+        const LockedBuffer* wrappingKey = nullptr);
+
+    /**
+     * Write a ring with one generation, a fresh mapping and its own AES key,
+     * under the same lock as rotateKey
+     *
+     * @throws std::runtime_error if filename already exists
+     */
+    static KeyRing createKeyRing(const std::string& filename, const std::string& password,
+        const LockedBuffer* wrappingKey = nullptr);
+
+    /**
+     * Fill key (KeyDerivation::KEY_SIZE bytes) with the wrapping key stored
+     * in filename under password, first writing a random one if there is no
+     * such file. Holds the same lock as rotateKey, so processes opening a
+     * new store at once agree on one key.
+     *
+     * @throws std::runtime_error if the file cannot be read or holds no wrapping key
+     */
+    static void openWrappingKey(const std::string& filename, const std::string& password, LockedBuffer& key);
 private:
     static const std::string keyboardChars;
-    static std::string encryptKeyData(const std::string& data, const std::string& password);
-    static std::string decryptKeyData(const std::string& data, const std::string& password);
+    static const size_t GENERATED_AES_KEY_SIZE = 32;
+    static const size_t KEY_FILE_HEADER_SIZE = 48;
+    // Advisory lock taken around read-modify-write of filename; creates its directory
+    static std::string lockFile(const std::string& filename);
+    static std::string generateAesKey();
+    static void writeKeyData(const std::string& data, const std::string& filename, const std::string& password,
+        const LockedBuffer* wrappingKey);
+    static std::string readKeyData(const std::string& filename, const std::string& password,
+        const LockedBuffer* wrappingKey);
+    static std::map<char, char> parseLegacyKey(const std::string& data);
+    // Base64 key data of releases before the binary format
+    static std::string decryptLegacyKeyData(const std::string& data, const std::string& password);
+    // Password padded with 'x' into key and IV, as files before format 3 were encrypted
+    static CipherSession& legacySession(const std::string& password);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef KEYRING_HPP
+#define KEYRING_HPP
+
+#include "substitutionTable.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Every key generation ever used, so rotating the key never strands data.
+ *
+ * A generation is a substitution mapping plus an AES key under a stable id.
+ * New data is encrypted under the active generation and names its id:
+ * containers in ContainerHeader::keyId, text messages with a PREFIX_SIZE
+ * prefix ("@k", eight hex digits, "."). Decryption looks the id up instead
+ * of trying keys. Generation 0 is the key of a legacy key file; its
+ * messages carry no prefix, so everything encrypted before key rings
+ * existed is read as generation 0.
+ *
+ * Serialized layout (little-endian): "XCKR", u16 version, u16 count,
+ * u32 active id, then per generation u32 id, i64 creation time (Unix
+ * seconds), u8 AES key length, the AES key and the substitution tables as
+ * SubstitutionTable::serialize writes them. Version 1 rings stored the
+ * mapping as a u8 pair count and from/to byte pairs; they are still read.
+ */
+class KeyRing {
+public:
+    static const uint16_t VERSION = 2;
+    static const size_t PREFIX_SIZE = 11;
+
+    struct Generation {
+        uint32_t id = 0;
+        int64_t created = 0;
+        // Strict table of the key's alphabet, as stored in the key file
+        SubstitutionTable table;
+        // Empty for a legacy generation, which uses the configured XCREEPTOR_AES_KEY
+        std::string aesKey;
+
+        // AES key of this generation, configuredKey if it has none of its own
+        const std::string& cipherKey(const std::string& configuredKey) const;
+    };
+
+    // Empty ring, no generation is active
+    KeyRing();
+    // Ring holding table as legacy generation 0
+    explicit KeyRing(const SubstitutionTable& legacyTable);
+
+    /**
+     * @throws std::logic_error if the ring is empty
+     */
+    const Generation& active() const;
+
+    // @return nullptr if no generation has this id
+    const Generation* find(uint32_t id) const;
+
+    /**
+     * @throws std::runtime_error if no generation has this id
+     */
+    const Generation& get(uint32_t id) const;
+
+    /**
+     * Add a generation under the next free id and make it the active one.
+     * Older generations stay, so their data keeps decrypting.
+     */
+    const Generation& rotate(const SubstitutionTable& table, const std::string& aesKey);
+
+    const std::vector<Generation>& generations() const;
+    bool empty() const;
+
+    std::string serialize() const;
+
+    /**
+     * @throws std::runtime_error if data is not a serialized ring
+     */
+    static KeyRing parse(const std::string& data);
+
+    // Whether data starts like a serialized ring rather than a legacy key
+    static bool matches(const std::string& data);
+
+    // Text to put in front of a message encrypted under id, empty for generation 0
+    static std::string prefix(uint32_t id);
+
+    /**
+     * Key id named by the prefix at the start of a message
+     *
+     * @return false if text has no prefix (a generation 0 or legacy message)
+     */
+    static bool readPrefix(const unsigned char* text, size_t length, uint32_t& id);
+
+private:
+    std::vector<Generation> entries;
+    // Generation id -> position in entries
+    std::unordered_map<uint32_t, size_t> byId;
+    uint32_t activeId;
+
+    void add(const Generation& generation);
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef LAYEREDPIPELINE_HPP
+#define LAYEREDPIPELINE_HPP
+
+#include "cipherStream.hpp"
+#include "textEncoding.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+class SubstitutionTable;
+class ZlibStream;
+
+enum class Compression {
+    NONE,
+    // zlib deflate ahead of the substitution layer
+    ZLIB
+};
+
+/**
+ * Single-pass substitution -> cipher -> encoding pipeline (and its reverse).
+ *
+ * The final stage defaults to base64; Encoding::RAW skips it and emits the
+ * ciphertext itself, which is a quarter smaller and needs no decode pass.
+ *
+ * With Compression::ZLIB the plaintext is deflated first. The cipher then
+ * sees MARKER followed by the substituted zlib stream, and decryption
+ * checks for MARKER to inflate automatically. Compressed bytes are binary,
+ * so they are substituted with the passthrough form of the table. A
+ * plaintext that would itself start with MARKER is stored as an
+ * uncompressed (level 0) zlib stream so it cannot be mistaken for one.
+ *
+ * With AES_256_CTR or an authenticated cipher (AES_256_GCM,
+ * CHACHA20_POLY1305) the ciphertext is framed as the backend's id byte, a
+ * random nonce that replaces the stream's IV, the ciphertext and, for the
+ * authenticated ones, the tag. CTR pads the head with one zero byte so
+ * its ciphertext starts on a whole base64 group. A fixed IV would repeat
+ * the keystream for every message under the key, which these modes cannot
+ * survive. CBC messages stay unframed. Decryption still streams, so the output of an
+ * authenticated message must only be trusted once final() returned true.
+ *
+ * Input is processed in BLOCK_SIZE pieces that pass through all layers
+ * while still cache resident, so no full-size intermediate copies of the
+ * payload are ever made.
+ */
+class LayeredPipeline {
+public:
+    using Sink = CipherStream::Sink;
+
+    // Plaintext (encrypt) or encoded text (decrypt) handled per step
+    static const size_t BLOCK_SIZE = 48 * 1024;
+
+    // Start of the cipher input of every compressed message
+    static const size_t MARKER_SIZE = 8;
+    static const unsigned char MARKER[MARKER_SIZE];
+
+    /**
+     * @param direction ENCRYPT turns plaintext into encoded text, DECRYPT the reverse
+     * @param table Substitution layer
+     * @param stream Cipher layer, already initialized for this message
+     * @param encoding Final layer
+     * @param compression First layer when encrypting; detected when decrypting
+     */
+    LayeredPipeline(CipherStream::Direction direction, const SubstitutionTable& table, CipherStream& stream,
+        Encoding encoding = Encoding::BASE64, Compression compression = Compression::NONE);
+    ~LayeredPipeline();
+
+    LayeredPipeline(const LayeredPipeline&) = delete;
+    LayeredPipeline& operator=(const LayeredPipeline&) = delete;
+
+    /**
+     * Feed the next part of the message
+     *
+     * @throws std::out_of_range for bytes the substitution layer cannot map
+     * @throws std::invalid_argument for malformed text when decrypting
+     * @throws std::runtime_error for corrupt compressed data, or a message
+     *         framed for a different cipher
+     */
+    void update(const unsigned char* data, size_t length, const Sink& sink);
+
+    /**
+     * Flush the remaining output
+     *
+     * @return false if the cipher rejected the message (bad padding or tag)
+     * @throws std::runtime_error if the compressed data is incomplete
+     */
+    bool final(const Sink& sink);
+
+    /**
+     * Whether the message is compressed. When decrypting this is known once
+     * the first plaintext was delivered, or after final().
+     */
+    bool compressed() const;
+
+    // Exact size of the uncompressed output produced for a plaintext of the given length
+    static size_t encodedLength(CipherMode mode, size_t plaintextLength, Encoding encoding = Encoding::BASE64);
+
+    // Whether messages in mode start with an id byte and a random nonce: all but CBC
+    static bool isFramed(CipherMode mode);
+
+    // Bytes the framing adds around the ciphertext, 0 for CBC
+    static size_t framingLength(CipherMode mode);
+
+    // Bytes of the framing in front of the ciphertext: id, nonce and padding
+    static size_t frameHeadLength(CipherMode mode);
+
+    // Fresh frame head for a message in a framed mode, with a random nonce
+    static std::string newFrameHead(CipherMode mode);
+
+    /**
+     * Nonce of a message in a framed mode, read from its decoded frame head
+     *
+     * @param head frameHeadLength(mode) bytes
+     * @throws std::invalid_argument if head was not framed for a framed mode
+     * @throws std::runtime_error if it was framed for a different one
+     */
+    static std::string frameNonce(CipherMode mode, const unsigned char* head);
+
+    /**
+     * Cipher an authenticated message was framed for, read from the start
+     * of its encoded text. A CTR frame is not reported, so a caller that
+     * expects an authenticated message is never switched to CTR.
+     *
+     * @return false if text does not start like an authenticated message
+     */
+    static bool framedMode(const unsigned char* text, size_t length, Encoding encoding, CipherMode& mode);
+
+    /**
+     * Whether an uncompressed plaintext starting with data would be stored
+     * compressed anyway because its substitution collides with MARKER. Code
+     * that lays out uncompressed output itself must not handle those.
+     */
+    static bool collidesWithMarker(const SubstitutionTable& table, const unsigned char* data, size_t length);
+
+private:
+    enum class Stage {
+        // Collecting the first MARKER_SIZE bytes to decide on compression
+        PROBE,
+        PLAIN,
+        COMPRESSED
+    };
+
+    CipherStream::Direction direction;
+    const SubstitutionTable& table;
+    CipherStream& stream;
+    Encoding encoding;
+    Compression compression;
+    bool authenticated;
+    bool framing;
+
+    // Framed modes: id and nonce seen or sent so far. Authenticated modes:
+    // the last TAG_SIZE decoded bytes, held back since they may be the tag
+    bool framed;
+    std::string frameHead;
+    std::string tagTail;
+
+    Stage stage;
+    std::string head;
+    // Active substitution layer: table, or its passthrough form for compressed data
+    const SubstitutionTable* substitution;
+    std::unique_ptr<SubstitutionTable> binaryTable;
+    std::unique_ptr<ZlibStream> zlib;
+
+    std::vector<unsigned char> substituted;
+    std::vector<unsigned char> encoded;
+    std::string pending;
+
+    void startFrame(const Sink& sink);
+    void decipher(const unsigned char* data, size_t length, const Sink& sink);
+    void decide(const Sink& sink);
+    void startCompressed(int level);
+    void encryptData(const unsigned char* data, size_t length, const Sink& sink);
+    void encryptBlock(const unsigned char* data, size_t length, const Sink& sink);
+    void decryptBlock(const unsigned char* data, size_t length, const Sink& sink);
+    void encodeCiphertext(const unsigned char* data, size_t length, const Sink& sink);
+    void decodeText(size_t length, const Sink& sink);
+    void deliverPlaintext(const unsigned char* data, size_t length, const Sink& sink);
+    void substitutePlaintext(const unsigned char* data, size_t length, const Sink& sink);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef PARALLELCTR_HPP
+#define PARALLELCTR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * AES-256-CTR split across threads.
+ *
+ * The keystream for block n only depends on IV + n, so every thread starts
+ * its own context at the counter of its segment. Output is byte-identical to
+ * a single CipherStream in CipherMode::AES_256_CTR. Encryption and
+ * decryption are the same operation.
+ *
+ * The IV is the starting counter and must never repeat under a key: two
+ * messages under the same key and IV share a keystream, and XORing their
+ * ciphertexts gives the XOR of the plaintexts. Give every message a fresh
+ * random IV (Encrypt::encryptAESParallel does) or one derived from a value
+ * that is unique per message.
+ */
+class ParallelCtr {
+public:
+    // Don't allow instantiation
+    ParallelCtr() = delete;
+
+    // Smallest segment worth handing to a separate thread
+    static const size_t MIN_SEGMENT = 1024 * 1024;
+    static const size_t IV_SIZE = 16;
+
+    /**
+     * Apply the keystream to length bytes
+     *
+     * The calling thread works on one segment itself. A segment whose thread
+     * cannot be started runs on the calling thread as well.
+     *
+     * @param iv IV_SIZE bytes, unique per message under key
+     * @param output May equal input
+     * @param threads Worker count, 0 uses std::thread::hardware_concurrency
+     */
+    static void apply(const std::string& key, const std::string& iv, const unsigned char* input,
+        unsigned char* output, size_t length, unsigned threads = 0);
+
+    /**
+     * Apply the keystream to a range that starts at a byte offset of the message
+     * (used for chunked work); offset must be a multiple of 16
+     */
+    static void applyAt(const std::string& key, const std::string& iv, uint64_t offset,
+        const unsigned char* input, unsigned char* output, size_t length);
+
+    // IV advanced by blockIndex as a 128-bit big-endian counter
+    static std::string counterAt(const std::string& iv, uint64_t blockIndex);
+};
+
+#endif
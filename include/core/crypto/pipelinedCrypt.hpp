@@ -0,0 +1,84 @@
+#ifndef PIPELINEDCRYPT_HPP
+#define PIPELINEDCRYPT_HPP
+
+#include "cipherStream.hpp"
+#include "layeredPipeline.hpp"
+#include "textEncoding.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class SubstitutionTable;
+
+/**
+ * Layered encryption with reading, crypto and writing on three threads.
+ *
+ * The stages hand preallocated, page-aligned chunks to each other through
+ * lock-free single-producer/single-consumer rings, and empty chunks travel
+ * back the same way, so nothing is allocated while data flows and the disk
+ * keeps working while the CPU substitutes, encrypts and encodes.
+ *
+ * Every time a stage has to wait is counted in Stats, which is what the
+ * chunk size and queue depth should be tuned against.
+ */
+class PipelinedCrypt {
+public:
+    // Don't allow instantiation
+    PipelinedCrypt() = delete;
+
+    struct Config {
+        // Bytes per chunk, for input and output alike
+        size_t chunkSize = 1024 * 1024;
+        // Chunks in flight between two stages (rounded up to a power of two)
+        size_t queueDepth = 8;
+        // Final layer of the output (encrypt) or input (decrypt)
+        Encoding encoding = Encoding::BASE64;
+        // Compression when encrypting; decryption detects it by itself
+        Compression compression = Compression::NONE;
+        // Bytes the caller already took from input (e.g. to peek at a key id), processed ahead of it
+        std::string inputLead;
+        // Written ahead of the pipeline's own output (e.g. a key id prefix)
+        std::string outputLead;
+    };
+
+    struct StageStats {
+        // Waits for input from the previous stage
+        uint64_t starved = 0;
+        // Waits for a free chunk, i.e. for the next stage to catch up
+        uint64_t blocked = 0;
+        double waitSeconds = 0;
+    };
+
+    struct Stats {
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        double seconds = 0;
+        StageStats reader;
+        StageStats crypto;
+        StageStats writer;
+        // Filled chunks waiting in each queue, sampled whenever one is taken
+        double averageReadQueueDepth = 0;
+        double averageWriteQueueDepth = 0;
+        size_t maxReadQueueDepth = 0;
+        size_t maxWriteQueueDepth = 0;
+    };
+
+    /**
+     * Run the layered pipeline from input to output. Both streams are
+     * switched to unbuffered mode, so pass them before any other I/O.
+     *
+     * @param stream Cipher layer, already initialized for this message
+     * @throws std::runtime_error on I/O or decryption failure
+     * @throws std::out_of_range / std::invalid_argument from the layers
+     */
+    static Stats run(CipherStream::Direction direction, const SubstitutionTable& table, CipherStream& stream,
+        FILE* input, FILE* output, const Config& config);
+    static Stats run(CipherStream::Direction direction, const SubstitutionTable& table, CipherStream& stream,
+        FILE* input, FILE* output);
+
+    // Human readable summary of stats, one stage per line
+    static void printStats(const Stats& stats, FILE* target);
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef REENCRYPTOR_HPP
+#define REENCRYPTOR_HPP
+
+#include "cipherStream.hpp"
+#include "keyRing.hpp"
+#include "substitutionTable.hpp"
+#include "textEncoding.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Background job moving a directory of encrypted files to the key ring's
+ * active generation, so an old generation can be retired.
+ *
+ * Every file below the directory is visited in sorted order on a
+ * work-stealing pool. Its key id is read from the container header or the
+ * text prefix (no prefix means generation 0); files already under the
+ * active generation are skipped after reading those few bytes. The others
+ * are decrypted and re-encrypted in one streaming pass into "<file>.part",
+ * which then replaces the file. Containers keep their cipher, chunk size and
+ * layers, text messages their cipher, encoding and compression.
+ *
+ * Files written by -r trees carry no key id and are not handled here.
+ *
+ * Work is paced per CHUNK_SIZE: bytesPerSecond caps the bytes read plus
+ * written by all workers together, and cpuShare makes every worker sleep so
+ * that it computes at most that fraction of the time. Both leave headroom
+ * for the production workload on the same machine.
+ *
+ * With a checkpoint path the job records, at most once per
+ * CHECKPOINT_SECONDS, the last file up to which every file is done. A
+ * restarted job for the same generation skips those without opening them.
+ * The checkpoint is removed once every file was visited.
+ */
+class Reencryptor {
+public:
+    // Plaintext handled between two pacing decisions
+    static const size_t CHUNK_SIZE = 1024 * 1024;
+    static const int CHECKPOINT_SECONDS = 1;
+
+    struct Options {
+        // Workers, 0 uses std::thread::hardware_concurrency
+        unsigned threads = 0;
+        // Bytes read plus written per second by all workers, 0 for no limit
+        uint64_t bytesPerSecond = 0;
+        // Fraction of each worker's time spent working, in (0, 1]
+        double cpuShare = 1.0;
+        // Cipher of text messages; with an authenticated mode either backend is read from the frame
+        CipherMode mode = CipherMode::AES_256_CBC;
+        // Final layer of text messages
+        Encoding encoding = Encoding::BASE64;
+        // Progress record, empty for none; never visited as a data file
+        std::string checkpointPath;
+    };
+
+    struct Progress {
+        // Found by the walk, including those a checkpoint skipped
+        size_t files = 0;
+        // Visited so far, whatever the outcome
+        size_t done = 0;
+        size_t reencrypted = 0;
+        // Already under the active generation (or skipped by the checkpoint)
+        size_t current = 0;
+        size_t failed = 0;
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        double seconds = 0;
+        // Time workers slept to stay within the budgets, summed over workers
+        double throttledSeconds = 0;
+        bool finished = false;
+
+        // Input bytes re-encrypted per second of wall time
+        double megabytesPerSecond() const;
+    };
+
+    /**
+     * @param aesKey Configured XCREEPTOR_AES_KEY, used by a legacy generation
+     * @param iv Configured IV of CBC text messages; CTR and the authenticated modes read theirs from the frame
+     * @throws std::invalid_argument if cpuShare is outside (0, 1]
+     */
+    Reencryptor(const KeyRing& ring, const std::string& aesKey, const std::string& iv, const Options& options);
+    // Stops and waits for a running job
+    ~Reencryptor();
+
+    Reencryptor(const Reencryptor&) = delete;
+    Reencryptor& operator=(const Reencryptor&) = delete;
+
+    /**
+     * Run the job on a background thread
+     *
+     * @throws std::logic_error if a job is already running
+     */
+    void start(const std::string& directory);
+
+    // Ask a running job to finish early; files being rewritten are abandoned and keep their old generation
+    void stop();
+
+    /**
+     * Wait for the background job
+     *
+     * @throws std::runtime_error if the job could not run at all (e.g. directory missing)
+     */
+    Progress wait();
+
+    // start() and wait() in one
+    Progress run(const std::string& directory);
+
+    // Snapshot of the counters, safe to call while the job runs
+    Progress progress() const;
+
+    // One "path: reason" entry per failed file
+    std::vector<std::string> errors() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pacer {
+        Clock::time_point since;
+    };
+
+    KeyRing ring;
+    std::string aesKey;
+    std::string iv;
+    Options options;
+    std::unordered_map<uint32_t, SubstitutionTable> tables;
+
+    std::thread worker;
+    std::exception_ptr failure;
+    std::atomic<bool> stopping;
+    std::atomic<bool> finished;
+
+    std::atomic<size_t> files;
+    std::atomic<size_t> done;
+    std::atomic<size_t> reencrypted;
+    std::atomic<size_t> current;
+    std::atomic<size_t> failed;
+    std::atomic<uint64_t> bytesRead;
+    std::atomic<uint64_t> bytesWritten;
+    std::atomic<uint64_t> throttledNanoseconds;
+    Clock::time_point startTime;
+    std::atomic<int64_t> elapsedNanoseconds;
+
+    mutable std::mutex errorLock;
+    std::vector<std::string> errorList;
+
+    // Shared byte budget: the time the next byte may be moved
+    std::mutex budgetLock;
+    Clock::time_point nextSlot;
+
+    void process(const std::string& directory);
+    void rewrite(const std::string& path, Pacer& pacer);
+    void rewriteContainer(const std::string& path, const KeyRing::Generation& from, Pacer& pacer);
+    void rewriteText(const std::string& path, const KeyRing::Generation& from, bool prefixed, Pacer& pacer);
+    void pace(Pacer& pacer, uint64_t bytes);
+    const SubstitutionTable& tableFor(const KeyRing::Generation& generation) const;
+};
+
+#endif
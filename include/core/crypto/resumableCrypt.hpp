@@ -0,0 +1,84 @@
+#ifndef RESUMABLECRYPT_HPP
+#define RESUMABLECRYPT_HPP
+
+#include "container.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class SubstitutionTable;
+
+/**
+ * Container encryption of a file that survives the process dying halfway.
+ *
+ * The container is written to "<outputPath>.part". Every CHECKPOINT_INTERVAL
+ * bytes the part file is flushed to disk and "<outputPath>.ckpt" is
+ * replaced with a Checkpoint naming the chunks committed so far and the
+ * header they were encrypted under (its nonce is all the cipher state a
+ * container has between chunks). A resumed run decrypts every committed
+ * chunk and compares it with the input before it trusts it, cuts off
+ * whatever was written after the checkpoint and carries on from the next
+ * chunk. Once the container is complete it is renamed into place and the
+ * checkpoint removed.
+ */
+class ResumableCrypt {
+public:
+    // Don't allow instantiation
+    ResumableCrypt() = delete;
+
+    static const uint64_t CHECKPOINT_INTERVAL = 256 * 1024 * 1024;
+
+    /**
+     * Progress record kept next to the output.
+     *
+     * Layout (little-endian): "XCRK", u16 version, u16 0, container header
+     * (ContainerHeader::SIZE bytes), u64 committed chunks, u64 input size,
+     * i64 input modification time.
+     */
+    struct Checkpoint {
+        static const size_t SIZE = 8 + ContainerHeader::SIZE + 24;
+        static const uint16_t VERSION = 1;
+
+        ContainerHeader header;
+        uint64_t chunks = 0;
+        uint64_t inputSize = 0;
+        int64_t inputTime = 0;
+
+        // Write to path through a temporary file, so a crash leaves the old or the new checkpoint
+        void save(const std::string& path) const;
+
+        /**
+         * @throws std::runtime_error if path holds no valid checkpoint
+         */
+        static Checkpoint load(const std::string& path);
+    };
+
+    struct Result {
+        // Plaintext bytes taken over from an earlier run
+        uint64_t resumedBytes = 0;
+        uint64_t bytesWritten = 0;
+        size_t checkpoints = 0;
+    };
+
+    static std::string partPath(const std::string& outputPath);
+    static std::string checkpointPath(const std::string& outputPath);
+
+    /**
+     * Encrypt inputPath into a container at outputPath
+     *
+     * @param resume Continue from an existing checkpoint; without one the file is started over
+     * @throws std::runtime_error on I/O failure, or when resuming if the input
+     *         changed, options.keyId differs from the checkpoint's or a
+     *         committed chunk does not decrypt back to it
+     * @throws std::invalid_argument if both paths name the same file
+     */
+    static Result encryptFile(const SubstitutionTable& table, const std::string& key,
+        const ContainerWriter::Options& options, const std::string& inputPath, const std::string& outputPath,
+        bool resume = false, uint64_t interval = CHECKPOINT_INTERVAL);
+
+private:
+    static uint64_t verify(const SubstitutionTable& table, const std::string& key, const Checkpoint& checkpoint,
+        const std::string& inputPath, const std::string& partPath);
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SUBSTITUTIONKERNELS_HPP
+#define SUBSTITUTIONKERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Vectorized 256-entry byte translation for the substitution layer.
+ *
+ * Tables use 0 as the "unmapped" marker: every kernel reports whether any
+ * input byte landed on a zero entry so callers can reject it. The best
+ * kernel for the running CPU is picked once via CPUID, with a scalar
+ * fallback everywhere else.
+ */
+namespace SubstitutionKernels {
+    enum class Isa {
+        SCALAR,
+        SSSE3,
+        AVX2,
+        AVX512_VBMI
+    };
+
+    // Best instruction set supported by this CPU and OS (cached after the first call)
+    Isa detect();
+    bool isSupported(Isa isa);
+    const char* name(Isa isa);
+
+    /**
+     * output[i] = table[input[i]] for every byte, using the detected kernel.
+     * Input and output may be the same buffer.
+     *
+     * @return false if any translated byte was 0 (unmapped)
+     */
+    bool translate(const uint8_t* table, const uint8_t* input, uint8_t* output, size_t length);
+
+    // Same, forcing a particular kernel (must be supported)
+    bool translate(Isa isa, const uint8_t* table, const uint8_t* input, uint8_t* output, size_t length);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef SUBSTITUTIONTABLE_HPP
+#define SUBSTITUTIONTABLE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * Flat lookup tables for the substitution cipher.
+ *
+ * Built once from the std::map that KeyManager produces, then every byte is
+ * a single array index instead of a tree walk. Key files store the tables
+ * themselves (see serialize), so loading a key builds nothing.
+ */
+class SubstitutionTable {
+public:
+    // Bytes written by serialize: the mapped-byte bitmap, then the forward and inverse tables
+    static const size_t SERIALIZED_SIZE = 32 + 256 + 256;
+
+    // Empty table, nothing is mapped
+    SubstitutionTable();
+    explicit SubstitutionTable(const std::map<char, char>& charMapping);
+
+    /**
+     * Copy of this table where every unmapped byte maps to itself, so any
+     * binary input can be substituted. Bytes inside the key's alphabet are
+     * substituted exactly as before.
+     *
+     * @throws std::invalid_argument if the key does not permute its own alphabet
+     */
+    SubstitutionTable withPassthrough() const;
+
+    /**
+     * Substitute every byte of input. Input and output must not overlap.
+     *
+     * @throws std::out_of_range if input contains a byte without a mapping
+     */
+    std::string encrypt(const std::string& input) const;
+    void encrypt(const uint8_t* input, uint8_t* output, size_t length) const;
+
+    /**
+     * Reverse the substitution using the precomputed inverse table.
+     * Input and output must not overlap.
+     *
+     * @throws std::out_of_range if input contains a byte no plaintext maps to
+     */
+    std::string decrypt(const std::string& input) const;
+    void decrypt(const uint8_t* input, uint8_t* output, size_t length) const;
+
+    bool isMapped(unsigned char c) const;
+    size_t size() const;
+
+    const std::array<uint8_t, 256>& forwardTable() const;
+    const std::array<uint8_t, 256>& inverseTable() const;
+
+    // Write SERIALIZED_SIZE bytes to out
+    void serialize(uint8_t* out) const;
+
+    /**
+     * Table from SERIALIZED_SIZE bytes written by serialize. Both tables are
+     * copied as they are and only checked to be each other's inverse.
+     *
+     * @throws std::invalid_argument if the tables do not describe one one-to-one mapping
+     */
+    static SubstitutionTable parse(const uint8_t* data);
+
+private:
+    std::array<uint8_t, 256> forward;
+    std::array<uint8_t, 256> inverse;
+    std::array<uint8_t, 256> forwardMapped;
+    std::array<uint8_t, 256> inverseMapped;
+    size_t mappedCount;
+
+    [[noreturn]] static void throwUnmapped(const uint8_t* data, size_t length, const std::array<uint8_t, 256>& mapped);
+};
+
+#endif
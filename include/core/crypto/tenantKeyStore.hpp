@@ -0,0 +1,132 @@
+#ifndef TENANTKEYSTORE_HPP
+#define TENANTKEYSTORE_HPP
+
+#include "keyRing.hpp"
+#include "lockedBuffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Key rings of many tenants, each in its own key file below one directory.
+ *
+ * A tenant's file, "<directory>/<tenant id>.key", is read on first use and
+ * the decoded ring is kept in a bounded LRU cache, so memory follows the
+ * capacity and not the number of tenants. The cache is split into shards by
+ * a hash of the tenant id, each with its own lock and LRU list. Lookups of
+ * different tenants rarely meet on a lock, and a hit is one hash, a short
+ * critical section and a shared_ptr copy. Rings evicted while a caller still
+ * holds them stay valid until released.
+ *
+ * The password is stretched once per store, not once per tenant: it
+ * protects a random store key in "<directory>/.store.key", derived when
+ * the store is opened, and tenant files are under that key (see
+ * KeyManager's wrapping keys). A miss is one file read and one AES decrypt
+ * outside the shard lock, with no key derivation and no global lock. Tenant
+ * files written under the password by earlier versions still load, and
+ * move to the store key on their next rotation.
+ */
+class TenantKeyStore {
+public:
+    static const size_t DEFAULT_CAPACITY = 4096;
+    static const size_t DEFAULT_SHARDS = 64;
+    static const size_t MAX_TENANT_ID_SIZE = 128;
+    // Starts with '.', so no tenant id can name it
+    static const char* const STORE_KEY_FILE;
+
+    struct Options {
+        // Rings kept decoded, rounded up to a multiple of the shard count
+        size_t capacity = DEFAULT_CAPACITY;
+        // Independent locks and LRU lists, rounded to a power of two no larger than capacity
+        size_t shards = DEFAULT_SHARDS;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        // Rings currently in the cache
+        size_t cached = 0;
+    };
+
+    /**
+     * Open the store key, creating it (and the directory) for a new store
+     *
+     * @param password Password of the store key file
+     * @throws std::invalid_argument if capacity or shards is 0
+     * @throws std::runtime_error if the store key file cannot be read, e.g. under a wrong password
+     */
+    TenantKeyStore(const std::string& directory, const std::string& password);
+    TenantKeyStore(const std::string& directory, const std::string& password, const Options& options);
+
+    TenantKeyStore(const TenantKeyStore&) = delete;
+    TenantKeyStore& operator=(const TenantKeyStore&) = delete;
+
+    /**
+     * Ring of tenantId, read from its key file on a miss
+     *
+     * @throws std::invalid_argument if tenantId is not a valid tenant id
+     * @throws std::runtime_error if the tenant's key file is missing or cannot be read
+     */
+    std::shared_ptr<const KeyRing> get(const std::string& tenantId);
+
+    /**
+     * Write the key file of a new tenant: one generation with a fresh
+     * mapping and its own AES key
+     *
+     * @throws std::runtime_error if the tenant already has a key file
+     */
+    std::shared_ptr<const KeyRing> create(const std::string& tenantId);
+
+    // Add a generation to the tenant's ring (see KeyManager::rotateKey) and cache the result
+    std::shared_ptr<const KeyRing> rotate(const std::string& tenantId);
+
+    bool exists(const std::string& tenantId) const;
+
+    // Forget the cached ring of tenantId, e.g. after its key file was replaced
+    void evict(const std::string& tenantId);
+
+    // Summed over the shards, each read under its own lock
+    Stats stats() const;
+
+    std::string keyFile(const std::string& tenantId) const;
+
+    // 1 to MAX_TENANT_ID_SIZE of [A-Za-z0-9._-], not starting with '.'
+    static bool isValidTenantId(const std::string& tenantId);
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const KeyRing>>;
+
+    struct Shard {
+        mutable std::mutex lock;
+        // Most recently used first
+        std::list<Entry> order;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        // Serializes create and rotate, which rewrite key files, without blocking lookups
+        std::mutex writeLock;
+    };
+
+    std::string directory;
+    // Still needed to read tenant files from before the store key
+    std::string password;
+    // Encrypts every tenant file, in locked memory
+    LockedBuffer storeKey;
+    size_t shardCount;
+    size_t perShard;
+    std::unique_ptr<Shard[]> shards;
+
+    Shard& shardFor(const std::string& tenantId) const;
+    // Cache ring as the most recent entry of tenantId; shard.lock must be held
+    std::shared_ptr<const KeyRing> store(Shard& shard, const std::string& tenantId, std::shared_ptr<const KeyRing> ring);
+    static void requireValid(const std::string& tenantId);
+};
+
+#endif
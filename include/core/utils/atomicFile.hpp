@@ -0,0 +1,32 @@
+#ifndef ATOMICFILE_HPP
+#define ATOMICFILE_HPP
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Whole-file replacement that readers and crashes never see half done.
+ *
+ * The data goes to a temporary file with a unique name next to the target
+ * (mkstemp, so concurrent writers never share one), is synced to disk and
+ * renamed over the target; the directory is synced after the rename.
+ * Readers see the old contents or the new ones. Two writers racing on the
+ * same target each leave a complete file, and the last rename wins; callers
+ * that read, modify and write back need a FileLock around all three.
+ */
+class AtomicFile {
+public:
+    // Don't allow instantiation
+    AtomicFile() = delete;
+    ~AtomicFile() = delete;
+
+    /**
+     * Replace path with size bytes of data. The new file is only readable by
+     * its owner, since the files written this way hold keys.
+     *
+     * @throws std::runtime_error if writing, syncing or renaming fails; the target is then unchanged
+     */
+    static void write(const std::string& path, const void* data, size_t size);
+};
+
+#endif
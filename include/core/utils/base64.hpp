@@ -0,0 +1,48 @@
+#ifndef BASE64_HPP
+#define BASE64_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Standalone base64 codec (RFC 4648) with AVX2 and SSSE3 fast paths.
+ *
+ * Output goes into caller-provided buffers sized with encodedLength() /
+ * decodedMaxLength(); there is no limit on the input size.
+ */
+class Base64 {
+public:
+    // Don't allow instantiation
+    Base64() = delete;
+
+    static size_t encodedLength(size_t length);
+    static size_t decodedMaxLength(size_t length);
+
+    /**
+     * Encode binary data as padded base64 without line breaks
+     *
+     * @param output Must hold encodedLength(length) chars
+     * @return Number of chars written
+     */
+    static size_t encode(const uint8_t* input, size_t length, char* output);
+
+    /**
+     * Decode padded base64, rejecting anything that is not canonical:
+     * characters outside the alphabet, misplaced padding, a length that is
+     * not a multiple of 4 or non-zero bits in the final character
+     *
+     * @param output Must hold decodedMaxLength(length) bytes
+     * @return Number of bytes written
+     * @throws std::invalid_argument on malformed input
+     */
+    static size_t decode(const char* input, size_t length, uint8_t* output);
+
+    static std::string encode(const std::string& input);
+    static std::string decode(const std::string& input);
+
+    // Name of the kernel picked for this CPU ("avx2", "ssse3" or "scalar")
+    static const char* kernelName();
+};
+
+#endif
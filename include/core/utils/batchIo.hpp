@@ -0,0 +1,80 @@
+#ifndef BATCHIO_HPP
+#define BATCHIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Batched file I/O over a fixed set of buffers.
+ *
+ * Operations are only queued until submit(), which hands them to the kernel
+ * and waits for all of them. The io_uring backend (Linux) sends a whole
+ * batch with a single io_uring_enter and reads/writes straight from buffers
+ * registered with the kernel once; the POSIX backend performs the same
+ * operations one syscall at a time with open/pread/pwrite/close.
+ */
+class BatchIo {
+public:
+    enum class Backend {
+        AUTO,   // io_uring when the kernel supports it, POSIX otherwise
+        URING,
+        POSIX
+    };
+
+    struct Completion {
+        uint64_t tag;
+        // Bytes transferred, the new descriptor for opens, or -errno
+        int64_t result;
+    };
+
+    /**
+     * @param entries Most operations queued between two submits
+     * @param bufferCount Number of buffers, each bufferSize bytes
+     * @throws std::runtime_error if URING is requested but unavailable
+     */
+    static std::unique_ptr<BatchIo> create(Backend backend, unsigned entries, size_t bufferCount, size_t bufferSize);
+
+    // Whether io_uring (with the operations used here) works on this system
+    static bool uringAvailable();
+
+    static Backend parseBackend(const std::string& name, bool& ok);
+
+    virtual ~BatchIo();
+
+    BatchIo(const BatchIo&) = delete;
+    BatchIo& operator=(const BatchIo&) = delete;
+
+    // Path is copied; flags and mode as for open(2)
+    virtual void queueOpen(const std::string& path, int flags, int mode, uint64_t tag) = 0;
+    virtual void queueRead(int fd, size_t buffer, size_t length, uint64_t offset, uint64_t tag) = 0;
+    virtual void queueWrite(int fd, size_t buffer, size_t length, uint64_t offset, uint64_t tag) = 0;
+    virtual void queueClose(int fd, uint64_t tag) = 0;
+
+    /**
+     * Run everything queued and wait for it; completions are appended in
+     * the order they finish
+     */
+    virtual void submit(std::vector<Completion>& completions) = 0;
+
+    virtual const char* name() const = 0;
+
+    unsigned char* buffer(size_t index);
+    size_t bufferSize() const;
+    size_t bufferCount() const;
+
+    // Syscalls made for queued operations so far
+    uint64_t syscalls() const;
+
+protected:
+    BatchIo(size_t bufferCount, size_t bufferSize);
+
+    unsigned char* arena;
+    size_t count;
+    size_t size;
+    uint64_t syscallCount;
+};
+
+#endif
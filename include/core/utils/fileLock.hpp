@@ -0,0 +1,35 @@
+#ifndef FILELOCK_HPP
+#define FILELOCK_HPP
+
+#include <string>
+
+/**
+ * Exclusive advisory lock on a lock file, held for the object's lifetime.
+ *
+ * flock, or LockFileEx on Windows, so it serializes threads and processes
+ * alike. Only code that takes the same lock is kept out. The lock file is
+ * created if missing and left in place afterwards: removing it would let a
+ * waiter lock a file that a newcomer no longer sees.
+ */
+class FileLock {
+public:
+    /**
+     * Block until the lock on path is held
+     *
+     * @throws std::runtime_error if the lock file cannot be opened or locked
+     */
+    explicit FileLock(const std::string& path);
+    ~FileLock();
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+private:
+#if defined(_WIN32)
+    void* handle;
+#else
+    int descriptor;
+#endif
+};
+
+#endif
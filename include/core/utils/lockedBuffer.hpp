@@ -0,0 +1,39 @@
+#ifndef LOCKEDBUFFER_HPP
+#define LOCKEDBUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Small block of memory for key material.
+ *
+ * The block gets whole pages of its own, which are locked so they are never
+ * written to swap and, where the OS supports it, left out of core dumps.
+ * The contents are wiped before the pages are released. Locking can fail
+ * when the process is over its locked-memory limit; the buffer then still
+ * works and isLocked() reports false.
+ */
+class LockedBuffer {
+public:
+    /**
+     * @throws std::bad_alloc if the pages cannot be allocated
+     */
+    explicit LockedBuffer(size_t size);
+    ~LockedBuffer();
+
+    LockedBuffer(const LockedBuffer&) = delete;
+    LockedBuffer& operator=(const LockedBuffer&) = delete;
+
+    uint8_t* data();
+    const uint8_t* data() const;
+    size_t size() const;
+    bool isLocked() const;
+
+private:
+    uint8_t* pages;
+    size_t length;
+    size_t allocated;
+    bool locked;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Read-only memory mapping of a whole file.
+ *
+ * Pages are faulted in on first access and can be handed back with
+ * release() once consumed, so walking a file front to back keeps resident
+ * memory bounded by the chunk size instead of the file size.
+ */
+class MappedFile {
+public:
+    /**
+     * Map a file for reading
+     *
+     * @throws std::runtime_error if the file cannot be opened or mapped
+     */
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const;
+    size_t size() const;
+
+    // Hint that the file will be read front to back (more read-ahead)
+    void adviseSequential();
+
+    // Drop the pages fully inside [offset, offset + count) from memory
+    void release(size_t offset, size_t count);
+
+private:
+    const uint8_t* mapping;
+    size_t length;
+    size_t pageSize;
+
+#if defined(_WIN32)
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int descriptor;
+#endif
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef OUTPUTFILE_HPP
+#define OUTPUTFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Write-only file of a known size that several threads fill at different
+ * offsets at the same time (pwrite, or WriteFile with an offset on Windows).
+ */
+class OutputFile {
+public:
+    /**
+     * Create or truncate path and extend it to size bytes
+     *
+     * @throws std::runtime_error if the file cannot be created
+     */
+    OutputFile(const std::string& path, uint64_t size);
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    /**
+     * Write length bytes at offset; safe to call from several threads
+     *
+     * @throws std::runtime_error on a failed or short write
+     */
+    void writeAt(uint64_t offset, const void* data, size_t length);
+
+    /**
+     * Close the file, reporting errors that only show up on close
+     *
+     * @throws std::runtime_error if closing fails
+     */
+    void close();
+
+private:
+    std::string path;
+
+#if defined(_WIN32)
+    void* handle;
+#else
+    int descriptor;
+#endif
+};
+
+#endif
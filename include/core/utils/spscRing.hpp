@@ -0,0 +1,82 @@
+#ifndef SPSCRING_HPP
+#define SPSCRING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Bounded lock-free queue for exactly one producer and one consumer thread.
+ *
+ * Head and tail live on separate cache lines, and each side keeps a cached
+ * copy of the other's index so the shared atomics are only read again when
+ * the queue looks full (producer) or empty (consumer).
+ */
+template <typename T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+        : head(0), cachedTail(0), tail(0), cachedHead(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side; false if the ring is full
+    bool tryPush(const T& value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        if (position - cachedHead == slots.size()) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (position - cachedHead == slots.size()) {
+                return false;
+            }
+        }
+        slots[position & mask] = value;
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false if the ring is empty
+    bool tryPop(T& value) {
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position == cachedTail) {
+                return false;
+            }
+        }
+        value = slots[position & mask];
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Number of queued items; exact only when called from either side
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    // Consumer-owned
+    alignas(64) std::atomic<size_t> head;
+    size_t cachedTail;
+
+    // Producer-owned
+    alignas(64) std::atomic<size_t> tail;
+    size_t cachedHead;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef TEXTENCODING_HPP
+#define TEXTENCODING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Final stage of the layered pipeline
+enum class Encoding {
+    RAW,        // ciphertext bytes as they are
+    BASE64,     // RFC 4648 base64, padded
+    BASE64URL,  // RFC 4648 URL and filename safe alphabet (-_), padded
+    HEX         // lowercase hex, upper case accepted when decoding
+};
+
+/**
+ * One entry point for every output encoding, so callers pick the encoding
+ * at runtime instead of hard-wiring base64.
+ */
+class TextEncoding {
+public:
+    // Don't allow instantiation
+    TextEncoding() = delete;
+
+    static size_t encodedLength(Encoding encoding, size_t length);
+    static size_t decodedMaxLength(Encoding encoding, size_t length);
+
+    // Input bytes per indivisible group and the text each group becomes:
+    // 1 -> 1 for raw, 1 -> 2 for hex, 3 -> 4 for base64
+    static size_t groupSize(Encoding encoding);
+    static size_t unitSize(Encoding encoding);
+
+    // Whether the last unit may carry padding (base64 variants)
+    static bool isPadded(Encoding encoding);
+
+    // Whether the output is text, i.e. line breaks in it can be ignored
+    static bool isText(Encoding encoding);
+
+    /**
+     * @param output Must hold encodedLength(encoding, length) chars
+     * @return Number of chars written
+     */
+    static size_t encode(Encoding encoding, const uint8_t* input, size_t length, char* output);
+
+    /**
+     * @param output Must hold decodedMaxLength(encoding, length) bytes
+     * @return Number of bytes written
+     * @throws std::invalid_argument on malformed input
+     */
+    static size_t decode(Encoding encoding, const char* input, size_t length, uint8_t* output);
+
+    static std::string encode(Encoding encoding, const std::string& input);
+    static std::string decode(Encoding encoding, const std::string& input);
+
+    // "raw", "base64", "base64url" or "hex"
+    static const char* name(Encoding encoding);
+
+    /**
+     * @return false if name is not one of the names above
+     */
+    static bool parse(const std::string& name, Encoding& encoding);
+};
+
+#endif
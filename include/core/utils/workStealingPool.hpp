@@ -0,0 +1,85 @@
+#ifndef WORKSTEALINGPOOL_HPP
+#define WORKSTEALINGPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed-size thread pool with one task deque per worker.
+ *
+ * Workers pop their own newest task first (so a job that splits itself
+ * keeps its pieces cache-warm) and, when empty, steal the oldest task from
+ * another worker. A long job therefore never blocks the small ones queued
+ * behind it: idle workers simply take them.
+ *
+ * Submitting, taking and finishing a task only touch the deque involved and
+ * two atomic counters. stateLock is taken only to park a worker with nothing
+ * to do, to wake one, and to signal wait().
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @param threads Worker count, 0 uses std::thread::hardware_concurrency
+     * @throws std::system_error if a worker thread cannot be started
+     */
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * Queue a task. Called from a worker it goes to that worker's own deque,
+     * otherwise the deques are filled round-robin.
+     */
+    void submit(Task task);
+
+    /**
+     * Block until every submitted task (including ones submitted by tasks)
+     * has finished
+     *
+     * @throws The first exception a task threw, if any
+     */
+    void wait();
+
+    unsigned threadCount() const;
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex stateLock;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    // Tasks in some deque and not yet taken; counted before the push
+    std::atomic<size_t> queued;
+    // Tasks submitted and not yet finished
+    std::atomic<size_t> unfinished;
+    // Workers parked (or about to park) on workAvailable
+    std::atomic<size_t> sleepers;
+    bool stopping;
+    std::exception_ptr firstError;
+    std::atomic<size_t> nextWorker;
+
+    // Wakes every worker and joins it once the deques are drained
+    void stop();
+    void workerLoop(unsigned index);
+    bool takeTask(unsigned index, Task& task);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef ZLIBSTREAM_HPP
+#define ZLIBSTREAM_HPP
+
+#include <zlib.h>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * Streaming wrapper around a zlib deflate or inflate context.
+ *
+ * Works like CipherStream: input of any size is fed in, output is handed to
+ * a sink in CHUNK_SIZE pieces, so memory stays bounded however much data
+ * passes through. The zlib format's Adler-32 trailer is checked when
+ * decompressing.
+ */
+class ZlibStream {
+public:
+    enum class Direction {
+        COMPRESS,
+        DECOMPRESS
+    };
+
+    // Output produced per call to deflate/inflate
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    // zlib's own default, a good ratio at a moderate cost
+    static const int DEFAULT_LEVEL = Z_DEFAULT_COMPRESSION;
+
+    using Sink = std::function<void(const unsigned char* data, size_t length)>;
+
+    ZlibStream();
+    ~ZlibStream();
+
+    ZlibStream(const ZlibStream&) = delete;
+    ZlibStream& operator=(const ZlibStream&) = delete;
+
+    /**
+     * Set up the context for a new stream
+     *
+     * @param level 0 (store) to 9 (best), ignored when decompressing
+     */
+    void init(Direction direction, int level = DEFAULT_LEVEL);
+
+    /**
+     * Process the next part of the stream
+     *
+     * @throws std::runtime_error for corrupt compressed data or data after its end
+     */
+    void update(const unsigned char* data, size_t length, const Sink& sink);
+
+    /**
+     * Flush the remaining output
+     *
+     * @return false if the compressed stream ended early
+     */
+    bool final(const Sink& sink);
+
+    // Upper bound of the compressed size of length bytes at any level
+    static size_t compressedBound(size_t length);
+
+private:
+    z_stream zs;
+    Direction direction;
+    int level;
+    bool active;
+    bool ended;
+    std::vector<unsigned char> outbuf;
+
+    void close();
+    void run(int flush, const Sink& sink);
+};
+
+#endif
@@ -1,5 +1,7 @@
 #pragma once
 #include "raylib.h"
+#include "cipherStream.hpp"
+#include "keyRing.hpp"
 #include <string>
 #include <map>
 
@@ -68,7 +70,11 @@ private:
     std::string keyPassword;
     std::string aesKey;
     std::string iv;
-    std::map<char, char> charMapping;  // Changed from unordered_map to map
+    CipherMode cipherMode;
+    // Every key generation; new data uses the active one
+    KeyRing keyRing;
+    // Why the key file could not be read; the ring then stays empty and the file untouched
+    std::string keyError;
     int passwordLength;
 
     // Authentication
@@ -110,4 +116,6 @@ private:
 
     // Crypto methods
     void initializeKey();
+    // Shows keyError in the output area and returns false if no key is loaded
+    bool requireKey();
 };
\ No newline at end of file
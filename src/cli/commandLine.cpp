@@ -0,0 +1,746 @@
+#include "commandLine.hpp"
+#include "cipherBackend.hpp"
+#include "container.hpp"
+#include "directoryCrypt.hpp"
+#include "envmgr.hpp"
+#include "keyManager.hpp"
+#include "cipherStream.hpp"
+#include "pipelinedCrypt.hpp"
+#include "reencryptor.hpp"
+#include "resumableCrypt.hpp"
+#include "substitutionTable.hpp"
+#include "utils.hpp"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+    const char* DEFAULT_KEY_FILE = "assets/key.dat";
+    // Kept inside the directory rekey works on, which skips it
+    const char* REKEY_CHECKPOINT = ".xcreeptor-rekey.ckpt";
+    // Upper bounds for -j and --queue-depth; a queue holds that many 1 MB chunks
+    const unsigned long long MAX_THREADS = 1024;
+    const unsigned long long MAX_QUEUE_DEPTH = 256;
+
+    volatile sig_atomic_t interrupted = 0;
+
+    struct FileCloser {
+        void operator()(FILE* file) const {
+            if (file && file != stdin && file != stdout) {
+                fclose(file);
+            }
+        }
+    };
+    using FileHandle = unique_ptr<FILE, FileCloser>;
+
+    FileHandle openInput(const string& path) {
+        if (path.empty() || path == "-") {
+#if defined(_WIN32)
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            return FileHandle(stdin);
+        }
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            throw runtime_error("Could not open input file: " + path);
+        }
+        return FileHandle(file);
+    }
+
+    FileHandle openOutput(const string& path) {
+        if (path.empty() || path == "-") {
+#if defined(_WIN32)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            return FileHandle(stdout);
+        }
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            throw runtime_error("Could not open output file: " + path);
+        }
+        return FileHandle(file);
+    }
+
+    // Read up to count bytes beneath stdio, so the stream can still be switched to unbuffered afterwards
+    string readAhead(FILE* file, size_t count) {
+        string data(count, '\0');
+        size_t got = 0;
+        while (got < count) {
+#if defined(_WIN32)
+            int n = _read(_fileno(file), &data[got], (unsigned)(count - got));
+#else
+            ssize_t n = read(fileno(file), &data[got], count - got);
+#endif
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                throw runtime_error("Read failed");
+            }
+            if (n == 0) {
+                break;
+            }
+            got += (size_t)n;
+        }
+        data.resize(got);
+        return data;
+    }
+
+    // Bytes outside the key's alphabet (binary data, whitespace) pass through the substitution layer unchanged
+    SubstitutionTable substitutionFor(const KeyRing::Generation& generation) {
+        return generation.table.withPassthrough();
+    }
+
+    bool parseKeyId(const string& text, uint32_t& id) {
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long value = strtoull(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || errno != 0 || value > UINT32_MAX) {
+            return false;
+        }
+        id = (uint32_t)value;
+        return true;
+    }
+
+    bool parseCount(const string& text, unsigned long long max, unsigned long long& count) {
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long value = strtoull(text.c_str(), &end, 10);
+        if (text.empty() || text[0] == '-' || *end != '\0' || errno != 0 || value > max) {
+            return false;
+        }
+        count = value;
+        return true;
+    }
+
+    // Containers are recognized by their magic; stdin is never one (no random access)
+    bool isContainerFile(const string& path) {
+        if (path.empty() || path == "-" || !filesystem::is_regular_file(path)) {
+            return false;
+        }
+        unsigned char magic[4];
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        size_t got = fread(magic, 1, sizeof(magic), file);
+        fclose(file);
+        return ContainerHeader::matches(magic, got);
+    }
+
+    ContainerHeader readContainerHeader(const string& path) {
+        unsigned char data[ContainerHeader::SIZE];
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            throw runtime_error("Could not open input file: " + path);
+        }
+        size_t got = fread(data, 1, sizeof(data), file);
+        fclose(file);
+        return ContainerHeader::parse(data, got);
+    }
+
+    // Cipher named by the frame of an authenticated message in a regular file
+    bool readFramedMode(const string& path, Encoding encoding, CipherMode& mode) {
+        if (path.empty() || path == "-" || !filesystem::is_regular_file(path)) {
+            return false;
+        }
+        unsigned char text[KeyRing::PREFIX_SIZE + 4];
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        size_t got = fread(text, 1, sizeof(text), file);
+        fclose(file);
+        // The frame follows the key id prefix, if there is one
+        uint32_t keyId;
+        size_t skip = KeyRing::readPrefix(text, got, keyId) ? KeyRing::PREFIX_SIZE : 0;
+        return LayeredPipeline::framedMode(text + skip, got - skip, encoding, mode);
+    }
+}
+
+void CommandLine::printUsage() {
+    cerr << "Usage: xcreeptor <command> [options]\n"
+        << "\n"
+        << "Commands:\n"
+        << "  enc       Encrypt input (substitution + AES + base64)\n"
+        << "  dec       Decrypt input produced by enc\n"
+        << "  genpass   Print a random password: genpass [length]\n"
+        << "  keygen    Generate a new substitution key file\n"
+        << "  rotate    Add a new key generation to the key file and make it the active one\n"
+        << "  rekey     Re-encrypt every file below -i under the active key generation\n"
+        << "\n"
+        << "Options:\n"
+        << "  -i, --in <path>        Input file (default: stdin)\n"
+        << "  -o, --out <path>       Output file (default: stdout)\n"
+        << "  -k, --key-file <path>  Key file (default: " << DEFAULT_KEY_FILE << ")\n"
+        << "  --key-id <n>           Key generation for enc, and for dec of input that names none\n"
+        << "                         (-r trees; default: the active one for enc and -r, else 0)\n"
+        << "  -m, --mode <cbc|ctr|gcm|chacha20|auto>\n"
+        << "                         Cipher for enc/dec (default: XCREEPTOR_CIPHER, else cbc, or gcm with -c);\n"
+        << "                         auto picks the faster of gcm and chacha20 on this CPU\n"
+        << "  -e, --encoding <raw|base64|base64url|hex>\n"
+        << "                         Final layer of enc output / dec input (default: XCREEPTOR_ENCODING or base64)\n"
+        << "  -z, --compress         enc: zlib-compress before encrypting (dec detects it)\n"
+        << "  -f, --force            Let keygen overwrite an existing key file\n"
+        << "  -c, --container        enc: write the chunked binary container instead of base64 text\n"
+        << "  --range <off>:<len>    dec: only decrypt these plaintext bytes of a container\n"
+        << "  --resume               enc -c: continue an interrupted file from its checkpoint (<out>.ckpt)\n"
+        << "  -r, --recursive        enc/dec every file below the -i directory into the -o directory\n"
+        << "  -j, --threads <n>      Worker threads for -r (default: one per core)\n"
+        << "  --io <auto|uring|posix>  File I/O for small files with -r (default: auto)\n"
+        << "  --queue-depth <n>      Chunks in flight between the read/crypto/write stages (default: 8)\n"
+        << "  --rate <MB/s>          rekey: cap on bytes read plus written per second (default: none)\n"
+        << "  --cpu <percent>        rekey: share of each worker's time spent working (default: 100)\n"
+        << "  --stats                Print throughput, stall counters and queue depths to stderr\n"
+        << "\n"
+        << "Keys are read from XCREEPTOR_PASS_KEY, XCREEPTOR_AES_KEY and XCREEPTOR_VI_KEY\n"
+        << "(environment or .env), the same as the GUI. XCREEPTOR_KDF (scrypt or pbkdf2) and\n"
+        << "XCREEPTOR_KDF_COST set how the key file password is stretched when the file is written." << endl;
+}
+
+bool CommandLine::parseArgs(int argc, char* argv[], Options& options) {
+    options.force = false;
+    options.recursive = false;
+    options.container = false;
+    options.compress = false;
+    options.resume = false;
+    options.threads = 0;
+    options.queueDepth = 0;
+    options.rate = 0;
+    options.cpuPercent = 100;
+    options.stats = false;
+    options.keyFile = DEFAULT_KEY_FILE;
+
+    if (argc < 2) {
+        return false;
+    }
+    options.command = argv[1];
+
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        auto value = [&](string& target) {
+            if (i + 1 >= argc) {
+                cerr << "Error: " << arg << " needs a value" << endl;
+                return false;
+            }
+            target = argv[++i];
+            return true;
+        };
+
+        if (arg == "-i" || arg == "--in") {
+            if (!value(options.input)) return false;
+        }
+        else if (arg == "-o" || arg == "--out") {
+            if (!value(options.output)) return false;
+        }
+        else if (arg == "-k" || arg == "--key-file") {
+            if (!value(options.keyFile)) return false;
+        }
+        else if (arg == "-m" || arg == "--mode") {
+            if (!value(options.mode)) return false;
+        }
+        else if (arg == "-e" || arg == "--encoding") {
+            if (!value(options.encoding)) return false;
+        }
+        else if (arg == "-z" || arg == "--compress") {
+            options.compress = true;
+        }
+        else if (arg == "-f" || arg == "--force") {
+            options.force = true;
+        }
+        else if (arg == "-c" || arg == "--container") {
+            options.container = true;
+        }
+        else if (arg == "--range") {
+            if (!value(options.range)) return false;
+        }
+        else if (arg == "-r" || arg == "--recursive") {
+            options.recursive = true;
+        }
+        else if (arg == "-j" || arg == "--threads") {
+            string threads;
+            unsigned long long count;
+            if (!value(threads)) return false;
+            if (!parseCount(threads, MAX_THREADS, count)) {
+                cerr << "Error: " << arg << " needs a thread count from 0 to " << MAX_THREADS << endl;
+                return false;
+            }
+            options.threads = (unsigned)count;
+        }
+        else if (arg == "--queue-depth") {
+            string depth;
+            unsigned long long count;
+            if (!value(depth)) return false;
+            if (!parseCount(depth, MAX_QUEUE_DEPTH, count)) {
+                cerr << "Error: " << arg << " needs a depth from 0 to " << MAX_QUEUE_DEPTH << endl;
+                return false;
+            }
+            options.queueDepth = (size_t)count;
+        }
+        else if (arg == "--io") {
+            if (!value(options.io)) return false;
+        }
+        else if (arg == "--stats") {
+            options.stats = true;
+        }
+        else if (arg == "--resume") {
+            options.resume = true;
+        }
+        else if (arg == "--key-id") {
+            if (!value(options.keyId)) return false;
+        }
+        else if (arg == "--rate") {
+            string rate;
+            if (!value(rate)) return false;
+            options.rate = atof(rate.c_str());
+        }
+        else if (arg == "--cpu") {
+            string cpu;
+            if (!value(cpu)) return false;
+            options.cpuPercent = atof(cpu.c_str());
+        }
+        else if (arg.size() > 1 && arg[0] == '-') {
+            cerr << "Error: Unknown option " << arg << endl;
+            return false;
+        }
+        else {
+            options.positional.push_back(arg);
+        }
+    }
+    return true;
+}
+
+int CommandLine::run(int argc, char* argv[]) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    try {
+        if (options.command == "enc") {
+            return runCrypt(options, true);
+        }
+        if (options.command == "dec") {
+            return runCrypt(options, false);
+        }
+        if (options.command == "genpass") {
+            return runGeneratePassword(options);
+        }
+        if (options.command == "keygen") {
+            return runKeygen(options);
+        }
+        if (options.command == "rotate") {
+            return runRotate(options);
+        }
+        if (options.command == "rekey") {
+            return runRekey(options);
+        }
+        if (options.command == "-h" || options.command == "--help" || options.command == "help") {
+            printUsage();
+            return 0;
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    cerr << "Error: Unknown command " << options.command << endl;
+    printUsage();
+    return 2;
+}
+
+int CommandLine::runCrypt(const Options& options, bool encrypt) {
+    EnvManager::load();
+    string keyPassword = EnvManager::get("XCREEPTOR_PASS_KEY");
+    string aesKey = EnvManager::get("XCREEPTOR_AES_KEY");
+    string iv = EnvManager::get("XCREEPTOR_VI_KEY");
+
+    // -e wins over the configured default, so one setup can still decode another's output
+    string encodingName = options.encoding.empty() ? EnvManager::get("XCREEPTOR_ENCODING", "base64") : options.encoding;
+    Encoding encoding;
+    if (!TextEncoding::parse(encodingName, encoding)) {
+        cerr << "Error: Unknown encoding " << encodingName << endl;
+        return 2;
+    }
+
+    bool containerIo = !options.recursive
+        && ((encrypt && options.container) || (!encrypt && isContainerFile(options.input)));
+    string modeName = options.mode.empty() ? EnvManager::get("XCREEPTOR_CIPHER", "") : options.mode;
+    CipherMode mode;
+    if (!CipherBackend::parse(modeName, mode)) {
+        cerr << "Error: Unknown mode " << modeName << endl;
+        return 2;
+    }
+    // New containers are authenticated unless a mode is asked for
+    if (encrypt && containerIo && modeName.empty()) {
+        mode = CipherMode::AES_256_GCM;
+    }
+    // Another host may have measured differently; its messages say which cipher they used
+    if (!encrypt && modeName == "auto" && !containerIo) {
+        readFramedMode(options.input, encoding, mode);
+    }
+    if (options.stats) {
+        fprintf(stderr, "cipher: %s\n", CipherBackend::name(mode));
+    }
+
+    if (!filesystem::exists(options.keyFile)) {
+        cerr << "Error: Key file not found: " << options.keyFile << " (run 'xcreeptor keygen' first)" << endl;
+        return 1;
+    }
+    // Never regenerate here: a wrong password must not replace the key
+    KeyRing ring = KeyManager::readKeyRing(options.keyFile, keyPassword);
+    uint32_t keyId = ring.active().id;
+    if (!options.keyId.empty() && !parseKeyId(options.keyId, keyId)) {
+        cerr << "Error: Invalid key id " << options.keyId << endl;
+        return 2;
+    }
+
+    if (options.compress && options.container) {
+        cerr << "Error: --compress does not apply to containers" << endl;
+        return 2;
+    }
+    if (options.resume && !(encrypt && containerIo)) {
+        cerr << "Error: --resume only applies to enc -c" << endl;
+        return 2;
+    }
+    Compression compression = options.compress ? Compression::ZLIB : Compression::NONE;
+
+    if (options.recursive) {
+        // Files carry no key id, so a tree is processed under a single generation
+        const KeyRing::Generation& generation = ring.get(keyId);
+        return runCryptTree(options, encrypt, substitutionFor(generation), generation.cipherKey(aesKey), iv, mode,
+            encoding, compression);
+    }
+    if (containerIo) {
+        return runContainer(options, encrypt, ring, keyId, aesKey, mode);
+    }
+    if (!options.range.empty()) {
+        cerr << "Error: --range only works on container input" << endl;
+        return 2;
+    }
+
+    if (!options.input.empty() && filesystem::is_directory(options.input)) {
+        cerr << "Error: " << options.input << " is a directory (use -r)" << endl;
+        return 1;
+    }
+    FileHandle in = openInput(options.input);
+    FileHandle out = openOutput(options.output);
+
+    // Reading, crypto and writing overlap on three threads
+    PipelinedCrypt::Config config;
+    config.chunkSize = IO_BLOCK_SIZE;
+    if (options.queueDepth > 0) {
+        config.queueDepth = options.queueDepth;
+    }
+    config.encoding = encoding;
+    config.compression = compression;
+    if (encrypt) {
+        config.outputLead = KeyRing::prefix(keyId);
+    }
+    else {
+        // Messages name their key generation; one that doesn't predates key rings, or --key-id says which it is
+        config.inputLead = readAhead(in.get(), KeyRing::PREFIX_SIZE);
+        if (KeyRing::readPrefix((const unsigned char*)config.inputLead.data(), config.inputLead.size(), keyId)) {
+            config.inputLead.clear();
+        }
+        else if (options.keyId.empty()) {
+            keyId = 0;
+        }
+    }
+    const KeyRing::Generation& generation = ring.get(keyId);
+    SubstitutionTable table = substitutionFor(generation);
+
+    CipherStream::Direction direction = encrypt ? CipherStream::Direction::ENCRYPT : CipherStream::Direction::DECRYPT;
+    CipherStream stream;
+    stream.init(direction, generation.cipherKey(aesKey), iv, mode);
+    PipelinedCrypt::Stats stats = PipelinedCrypt::run(direction, table, stream, in.get(), out.get(), config);
+
+    // Text output ends with a newline; raw output must stay byte exact
+    if (encrypt && TextEncoding::isText(encoding) && fwrite("\n", 1, 1, out.get()) != 1) {
+        throw runtime_error("Write failed");
+    }
+    if (fflush(out.get()) != 0) {
+        throw runtime_error("Write failed");
+    }
+    if (options.stats) {
+        PipelinedCrypt::printStats(stats, stderr);
+    }
+    return 0;
+}
+
+int CommandLine::runContainer(const Options& options, bool encrypt, const KeyRing& ring, uint32_t keyId,
+    const string& aesKey, CipherMode mode) {
+    bool namedFiles = !options.input.empty() && options.input != "-" && !options.output.empty() && options.output != "-";
+    string checkpoint = ResumableCrypt::checkpointPath(options.output);
+    if (encrypt && namedFiles && options.resume && options.keyId.empty() && filesystem::exists(checkpoint)) {
+        // Carry on under the generation the run started with, even if the key was rotated since
+        keyId = ResumableCrypt::Checkpoint::load(checkpoint).header.keyId;
+    }
+    if (!encrypt) {
+        // The header names the generation (and the cipher mode)
+        keyId = readContainerHeader(options.input).keyId;
+    }
+    const KeyRing::Generation& generation = ring.get(keyId);
+    SubstitutionTable table = substitutionFor(generation);
+    const string& key = generation.cipherKey(aesKey);
+
+    if (encrypt && namedFiles) {
+        // Checkpointed, so a long run that dies can be picked up with --resume
+        ContainerWriter::Options containerOptions;
+        containerOptions.mode = mode;
+        containerOptions.keyId = keyId;
+        ResumableCrypt::Result result = ResumableCrypt::encryptFile(table, key, containerOptions,
+            options.input, options.output, options.resume);
+        if (options.stats || result.resumedBytes > 0) {
+            fprintf(stderr, "resumed after %.1f MB, wrote %.1f MB, %zu checkpoints\n",
+                result.resumedBytes / (1024.0 * 1024.0), result.bytesWritten / (1024.0 * 1024.0), result.checkpoints);
+        }
+        return 0;
+    }
+    if (options.resume) {
+        cerr << "Error: --resume needs -i and -o files" << endl;
+        return 2;
+    }
+    if (encrypt) {
+        FileHandle in = openInput(options.input);
+        FileHandle out = openOutput(options.output);
+        FILE* outFile = out.get();
+
+        ContainerWriter::Options containerOptions;
+        containerOptions.mode = mode;
+        containerOptions.keyId = keyId;
+        ContainerWriter writer(table, key, containerOptions, [outFile](const unsigned char* data, size_t length) {
+            if (fwrite(data, 1, length, outFile) != length) {
+                throw runtime_error("Write failed");
+            }
+        });
+
+        vector<unsigned char> block(IO_BLOCK_SIZE);
+        size_t got;
+        while ((got = fread(block.data(), 1, block.size(), in.get())) > 0) {
+            writer.write(block.data(), got);
+        }
+        if (ferror(in.get())) {
+            throw runtime_error("Read failed");
+        }
+        writer.finish();
+        if (fflush(outFile) != 0) {
+            throw runtime_error("Write failed");
+        }
+        return 0;
+    }
+
+    // The cipher mode comes from the container header, -m is not needed
+    ContainerReader reader(table, key, options.input);
+    uint64_t offset = 0;
+    uint64_t length = reader.size();
+    if (!options.range.empty()) {
+        size_t colon = options.range.find(':');
+        unsigned long long from;
+        unsigned long long count;
+        if (colon == string::npos || !parseCount(options.range.substr(0, colon), UINT64_MAX, from) ||
+            !parseCount(options.range.substr(colon + 1), UINT64_MAX, count)) {
+            cerr << "Error: --range expects <offset>:<length>" << endl;
+            return 2;
+        }
+        offset = from;
+        length = count;
+    }
+
+    FileHandle out = openOutput(options.output);
+    vector<unsigned char> block(IO_BLOCK_SIZE);
+    try {
+        while (length > 0) {
+            size_t got = reader.read(offset, (size_t)min<uint64_t>(length, block.size()), block.data());
+            if (got == 0) {
+                break;
+            }
+            if (fwrite(block.data(), 1, got, out.get()) != got) {
+                throw runtime_error("Write failed");
+            }
+            offset += got;
+            length -= got;
+        }
+    }
+    catch (...) {
+        // Chunks before a failed one were genuine, but the file as a whole is not
+        out.reset();
+        if (!options.output.empty() && options.output != "-") {
+            error_code ignored;
+            filesystem::remove(options.output, ignored);
+        }
+        throw;
+    }
+    if (fflush(out.get()) != 0) {
+        throw runtime_error("Write failed");
+    }
+    return 0;
+}
+
+int CommandLine::runCryptTree(const Options& options, bool encrypt, const SubstitutionTable& table,
+    const string& aesKey, const string& iv, CipherMode mode, Encoding encoding, Compression compression) {
+    if (options.input.empty() || options.output.empty()) {
+        cerr << "Error: -r needs both -i <directory> and -o <directory>" << endl;
+        return 2;
+    }
+
+    bool known;
+    BatchIo::Backend io = BatchIo::parseBackend(options.io, known);
+    if (!known) {
+        cerr << "Error: Unknown I/O backend " << options.io << endl;
+        return 2;
+    }
+
+    DirectoryCrypt::Stats stats = encrypt
+        ? DirectoryCrypt::encryptTree(table, aesKey, iv, mode, options.input, options.output, options.threads, io, encoding,
+            compression)
+        : DirectoryCrypt::decryptTree(table, aesKey, iv, mode, options.input, options.output, options.threads, io, encoding);
+
+    for (const string& error : stats.errors) {
+        cerr << "Error: " << error << endl;
+    }
+    fprintf(stderr, "%s %zu files, %.1f MB in %.2f s (%.1f MB/s)%s\n",
+        encrypt ? "Encrypted" : "Decrypted", stats.files, stats.bytesRead / (1024.0 * 1024.0),
+        stats.seconds, stats.megabytesPerSecond(),
+        stats.errors.empty() ? "" : (", " + to_string(stats.errors.size()) + " failed").c_str());
+    if (options.stats && !stats.ioBackend.empty()) {
+        fprintf(stderr, "small files: %s, %llu I/O syscalls\n",
+            stats.ioBackend.c_str(), (unsigned long long)stats.ioSyscalls);
+    }
+    return stats.errors.empty() ? 0 : 1;
+}
+
+int CommandLine::runGeneratePassword(const Options& options) {
+    int length = 12;
+    if (!options.positional.empty()) {
+        length = atoi(options.positional[0].c_str());
+    }
+    // Same bounds as the GUI
+    if (length < 4) length = 4;
+    if (length > 128) length = 128;
+
+    cout << Utils::generateRandomString(length) << endl;
+    return 0;
+}
+
+int CommandLine::runKeygen(const Options& options) {
+    if (filesystem::exists(options.keyFile) && !options.force) {
+        cerr << "Error: " << options.keyFile << " already exists; data encrypted with it becomes unreadable "
+            << "if it is replaced. Use 'xcreeptor rotate' to add a key while keeping it, or --force to overwrite." << endl;
+        return 1;
+    }
+
+    EnvManager::load();
+    string keyPassword = EnvManager::get("XCREEPTOR_PASS_KEY");
+    KeyManager::saveKeyToFile(KeyManager::generateKey(), options.keyFile, keyPassword);
+    cerr << "Key written to " << options.keyFile << endl;
+    return 0;
+}
+
+int CommandLine::runRotate(const Options& options) {
+    if (!filesystem::exists(options.keyFile)) {
+        cerr << "Error: Key file not found: " << options.keyFile << " (run 'xcreeptor keygen' first)" << endl;
+        return 1;
+    }
+
+    EnvManager::load();
+    string keyPassword = EnvManager::get("XCREEPTOR_PASS_KEY");
+    KeyRing ring = KeyManager::readKeyRing(options.keyFile, keyPassword);
+    const KeyRing::Generation& generation = KeyManager::rotateKey(ring, options.keyFile, keyPassword);
+    cerr << "Key " << generation.id << " is now active in " << options.keyFile << " ("
+        << ring.generations().size() << " generations kept)" << endl;
+    return 0;
+}
+
+int CommandLine::runRekey(const Options& options) {
+    if (options.input.empty() || !filesystem::is_directory(options.input)) {
+        cerr << "Error: rekey needs -i <directory>" << endl;
+        return 2;
+    }
+    if (!(options.cpuPercent > 0 && options.cpuPercent <= 100) || options.rate < 0) {
+        cerr << "Error: --cpu takes a percentage in (0, 100] and --rate a positive MB/s" << endl;
+        return 2;
+    }
+    if (!filesystem::exists(options.keyFile)) {
+        cerr << "Error: Key file not found: " << options.keyFile << endl;
+        return 1;
+    }
+
+    EnvManager::load();
+    string keyPassword = EnvManager::get("XCREEPTOR_PASS_KEY");
+    string aesKey = EnvManager::get("XCREEPTOR_AES_KEY");
+    string iv = EnvManager::get("XCREEPTOR_VI_KEY");
+
+    Reencryptor::Options rekeyOptions;
+    string encodingName = options.encoding.empty() ? EnvManager::get("XCREEPTOR_ENCODING", "base64") : options.encoding;
+    if (!TextEncoding::parse(encodingName, rekeyOptions.encoding)) {
+        cerr << "Error: Unknown encoding " << encodingName << endl;
+        return 2;
+    }
+    string modeName = options.mode.empty() ? EnvManager::get("XCREEPTOR_CIPHER", "") : options.mode;
+    if (!CipherBackend::parse(modeName, rekeyOptions.mode)) {
+        cerr << "Error: Unknown mode " << modeName << endl;
+        return 2;
+    }
+    rekeyOptions.threads = options.threads;
+    rekeyOptions.bytesPerSecond = (uint64_t)(options.rate * 1024 * 1024);
+    rekeyOptions.cpuShare = options.cpuPercent / 100.0;
+    rekeyOptions.checkpointPath = (filesystem::path(options.input) / REKEY_CHECKPOINT).string();
+
+    KeyRing ring = KeyManager::readKeyRing(options.keyFile, keyPassword);
+    Reencryptor reencryptor(ring, aesKey, iv, rekeyOptions);
+
+    // Ctrl-C stops after the files in flight; the checkpoint lets the next run skip what is done
+    interrupted = 0;
+    auto previousHandler = signal(SIGINT, [](int) { interrupted = 1; });
+    reencryptor.start(options.input);
+    Reencryptor::Progress progress = reencryptor.progress();
+    auto lastReport = chrono::steady_clock::now();
+    while (!progress.finished) {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        if (interrupted) {
+            reencryptor.stop();
+        }
+        progress = reencryptor.progress();
+        if (options.stats && chrono::steady_clock::now() - lastReport >= chrono::seconds(1)) {
+            lastReport = chrono::steady_clock::now();
+            fprintf(stderr, "%zu/%zu files, %.1f MB/s, %.1f s throttled\n",
+                progress.done, progress.files, progress.megabytesPerSecond(), progress.throttledSeconds);
+        }
+    }
+    signal(SIGINT, previousHandler);
+    progress = reencryptor.wait();
+
+    for (const string& error : reencryptor.errors()) {
+        cerr << "Error: " << error << endl;
+    }
+    fprintf(stderr, "Key %u: %zu files re-encrypted, %zu already current, %zu failed, %zu not reached; "
+        "%.1f MB in %.2f s (%.1f MB/s)\n",
+        ring.active().id, progress.reencrypted, progress.current, progress.failed, progress.files - progress.done,
+        progress.bytesRead / (1024.0 * 1024.0), progress.seconds, progress.megabytesPerSecond());
+    if (interrupted) {
+        return 130;
+    }
+    return progress.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#include "cipherBackend.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+namespace CipherBackend {
+    const char* name(CipherMode mode) {
+        switch (mode) {
+        case CipherMode::AES_256_CBC: return "cbc";
+        case CipherMode::AES_256_CTR: return "ctr";
+        case CipherMode::AES_256_GCM: return "gcm";
+        case CipherMode::CHACHA20_POLY1305: return "chacha20";
+        }
+        return "unknown";
+    }
+
+    bool parse(const string& value, CipherMode& mode) {
+        if (value.empty()) {
+            mode = CipherMode::AES_256_CBC;
+            return true;
+        }
+        if (value == "auto") {
+            mode = fastest();
+            return true;
+        }
+        const CipherMode modes[] = { CipherMode::AES_256_CBC, CipherMode::AES_256_CTR,
+            CipherMode::AES_256_GCM, CipherMode::CHACHA20_POLY1305 };
+        for (CipherMode candidate : modes) {
+            if (value == name(candidate)) {
+                mode = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    double measure(CipherMode mode, size_t bytes) {
+        vector<unsigned char> data(bytes, 'a');
+        vector<unsigned char> output(bytes + EVP_MAX_BLOCK_LENGTH);
+        CipherStream stream;
+        stream.init(CipherStream::Direction::ENCRYPT, string(32, 'k'), string(16, 'i'), mode);
+
+        // Untimed warm-up pass so page faults and lazy OpenSSL setup don't count
+        stream.update(data.data(), data.size(), output.data());
+        stream.reset(string(16, 'j'));
+
+        auto start = chrono::steady_clock::now();
+        stream.update(data.data(), data.size(), output.data());
+        stream.final([](const unsigned char*, size_t) {});
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return seconds > 0 ? (double)bytes / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+
+    CipherMode fastest() {
+        static const CipherMode best = [] {
+            // Best of three each, so one preempted run doesn't decide
+            double gcm = 0;
+            double chacha = 0;
+            for (int i = 0; i < 3; ++i) {
+                gcm = max(gcm, measure(CipherMode::AES_256_GCM));
+                chacha = max(chacha, measure(CipherMode::CHACHA20_POLY1305));
+            }
+            return chacha > gcm ? CipherMode::CHACHA20_POLY1305 : CipherMode::AES_256_GCM;
+        }();
+        return best;
+    }
+
+    // Stable on-disk ids, independent of the enum's order
+    uint8_t id(CipherMode mode) {
+        switch (mode) {
+        case CipherMode::AES_256_CBC: return 1;
+        case CipherMode::AES_256_CTR: return 2;
+        case CipherMode::AES_256_GCM: return 3;
+        case CipherMode::CHACHA20_POLY1305: return 4;
+        }
+        throw invalid_argument("Unsupported cipher mode");
+    }
+
+    bool fromId(uint8_t value, CipherMode& mode) {
+        switch (value) {
+        case 1: mode = CipherMode::AES_256_CBC; return true;
+        case 2: mode = CipherMode::AES_256_CTR; return true;
+        case 3: mode = CipherMode::AES_256_GCM; return true;
+        case 4: mode = CipherMode::CHACHA20_POLY1305; return true;
+        }
+        return false;
+    }
+}
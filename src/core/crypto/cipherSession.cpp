@@ -0,0 +1,45 @@
+#include "cipherSession.hpp"
+using namespace std;
+
+CipherSession::CipherSession(const string& key, const string& iv, CipherMode mode)
+    : key(key),
+    iv(iv),
+    mode(mode),
+    encryptReady(false),
+    decryptReady(false) {
+}
+
+void CipherSession::setIV(const string& newIv) {
+    iv = newIv;
+}
+
+const string& CipherSession::getIV() const {
+    return iv;
+}
+
+CipherMode CipherSession::getMode() const {
+    return mode;
+}
+
+CipherStream& CipherSession::encryptor() {
+    // Expand the key schedule on first use only, afterwards just rewind the IV
+    if (!encryptReady) {
+        encryptStream.init(CipherStream::Direction::ENCRYPT, key, iv, mode);
+        encryptReady = true;
+    }
+    else {
+        encryptStream.reset(iv);
+    }
+    return encryptStream;
+}
+
+CipherStream& CipherSession::decryptor() {
+    if (!decryptReady) {
+        decryptStream.init(CipherStream::Direction::DECRYPT, key, iv, mode);
+        decryptReady = true;
+    }
+    else {
+        decryptStream.reset(iv);
+    }
+    return decryptStream;
+}
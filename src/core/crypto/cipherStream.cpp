@@ -0,0 +1,160 @@
+#include "cipherStream.hpp"
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+CipherStream::CipherStream()
+    : ctx(EVP_CIPHER_CTX_new()), mode(CipherMode::AES_256_CBC) {
+    if (!ctx) {
+        throw runtime_error("Failed to allocate cipher context");
+    }
+}
+
+CipherStream::~CipherStream() {
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+const EVP_CIPHER* CipherStream::cipherFor(CipherMode mode) {
+    switch (mode) {
+    case CipherMode::AES_256_CBC:
+        return EVP_aes_256_cbc();
+    case CipherMode::AES_256_CTR:
+        return EVP_aes_256_ctr();
+    case CipherMode::AES_256_GCM:
+        return EVP_aes_256_gcm();
+    case CipherMode::CHACHA20_POLY1305:
+        return EVP_chacha20_poly1305();
+    }
+    throw invalid_argument("Unknown cipher mode");
+}
+
+size_t CipherStream::ciphertextLength(CipherMode mode, size_t plaintextLength) {
+    switch (mode) {
+    case CipherMode::AES_256_CBC:
+        // PKCS#7 always adds between 1 and 16 bytes
+        return (plaintextLength / 16 + 1) * 16;
+    case CipherMode::AES_256_CTR:
+    case CipherMode::AES_256_GCM:
+    case CipherMode::CHACHA20_POLY1305:
+        // The tag is kept apart from the ciphertext
+        return plaintextLength;
+    }
+    throw invalid_argument("Unknown cipher mode");
+}
+
+bool CipherStream::isAuthenticated(CipherMode mode) {
+    return mode == CipherMode::AES_256_GCM || mode == CipherMode::CHACHA20_POLY1305;
+}
+
+CipherMode CipherStream::getMode() const {
+    return mode;
+}
+
+size_t CipherStream::keyLength(CipherMode mode) {
+    return EVP_CIPHER_key_length(cipherFor(mode));
+}
+
+size_t CipherStream::ivLength(CipherMode mode) {
+    return EVP_CIPHER_iv_length(cipherFor(mode));
+}
+
+string CipherStream::fitToLength(const string& value, size_t length) {
+    string fitted = value.substr(0, length);
+    fitted.resize(length, '\0');
+    return fitted;
+}
+
+void CipherStream::init(Direction direction, const string& key, const string& iv, CipherMode mode) {
+    const EVP_CIPHER* cipher = cipherFor(mode);
+    string fittedKey = fitToLength(key, EVP_CIPHER_key_length(cipher));
+    string fittedIv = fitToLength(iv, EVP_CIPHER_iv_length(cipher));
+
+    int enc = (direction == Direction::ENCRYPT) ? 1 : 0;
+    if (EVP_CipherInit_ex(ctx, cipher, nullptr, (const unsigned char*)fittedKey.data(),
+        (const unsigned char*)fittedIv.data(), enc) != 1) {
+        throw runtime_error("Cipher initialization failed");
+    }
+    this->mode = mode;
+}
+
+void CipherStream::reset(const string& iv) {
+    if (!EVP_CIPHER_CTX_cipher(ctx)) {
+        throw logic_error("CipherStream::reset called before init");
+    }
+    string fittedIv = fitToLength(iv, EVP_CIPHER_CTX_iv_length(ctx));
+    if (EVP_CipherInit_ex(ctx, nullptr, nullptr, nullptr, (const unsigned char*)fittedIv.data(), -1) != 1) {
+        throw runtime_error("Cipher reset failed");
+    }
+}
+
+void CipherStream::update(const unsigned char* data, size_t length, const Sink& sink) {
+    // Grow the output buffer on demand so short messages don't pay for a full chunk
+    size_t needed = min(CHUNK_SIZE, length) + EVP_MAX_BLOCK_LENGTH;
+    if (outbuf.size() < needed) {
+        outbuf.resize(needed);
+    }
+
+    size_t offset = 0;
+    while (offset < length) {
+        size_t slice = min(CHUNK_SIZE, length - offset);
+        int outlen = 0;
+
+        if (EVP_CipherUpdate(ctx, outbuf.data(), &outlen, data + offset, (int)slice) != 1) {
+            throw runtime_error("Cipher update failed");
+        }
+        if (outlen > 0) {
+            sink(outbuf.data(), outlen);
+        }
+        offset += slice;
+    }
+}
+
+size_t CipherStream::update(const unsigned char* data, size_t length, unsigned char* output) {
+    size_t offset = 0;
+    size_t written = 0;
+    while (offset < length) {
+        size_t slice = min(CHUNK_SIZE, length - offset);
+        int outlen = 0;
+
+        if (EVP_CipherUpdate(ctx, output + written, &outlen, data + offset, (int)slice) != 1) {
+            throw runtime_error("Cipher update failed");
+        }
+        written += outlen;
+        offset += slice;
+    }
+    return written;
+}
+
+bool CipherStream::final(const Sink& sink) {
+    if (outbuf.size() < EVP_MAX_BLOCK_LENGTH) {
+        outbuf.resize(EVP_MAX_BLOCK_LENGTH);
+    }
+
+    int outlen = 0;
+    if (EVP_CipherFinal_ex(ctx, outbuf.data(), &outlen) != 1) {
+        return false;
+    }
+    if (outlen > 0) {
+        sink(outbuf.data(), outlen);
+    }
+    return true;
+}
+
+void CipherStream::addAad(const unsigned char* data, size_t length) {
+    int outlen = 0;
+    if (EVP_CipherUpdate(ctx, nullptr, &outlen, data, (int)length) != 1) {
+        throw runtime_error("Cipher AAD update failed");
+    }
+}
+
+void CipherStream::getTag(unsigned char* tag) {
+    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, (int)TAG_SIZE, tag) != 1) {
+        throw runtime_error("Cipher has no authentication tag");
+    }
+}
+
+void CipherStream::setTag(const unsigned char* tag) {
+    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, (int)TAG_SIZE, const_cast<unsigned char*>(tag)) != 1) {
+        throw runtime_error("Cipher does not take an authentication tag");
+    }
+}
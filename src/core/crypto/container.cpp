@@ -0,0 +1,528 @@
+#include "container.hpp"
+#include "cipherBackend.hpp"
+#include "mappedFile.hpp"
+#include "parallelCtr.hpp"
+#include "substitutionTable.hpp"
+#include <openssl/rand.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+    const char HEADER_MAGIC[4] = { 'X', 'C', 'R', 'C' };
+    const char FOOTER_MAGIC[4] = { 'X', 'C', 'R', 'I' };
+    const size_t RECORD_PREFIX = 4;
+    const size_t INDEX_ENTRY_SIZE = 16;
+    const size_t FOOTER_SIZE = 32;
+    // Chunk index of the seal's IV in the authenticated modes, never reached by a chunk
+    const uint64_t SEAL_INDEX = UINT64_MAX;
+
+    void putU16(unsigned char* p, uint16_t v) {
+        p[0] = (unsigned char)v;
+        p[1] = (unsigned char)(v >> 8);
+    }
+
+    void putU32(unsigned char* p, uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            p[i] = (unsigned char)(v >> (8 * i));
+        }
+    }
+
+    void putU64(unsigned char* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            p[i] = (unsigned char)(v >> (8 * i));
+        }
+    }
+
+    uint16_t getU16(const unsigned char* p) {
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    uint32_t getU32(const unsigned char* p) {
+        uint32_t v = 0;
+        for (int i = 3; i >= 0; --i) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    uint64_t getU64(const unsigned char* p) {
+        uint64_t v = 0;
+        for (int i = 7; i >= 0; --i) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    [[noreturn]] void malformed(const string& reason) {
+        throw runtime_error("Invalid container: " + reason);
+    }
+
+    // Associated data of the authenticated modes: the serialized header followed by two values
+    void addAad(CipherStream& stream, const ContainerHeader& head, uint64_t first, uint64_t second) {
+        unsigned char aad[ContainerHeader::SIZE + 16];
+        head.serialize(aad);
+        putU64(aad + ContainerHeader::SIZE, first);
+        putU64(aad + ContainerHeader::SIZE + 8, second);
+        stream.addAad(aad, sizeof(aad));
+    }
+}
+
+void ContainerHeader::serialize(unsigned char* output) const {
+    memset(output, 0, SIZE);
+    memcpy(output, HEADER_MAGIC, 4);
+    putU16(output + 4, version);
+    putU16(output + 6, (uint16_t)SIZE);
+    output[8] = CipherBackend::id(mode);
+    output[9] = layers;
+    putU32(output + 12, keyId);
+    putU32(output + 16, chunkSize);
+    memcpy(output + 24, nonce.data(), nonce.size());
+}
+
+bool ContainerHeader::matches(const unsigned char* data, size_t length) {
+    return length >= 4 && memcmp(data, HEADER_MAGIC, 4) == 0;
+}
+
+ContainerHeader ContainerHeader::parse(const unsigned char* data, size_t length) {
+    if (length < SIZE || !matches(data, length)) {
+        malformed("missing header");
+    }
+
+    ContainerHeader header;
+    header.version = getU16(data + 4);
+    if (header.version != VERSION) {
+        malformed("unsupported version " + to_string(header.version));
+    }
+    if (getU16(data + 6) != SIZE) {
+        malformed("unexpected header size");
+    }
+    if (!CipherBackend::fromId(data[8], header.mode)) {
+        malformed("unknown cipher mode " + to_string(data[8]));
+    }
+    header.layers = data[9];
+    if (header.layers & ~LAYER_SUBSTITUTION) {
+        malformed("unknown layer flags");
+    }
+    header.keyId = getU32(data + 12);
+    header.chunkSize = getU32(data + 16);
+    if (header.chunkSize == 0) {
+        malformed("chunk size is 0");
+    }
+    memcpy(header.nonce.data(), data + 24, header.nonce.size());
+    return header;
+}
+
+string ContainerHeader::chunkIV(uint64_t index) const {
+    if (CipherStream::isAuthenticated(mode)) {
+        string iv((const char*)nonce.data(), 12);
+        uint64_t counter = 0;
+        for (size_t i = 4; i < 12; ++i) {
+            counter = (counter << 8) | (unsigned char)iv[i];
+        }
+        counter += index;
+        for (size_t i = 11; i >= 4; --i) {
+            iv[i] = (char)(counter & 0xFF);
+            counter >>= 8;
+        }
+        return iv;
+    }
+
+    // One spare block per chunk covers CBC padding
+    uint64_t blocksPerChunk = (chunkSize + 15) / 16 + 1;
+    return ParallelCtr::counterAt(string((const char*)nonce.data(), nonce.size()), index * blocksPerChunk);
+}
+
+size_t ContainerHeader::storedLength(size_t plainLength) const {
+    size_t tag = CipherStream::isAuthenticated(mode) ? CipherStream::TAG_SIZE : 0;
+    return CipherStream::ciphertextLength(mode, plainLength) + tag;
+}
+
+ContainerWriter::ContainerWriter(const SubstitutionTable& table, const string& key, const Options& options,
+    const CipherStream::Sink& sink)
+    : table(table), key(key), sink(sink), streamReady(false),
+    offset(0), plaintextSize(0), chunkCount(0), finished(false) {
+    start(options);
+}
+
+ContainerWriter::ContainerWriter(const SubstitutionTable& table, const string& key, const CipherStream::Sink& sink)
+    : table(table), key(key), sink(sink), streamReady(false),
+    offset(0), plaintextSize(0), chunkCount(0), finished(false) {
+    start(Options());
+}
+
+ContainerWriter::ContainerWriter(const SubstitutionTable& table, const string& key, const ContainerHeader& header,
+    uint64_t committed, const CipherStream::Sink& sink)
+    : table(table), key(key), sink(sink), head(header), streamReady(false),
+    offset(sizeAfter(header, committed)), plaintextSize(committed * header.chunkSize), chunkCount(committed), finished(false) {
+    // Committed chunks are all full, so their entries follow from the header alone
+    uint32_t stored = (uint32_t)head.storedLength(head.chunkSize);
+    index.resize(committed * INDEX_ENTRY_SIZE);
+    for (uint64_t i = 0; i < committed; ++i) {
+        unsigned char* entry = index.data() + i * INDEX_ENTRY_SIZE;
+        putU64(entry, sizeAfter(head, i));
+        putU32(entry + 8, stored);
+        putU32(entry + 12, head.chunkSize);
+    }
+}
+
+void ContainerWriter::start(const Options& options) {
+    if (options.chunkSize == 0) {
+        throw invalid_argument("Chunk size must be positive");
+    }
+    head.mode = options.mode;
+    head.layers = options.substitution ? ContainerHeader::LAYER_SUBSTITUTION : 0;
+    head.keyId = options.keyId;
+    head.chunkSize = options.chunkSize;
+    if (RAND_bytes(head.nonce.data(), (int)head.nonce.size()) != 1) {
+        throw runtime_error("Could not generate container nonce");
+    }
+
+    unsigned char header[ContainerHeader::SIZE];
+    head.serialize(header);
+    emit(header, sizeof(header));
+}
+
+const ContainerHeader& ContainerWriter::header() const {
+    return head;
+}
+
+uint64_t ContainerWriter::committedChunks() const {
+    return chunkCount;
+}
+
+uint64_t ContainerWriter::committedSize() const {
+    return offset;
+}
+
+uint64_t ContainerWriter::sizeAfter(const ContainerHeader& header, uint64_t count) {
+    return ContainerHeader::SIZE + count * (RECORD_PREFIX + header.storedLength(header.chunkSize));
+}
+
+void ContainerWriter::startCipher(const string& iv) {
+    // The key schedule is expanded once and kept for every chunk
+    if (!streamReady) {
+        stream.init(CipherStream::Direction::ENCRYPT, key, iv, head.mode);
+        streamReady = true;
+    }
+    else {
+        stream.reset(iv);
+    }
+}
+
+void ContainerWriter::emit(const unsigned char* data, size_t length) {
+    sink(data, length);
+    offset += length;
+}
+
+void ContainerWriter::write(const unsigned char* data, size_t length) {
+    if (finished) {
+        throw logic_error("Container already finished");
+    }
+    plaintextSize += length;
+
+    // Top up a partial chunk first, then take full chunks straight from the input
+    if (!pending.empty()) {
+        size_t take = min(length, head.chunkSize - pending.size());
+        pending.insert(pending.end(), data, data + take);
+        data += take;
+        length -= take;
+        if (pending.size() < head.chunkSize) {
+            return;
+        }
+        writeChunk(pending.data(), pending.size());
+        pending.clear();
+    }
+    while (length >= head.chunkSize) {
+        writeChunk(data, head.chunkSize);
+        data += head.chunkSize;
+        length -= head.chunkSize;
+    }
+    pending.assign(data, data + length);
+}
+
+void ContainerWriter::writeChunk(const unsigned char* data, size_t length) {
+    const unsigned char* plain = data;
+    if (head.layers & ContainerHeader::LAYER_SUBSTITUTION) {
+        work.resize(length);
+        table.encrypt(data, work.data(), length);
+        plain = work.data();
+    }
+
+    bool authenticated = CipherStream::isAuthenticated(head.mode);
+    startCipher(head.chunkIV(chunkCount));
+    if (authenticated) {
+        addAad(stream, head, chunkCount, 0);
+    }
+
+    record.resize(RECORD_PREFIX + length + EVP_MAX_BLOCK_LENGTH + CipherStream::TAG_SIZE);
+    size_t stored = stream.update(plain, length, record.data() + RECORD_PREFIX);
+    stream.final([&](const unsigned char* tail, size_t count) {
+        memcpy(record.data() + RECORD_PREFIX + stored, tail, count);
+        stored += count;
+    });
+    if (authenticated) {
+        stream.getTag(record.data() + RECORD_PREFIX + stored);
+        stored += CipherStream::TAG_SIZE;
+    }
+    putU32(record.data(), (uint32_t)stored);
+
+    unsigned char entry[INDEX_ENTRY_SIZE];
+    putU64(entry, offset);
+    putU32(entry + 8, (uint32_t)stored);
+    putU32(entry + 12, (uint32_t)length);
+    index.insert(index.end(), entry, entry + sizeof(entry));
+
+    emit(record.data(), RECORD_PREFIX + stored);
+    chunkCount++;
+}
+
+void ContainerWriter::finish() {
+    if (finished) {
+        return;
+    }
+    if (!pending.empty()) {
+        writeChunk(pending.data(), pending.size());
+        pending.clear();
+    }
+
+    if (CipherStream::isAuthenticated(head.mode)) {
+        unsigned char seal[CipherStream::TAG_SIZE];
+        startCipher(head.chunkIV(SEAL_INDEX));
+        addAad(stream, head, chunkCount, plaintextSize);
+        stream.final([](const unsigned char*, size_t) {});
+        stream.getTag(seal);
+        emit(seal, sizeof(seal));
+    }
+
+    uint64_t indexOffset = offset;
+    if (!index.empty()) {
+        emit(index.data(), index.size());
+    }
+
+    unsigned char footer[FOOTER_SIZE] = {};
+    putU64(footer, indexOffset);
+    putU64(footer + 8, chunkCount);
+    putU64(footer + 16, plaintextSize);
+    memcpy(footer + 24, FOOTER_MAGIC, 4);
+    emit(footer, sizeof(footer));
+    finished = true;
+}
+
+ContainerReader::ContainerReader(const SubstitutionTable& table, const string& key, const string& path)
+    : table(table), key(key), file(new MappedFile(path)), plaintextSize(0), streamReady(false), cachedChunk(SIZE_MAX) {
+    data = file->data();
+    length = file->size();
+    parse();
+}
+
+ContainerReader::ContainerReader(const SubstitutionTable& table, const string& key, const unsigned char* data, size_t length)
+    : table(table), key(key), data(data), length(length), plaintextSize(0), streamReady(false), cachedChunk(SIZE_MAX) {
+    parse();
+}
+
+ContainerReader::ContainerReader(const SubstitutionTable& table, const string& key, const unsigned char* data, size_t length,
+    const ContainerHeader& header, uint64_t chunkCount)
+    : table(table), key(key), data(data), length(length), head(header), plaintextSize(0), streamReady(false),
+    cachedChunk(SIZE_MAX) {
+    if (length < ContainerWriter::sizeAfter(header, chunkCount)) {
+        malformed("shorter than its " + to_string(chunkCount) + " committed chunks");
+    }
+
+    uint32_t stored = (uint32_t)head.storedLength(head.chunkSize);
+    chunks.resize(chunkCount);
+    for (uint64_t i = 0; i < chunkCount; ++i) {
+        Chunk& chunk = chunks[i];
+        chunk.offset = ContainerHeader::SIZE + i * (RECORD_PREFIX + stored);
+        chunk.storedLength = stored;
+        chunk.plainLength = head.chunkSize;
+        if (getU32(data + chunk.offset) != stored) {
+            malformed("bad record length in chunk " + to_string(i));
+        }
+    }
+    plaintextSize = chunkCount * head.chunkSize;
+}
+
+ContainerReader::~ContainerReader() {
+}
+
+void ContainerReader::parse() {
+    head = ContainerHeader::parse(data, length);
+    if (length < ContainerHeader::SIZE + FOOTER_SIZE) {
+        malformed("truncated");
+    }
+
+    const unsigned char* footer = data + length - FOOTER_SIZE;
+    if (memcmp(footer + 24, FOOTER_MAGIC, 4) != 0) {
+        malformed("missing index footer (truncated file?)");
+    }
+    uint64_t indexOffset = getU64(footer);
+    uint64_t count = getU64(footer + 8);
+    plaintextSize = getU64(footer + 16);
+
+    uint64_t indexEnd = length - FOOTER_SIZE;
+    // Chunk records end where the seal (if any) starts
+    bool authenticated = CipherStream::isAuthenticated(head.mode);
+    uint64_t sealSize = authenticated ? CipherStream::TAG_SIZE : 0;
+    if (indexOffset < ContainerHeader::SIZE + sealSize || indexOffset > indexEnd
+        || count != (indexEnd - indexOffset) / INDEX_ENTRY_SIZE
+        || (indexEnd - indexOffset) % INDEX_ENTRY_SIZE != 0) {
+        malformed("bad index");
+    }
+    uint64_t recordsEnd = indexOffset - sealSize;
+
+    // Checked before anything else, so a wrong key costs one tag computation
+    if (authenticated) {
+        startCipher(head.chunkIV(SEAL_INDEX));
+        addAad(stream, head, count, plaintextSize);
+        stream.setTag(data + recordsEnd);
+        if (!stream.final([](const unsigned char*, size_t) {})) {
+            throw runtime_error("Container authentication failed (wrong key or modified header or footer)");
+        }
+    }
+
+    chunks.resize(count);
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        const unsigned char* entry = data + indexOffset + i * INDEX_ENTRY_SIZE;
+        Chunk& chunk = chunks[i];
+        chunk.offset = getU64(entry);
+        chunk.storedLength = getU32(entry + 8);
+        chunk.plainLength = getU32(entry + 12);
+
+        bool lastChunk = (i + 1 == count);
+        if (chunk.offset < ContainerHeader::SIZE || chunk.offset > recordsEnd
+            || recordsEnd - chunk.offset < RECORD_PREFIX + (uint64_t)chunk.storedLength
+            || getU32(data + chunk.offset) != chunk.storedLength
+            || chunk.storedLength != head.storedLength(chunk.plainLength)
+            || chunk.plainLength > head.chunkSize
+            || (!lastChunk && chunk.plainLength != head.chunkSize)) {
+            malformed("bad index entry " + to_string(i));
+        }
+        total += chunk.plainLength;
+    }
+    if (total != plaintextSize) {
+        malformed("index does not add up to the plaintext size");
+    }
+}
+
+const ContainerHeader& ContainerReader::header() const {
+    return head;
+}
+
+uint64_t ContainerReader::size() const {
+    return plaintextSize;
+}
+
+size_t ContainerReader::chunkCount() const {
+    return chunks.size();
+}
+
+const ContainerReader::Chunk& ContainerReader::chunk(size_t index) const {
+    return chunks.at(index);
+}
+
+void ContainerReader::startCipher(const string& iv) {
+    if (!streamReady) {
+        stream.init(CipherStream::Direction::DECRYPT, key, iv, head.mode);
+        streamReady = true;
+    }
+    else {
+        stream.reset(iv);
+    }
+}
+
+size_t ContainerReader::readChunk(size_t index, size_t from, size_t count, unsigned char* output) {
+    const Chunk& chunk = chunks[index];
+    const unsigned char* stored = data + chunk.offset + RECORD_PREFIX;
+
+    if (CipherStream::isAuthenticated(head.mode)) {
+        // The tag covers the whole chunk, so it is decrypted and checked in
+        // full before a single byte goes on; later reads of it are served from work
+        if (cachedChunk != index) {
+            cachedChunk = SIZE_MAX;
+            startCipher(head.chunkIV(index));
+            addAad(stream, head, index, 0);
+            work.resize(chunk.plainLength);
+            stream.update(stored, chunk.plainLength, work.data());
+            stream.setTag(stored + chunk.plainLength);
+            if (!stream.final([](const unsigned char*, size_t) {})) {
+                throw runtime_error("Container chunk " + to_string(index) + " failed authentication (wrong key or corrupted data)");
+            }
+            cachedChunk = index;
+        }
+        if (head.layers & ContainerHeader::LAYER_SUBSTITUTION) {
+            table.decrypt(work.data() + from, output, count);
+        }
+        else {
+            memcpy(output, work.data() + from, count);
+        }
+        return count;
+    }
+
+    // Both modes can start mid-chunk: CTR at the counter of the first block,
+    // CBC with the previous ciphertext block as IV
+    size_t firstBlock = from / 16;
+    string iv;
+    size_t begin = firstBlock * 16;
+    size_t end;
+    if (head.mode == CipherMode::AES_256_CTR) {
+        iv = ParallelCtr::counterAt(head.chunkIV(index), firstBlock);
+        end = min<size_t>(chunk.storedLength, (from + count + 15) / 16 * 16);
+    }
+    else {
+        iv = (firstBlock == 0) ? head.chunkIV(index) : string((const char*)stored + begin - 16, 16);
+        // Run to the end so the padding is checked and stripped
+        end = chunk.storedLength;
+    }
+
+    startCipher(iv);
+    work.resize(end - begin + EVP_MAX_BLOCK_LENGTH);
+    size_t produced = stream.update(stored + begin, end - begin, work.data());
+    bool ok = stream.final([&](const unsigned char* tail, size_t tailLength) {
+        memcpy(work.data() + produced, tail, tailLength);
+        produced += tailLength;
+    });
+    if (!ok) {
+        throw runtime_error("Container chunk " + to_string(index) + " failed to decrypt (wrong key or corrupted data)");
+    }
+
+    size_t skip = from - begin;
+    if (produced < skip + count) {
+        throw runtime_error("Container chunk " + to_string(index) + " is shorter than its index entry");
+    }
+    if (head.layers & ContainerHeader::LAYER_SUBSTITUTION) {
+        table.decrypt(work.data() + skip, output, count);
+    }
+    else {
+        memcpy(output, work.data() + skip, count);
+    }
+    return count;
+}
+
+size_t ContainerReader::read(uint64_t offset, size_t count, unsigned char* output) {
+    if (offset > plaintextSize) {
+        throw out_of_range("Read offset beyond the end of the container");
+    }
+    count = (size_t)min<uint64_t>(count, plaintextSize - offset);
+
+    size_t written = 0;
+    while (written < count) {
+        uint64_t position = offset + written;
+        size_t index = (size_t)(position / head.chunkSize);
+        size_t from = (size_t)(position % head.chunkSize);
+        size_t take = min<size_t>(count - written, chunks[index].plainLength - from);
+        written += readChunk(index, from, take, output + written);
+    }
+    return written;
+}
+
+string ContainerReader::read(uint64_t offset, size_t count) {
+    if (offset > plaintextSize) {
+        throw out_of_range("Read offset beyond the end of the container");
+    }
+    string result((size_t)min<uint64_t>(count, plaintextSize - offset), '\0');
+    read(offset, result.size(), (unsigned char*)&result[0]);
+    return result;
+}
@@ -1,73 +1,142 @@
 #include "decrypt.hpp"
-#include <openssl/evp.h>
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
-#include <cstring>
+#include "cipherSession.hpp"
+#include "substitutionTable.hpp"
+#include "layeredPipeline.hpp"
+#include "parallelCtr.hpp"
+#include "base64.hpp"
+#include "container.hpp"
+#include "keyRing.hpp"
 #include <iostream>
+#include <stdexcept>
 using namespace std;
 
 string Decrypt::decryptString(const map<char, char>& charMapping, const string& encrypted) {
-    string decrypted;
-    for (char c : encrypted) {
-        for (const auto& pair : charMapping) {
-            if (pair.second == c) {
-                decrypted += pair.first;
-                break;
-            }
-        }
-    }
-    return decrypted;
+    return decryptString(SubstitutionTable(charMapping), encrypted);
 }
 
-string Decrypt::decryptAES(const string& ciphertext, const string& key, const string& iv) {
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    unsigned char outbuf[1024];
-    int outlen;
+string Decrypt::decryptString(const SubstitutionTable& table, const string& encrypted) {
+    return table.decrypt(encrypted);
+}
 
+static string runDecrypt(CipherStream& stream, const string& ciphertext) {
     string plaintext;
+    plaintext.reserve(ciphertext.size());
+    auto sink = [&plaintext](const unsigned char* data, size_t length) {
+        plaintext.append((const char*)data, length);
+    };
 
-    EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, (unsigned char*)key.c_str(), (unsigned char*)iv.c_str());
-    EVP_DecryptUpdate(ctx, outbuf, &outlen, (unsigned char*)ciphertext.c_str(), ciphertext.size());
-    plaintext.assign((char*)outbuf, outlen);
+    stream.update((const unsigned char*)ciphertext.data(), ciphertext.size(), sink);
 
-    if (EVP_DecryptFinal_ex(ctx, outbuf, &outlen) > 0) {
-        plaintext.append((char*)outbuf, outlen);
-    }
-    else {
+    // Output that failed to decrypt is never handed back, not even in part
+    if (!stream.final(sink)) {
         cerr << "Error: AES decryption failed." << endl;
+        return string();
     }
 
-    EVP_CIPHER_CTX_free(ctx);
+    return plaintext;
+}
+
+string Decrypt::decryptAES(const string& ciphertext, const string& key, const string& iv) {
+    CipherStream stream;
+    stream.init(CipherStream::Direction::DECRYPT, key, iv);
+    return runDecrypt(stream, ciphertext);
+}
+
+string Decrypt::decryptAES(CipherSession& session, const string& ciphertext) {
+    return runDecrypt(session.decryptor(), ciphertext);
+}
+
+string Decrypt::decryptAESParallel(const string& ciphertext, const string& key, unsigned threads) {
+    if (ciphertext.size() < ParallelCtr::IV_SIZE) {
+        throw invalid_argument("Ciphertext is shorter than its IV");
+    }
+    string iv = ciphertext.substr(0, ParallelCtr::IV_SIZE);
+    size_t length = ciphertext.size() - ParallelCtr::IV_SIZE;
+    string plaintext(length, '\0');
+    ParallelCtr::apply(key, iv, (const unsigned char*)ciphertext.data() + ParallelCtr::IV_SIZE, (unsigned char*)&plaintext[0],
+        length, threads);
     return plaintext;
 }
 
 string Decrypt::base64Decode(const string& input) {
-    BIO* bio, * b64;
-    char buffer[1024];
-    memset(buffer, 0, sizeof(buffer));
+    // Older releases wrapped base64 output at 64 columns; accept that, but nothing else
+    if (input.find_first_of("\r\n") == string::npos) {
+        return Base64::decode(input);
+    }
 
-    b64 = BIO_new(BIO_f_base64());
-    bio = BIO_new_mem_buf(input.data(), input.size());
-    BIO_push(b64, bio);
+    string unwrapped;
+    unwrapped.reserve(input.size());
+    for (char c : input) {
+        if (c != '\r' && c != '\n') {
+            unwrapped.push_back(c);
+        }
+    }
+    return Base64::decode(unwrapped);
+}
+
+static string runLayered(const SubstitutionTable& table, const string& encrypted, CipherStream& stream,
+    Encoding encoding = Encoding::BASE64) {
+    string output;
+    output.reserve(TextEncoding::decodedMaxLength(encoding, encrypted.size()));
+    auto sink = [&output](const unsigned char* data, size_t length) {
+        output.append((const char*)data, length);
+    };
+
+    LayeredPipeline pipeline(CipherStream::Direction::DECRYPT, table, stream, encoding);
+    pipeline.update((const unsigned char*)encrypted.data(), encrypted.size(), sink);
+
+    if (!pipeline.final(sink)) {
+        cerr << "Error: Decryption failed." << endl;
+        return string();
+    }
+    return output;
+}
+
+static string decryptWithKey(const SubstitutionTable& table, const string& encrypted, const string& aesKey, const string& iv,
+    CipherMode mode) {
+    if (CipherStream::isAuthenticated(mode)) {
+        LayeredPipeline::framedMode((const unsigned char*)encrypted.data(), encrypted.size(), Encoding::BASE64, mode);
+    }
+    CipherStream stream;
+    stream.init(CipherStream::Direction::DECRYPT, aesKey, iv, mode);
+    return runLayered(table, encrypted, stream);
+}
 
-    BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
+string Decrypt::decryptLayered(const map<char, char>& charMapping, const string& encrypted, const string& aesKey, const string& iv,
+    CipherMode mode) {
+    return decryptWithKey(SubstitutionTable(charMapping), encrypted, aesKey, iv, mode);
+}
 
-    int decodedLength = BIO_read(b64, buffer, sizeof(buffer));
-    if (decodedLength <= 0) {
-        cerr << "Error: Base64 Decoding failed. Input: [" << input << "]" << endl;
+string Decrypt::decryptLayered(const KeyRing& ring, const string& encrypted, const string& aesKey, const string& iv, CipherMode mode) {
+    uint32_t keyId = 0;
+    size_t skip = 0;
+    if (KeyRing::readPrefix((const unsigned char*)encrypted.data(), encrypted.size(), keyId)) {
+        skip = KeyRing::PREFIX_SIZE;
     }
-    BIO_free_all(b64);
+    const KeyRing::Generation& generation = ring.get(keyId);
+    return decryptWithKey(generation.table, encrypted.substr(skip), generation.cipherKey(aesKey), iv, mode);
+}
+
+string Decrypt::decryptLayered(const SubstitutionTable& table, const string& encrypted, CipherSession& session) {
+    return runLayered(table, encrypted, session.decryptor());
+}
 
-    return string(buffer, decodedLength);
+string Decrypt::decryptLayered(const SubstitutionTable& table, const string& encrypted, CipherSession& session, Encoding encoding) {
+    return runLayered(table, encrypted, session.decryptor(), encoding);
 }
 
-string Decrypt::decryptLayered(const map<char, char>& charMapping, const string& encrypted, const string& aesKey, const string& iv) {
-    // Decode base64
-    string decoded = base64Decode(encrypted);
+string Decrypt::decryptContainer(const SubstitutionTable& table, const string& container, const string& aesKey) {
+    ContainerReader reader(table, aesKey, (const unsigned char*)container.data(), container.size());
+    return reader.read(0, (size_t)reader.size());
+}
 
-    // Layer 2: Decrypt AES
-    string layer2 = decryptAES(decoded, aesKey, iv);
+string Decrypt::decryptRange(const SubstitutionTable& table, const string& container, const string& aesKey, uint64_t offset, size_t length) {
+    ContainerReader reader(table, aesKey, (const unsigned char*)container.data(), container.size());
+    return reader.read(offset, length);
+}
 
-    // Layer 1: Decrypt substitution
-    return decryptString(charMapping, layer2);
-}
\ No newline at end of file
+string Decrypt::decryptRangeFromFile(const SubstitutionTable& table, const string& path, const string& aesKey, uint64_t offset, size_t length) {
+    // Only the pages of the header, index and the chunks read get faulted in
+    ContainerReader reader(table, aesKey, path);
+    return reader.read(offset, length);
+}
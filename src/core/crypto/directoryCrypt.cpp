@@ -0,0 +1,563 @@
+#include "directoryCrypt.hpp"
+#include "fileCrypt.hpp"
+#include "layeredPipeline.hpp"
+#include "mappedFile.hpp"
+#include "outputFile.hpp"
+#include "parallelCtr.hpp"
+#include "substitutionTable.hpp"
+#include "workStealingPool.hpp"
+#include "zlibStream.hpp"
+#include <openssl/sha.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+    struct Context {
+        CipherStream::Direction direction;
+        const SubstitutionTable& table;
+        string key;
+        string iv;
+        CipherMode mode;
+        BatchIo::Backend io;
+        Encoding encoding;
+        Compression compression;
+        // Encoded text produced by one full chunk
+        size_t textChunkSize;
+
+        atomic<size_t> files{ 0 };
+        atomic<uint64_t> bytesRead{ 0 };
+        atomic<uint64_t> bytesWritten{ 0 };
+        atomic<uint64_t> ioSyscalls{ 0 };
+
+        mutex errorLock;
+        vector<string> errors;
+        string ioBackend;
+
+        Context(CipherStream::Direction direction, const SubstitutionTable& table, const string& key,
+            const string& iv, CipherMode mode, BatchIo::Backend io, Encoding encoding, Compression compression)
+            : direction(direction), table(table), key(key), iv(iv), mode(mode), io(io), encoding(encoding), compression(compression),
+            textChunkSize(TextEncoding::encodedLength(encoding, DirectoryCrypt::CHUNK_SIZE)) {
+        }
+
+        void succeeded(uint64_t read, uint64_t written) {
+            files++;
+            bytesRead += read;
+            bytesWritten += written;
+        }
+
+        void failed(const string& path, const string& reason) {
+            lock_guard<mutex> guard(errorLock);
+            errors.push_back(path + ": " + reason);
+        }
+    };
+
+    // A large file whose chunks are processed as separate jobs
+    struct SplitFile {
+        Context& context;
+        string relativePath;
+        string outputPath;
+        string partPath;
+        // Nonce from the file's frame head, and where the text after that head starts
+        string iv;
+        size_t textStart;
+        MappedFile input;
+        unique_ptr<OutputFile> output;
+
+        size_t inputLength;
+        uint64_t outputLength;
+        size_t chunkCount;
+        atomic<size_t> remaining{ 0 };
+
+        mutex errorLock;
+        string error;
+
+        SplitFile(Context& context, const string& inputPath)
+            : context(context), textStart(0), input(inputPath), inputLength(0), outputLength(0), chunkCount(0) {
+        }
+
+        void fail(const string& reason) {
+            lock_guard<mutex> guard(errorLock);
+            if (error.empty()) {
+                error = reason;
+            }
+        }
+    };
+
+    struct SmallFile {
+        fs::path source;
+        fs::path target;
+        string relativePath;
+        uint64_t size;
+    };
+
+    // Holds the whole input plus the encoding of its padded or framed ciphertext,
+    // even if compression made it grow; hex is the largest encoding
+    size_t smallFileBuffer() {
+        size_t staged = ZlibStream::compressedBound(DirectoryCrypt::SMALL_FILE_SIZE) + LayeredPipeline::MARKER_SIZE;
+        size_t ciphertext = max(CipherStream::ciphertextLength(CipherMode::AES_256_CBC, staged),
+            staged + LayeredPipeline::framingLength(CipherMode::CHACHA20_POLY1305));
+        return TextEncoding::encodedLength(Encoding::HEX, ciphertext);
+    }
+
+    // One BatchIo per worker thread, buffers 0..BATCH_FILES-1 for input and the rest for output
+    BatchIo& workerIo(Context& context) {
+        thread_local unique_ptr<BatchIo> io;
+        if (!io) {
+            io = BatchIo::create(context.io, 2 * DirectoryCrypt::BATCH_FILES, 2 * DirectoryCrypt::BATCH_FILES, smallFileBuffer());
+            lock_guard<mutex> guard(context.errorLock);
+            if (context.ioBackend.empty()) {
+                context.ioBackend = io->name();
+            }
+        }
+        return *io;
+    }
+
+    string ioError(int64_t result) {
+        return strerror((int)-result);
+    }
+
+    void processWhole(Context& context, const fs::path& inputPath, const fs::path& outputPath,
+        const string& relativePath, uint64_t size) {
+        try {
+            CipherStream stream;
+            stream.init(context.direction, context.key, DirectoryCrypt::fileIV(context.iv, relativePath), context.mode);
+
+            size_t written = (context.direction == CipherStream::Direction::ENCRYPT)
+                ? FileCrypt::encryptFile(context.table, stream, inputPath.string(), outputPath.string(), context.encoding,
+                    context.compression)
+                : FileCrypt::decryptFile(context.table, stream, inputPath.string(), outputPath.string(), context.encoding);
+            context.succeeded(size, written);
+        }
+        catch (const exception& e) {
+            context.failed(relativePath, e.what());
+        }
+    }
+
+    // Open, read, write and close a batch of small files in four rounds of I/O
+    void processBatch(Context& context, const vector<SmallFile>& batch) {
+        BatchIo& io = workerIo(context);
+        uint64_t syscallsBefore = io.syscalls();
+        size_t n = batch.size();
+        vector<string> errors(n);
+        vector<int> inputFds(n, -1);
+        vector<int> outputFds(n, -1);
+        vector<size_t> outputLengths(n, 0);
+        // Compressed files can inflate past the buffer; those are redone whole
+        vector<char> tooLarge(n, 0);
+        vector<BatchIo::Completion> done;
+
+        for (size_t i = 0; i < n; ++i) {
+            io.queueOpen(batch[i].source.string(), O_RDONLY, 0, 2 * i);
+            io.queueOpen(batch[i].target.string() + ".part", O_WRONLY | O_CREAT | O_TRUNC, 0644, 2 * i + 1);
+        }
+        io.submit(done);
+        for (const BatchIo::Completion& c : done) {
+            size_t i = c.tag / 2;
+            if (c.result < 0) {
+                errors[i] = "Could not open " + string(c.tag % 2 ? "output" : "input") + ": " + ioError(c.result);
+            }
+            else {
+                (c.tag % 2 ? outputFds : inputFds)[i] = (int)c.result;
+            }
+        }
+
+        done.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (errors[i].empty()) {
+                io.queueRead(inputFds[i], i, batch[i].size, 0, i);
+            }
+        }
+        io.submit(done);
+        for (const BatchIo::Completion& c : done) {
+            if (c.result != (int64_t)batch[c.tag].size) {
+                errors[c.tag] = c.result < 0 ? "Read failed: " + ioError(c.result) : "File changed while reading";
+            }
+        }
+
+        // Layered pipeline from input buffer i into output buffer BATCH_FILES + i
+        for (size_t i = 0; i < n; ++i) {
+            if (!errors[i].empty()) {
+                continue;
+            }
+            try {
+                CipherStream stream;
+                stream.init(context.direction, context.key, DirectoryCrypt::fileIV(context.iv, batch[i].relativePath), context.mode);
+                LayeredPipeline pipeline(context.direction, context.table, stream, context.encoding, context.compression);
+
+                unsigned char* output = io.buffer(DirectoryCrypt::BATCH_FILES + i);
+                size_t& length = outputLengths[i];
+                auto sink = [&](const unsigned char* data, size_t count) {
+                    if (length + count > io.bufferSize()) {
+                        tooLarge[i] = 1;
+                        throw length_error("Output does not fit the batch buffer");
+                    }
+                    memcpy(output + length, data, count);
+                    length += count;
+                };
+                pipeline.update(io.buffer(i), batch[i].size, sink);
+                if (!pipeline.final(sink)) {
+                    throw runtime_error("Decryption failed (wrong key or corrupted data)");
+                }
+            }
+            catch (const exception& e) {
+                errors[i] = e.what();
+            }
+        }
+
+        done.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (errors[i].empty()) {
+                io.queueWrite(outputFds[i], DirectoryCrypt::BATCH_FILES + i, outputLengths[i], 0, 2 * i);
+            }
+            if (inputFds[i] >= 0) {
+                io.queueClose(inputFds[i], 2 * i + 1);
+            }
+        }
+        io.submit(done);
+        for (const BatchIo::Completion& c : done) {
+            size_t i = c.tag / 2;
+            if (c.tag % 2 == 0 && c.result != (int64_t)outputLengths[i] && errors[i].empty()) {
+                errors[i] = c.result < 0 ? "Write failed: " + ioError(c.result) : "Short write";
+            }
+        }
+
+        done.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (outputFds[i] >= 0) {
+                io.queueClose(outputFds[i], i);
+            }
+        }
+        io.submit(done);
+        for (const BatchIo::Completion& c : done) {
+            if (c.result < 0 && errors[c.tag].empty()) {
+                errors[c.tag] = "Write failed: " + ioError(c.result);
+            }
+        }
+        context.ioSyscalls += io.syscalls() - syscallsBefore;
+
+        for (size_t i = 0; i < n; ++i) {
+            string partPath = batch[i].target.string() + ".part";
+            error_code ec;
+            if (errors[i].empty()) {
+                fs::rename(partPath, batch[i].target, ec);
+                if (!ec) {
+                    context.succeeded(batch[i].size, outputLengths[i]);
+                    continue;
+                }
+                errors[i] = ec.message();
+            }
+            if (outputFds[i] >= 0) {
+                fs::remove(partPath, ec);
+            }
+            if (tooLarge[i]) {
+                processWhole(context, batch[i].source, batch[i].target, batch[i].relativePath, batch[i].size);
+                continue;
+            }
+            context.failed(batch[i].relativePath, errors[i]);
+        }
+    }
+
+    void finishSplit(SplitFile& file) {
+        string error;
+        {
+            lock_guard<mutex> guard(file.errorLock);
+            error = file.error;
+        }
+        if (error.empty()) {
+            try {
+                file.output->close();
+                fs::rename(file.partPath, file.outputPath);
+                file.context.succeeded(file.input.size(), file.outputLength);
+                return;
+            }
+            catch (const exception& e) {
+                error = e.what();
+            }
+        }
+
+        file.output.reset();
+        error_code ec;
+        fs::remove(file.partPath, ec);
+        file.context.failed(file.relativePath, error);
+    }
+
+    void processChunk(SplitFile& file, size_t index) {
+        // Reused across chunks handled by the same worker
+        thread_local vector<uint8_t> work;
+        thread_local vector<uint8_t> result;
+
+        Context& context = file.context;
+        try {
+            if (context.direction == CipherStream::Direction::ENCRYPT) {
+                size_t offset = index * DirectoryCrypt::CHUNK_SIZE;
+                size_t length = min(DirectoryCrypt::CHUNK_SIZE, file.inputLength - offset);
+                work.resize(length);
+                result.resize(TextEncoding::encodedLength(context.encoding, length));
+
+                context.table.encrypt(file.input.data() + offset, work.data(), length);
+                ParallelCtr::applyAt(context.key, file.iv, offset, work.data(), work.data(), length);
+                size_t encoded = TextEncoding::encode(context.encoding, work.data(), length, (char*)result.data());
+                file.output->writeAt(file.textStart + (uint64_t)index * context.textChunkSize, result.data(), encoded);
+                file.input.release(offset, length);
+            }
+            else {
+                size_t offset = file.textStart + index * context.textChunkSize;
+                size_t length = min(context.textChunkSize, file.textStart + file.inputLength - offset);
+                work.resize(TextEncoding::decodedMaxLength(context.encoding, length));
+
+                size_t decoded = TextEncoding::decode(context.encoding, (const char*)file.input.data() + offset, length, work.data());
+                uint64_t plainOffset = (uint64_t)index * DirectoryCrypt::CHUNK_SIZE;
+                ParallelCtr::applyAt(context.key, file.iv, plainOffset, work.data(), work.data(), decoded);
+                result.resize(decoded);
+                context.table.decrypt(work.data(), result.data(), decoded);
+                file.output->writeAt(plainOffset, result.data(), decoded);
+                file.input.release(offset, length);
+            }
+        }
+        catch (const exception& e) {
+            file.fail(e.what());
+        }
+
+        if (--file.remaining == 0) {
+            finishSplit(file);
+        }
+    }
+
+    // Nonce of an encrypted file, read from the frame head at the start of its text
+    string readFrameHead(const Context& context, const MappedFile& input) {
+        size_t headLength = LayeredPipeline::frameHeadLength(context.mode);
+        size_t textLength = TextEncoding::encodedLength(context.encoding, headLength);
+        if (input.size() < textLength) {
+            throw invalid_argument("Not a framed CTR message (wrong mode?)");
+        }
+        vector<uint8_t> head(TextEncoding::decodedMaxLength(context.encoding, textLength));
+        TextEncoding::decode(context.encoding, (const char*)input.data(), textLength, head.data());
+        return LayeredPipeline::frameNonce(context.mode, head.data());
+    }
+
+    // Whether encrypted text starts with a compressed message, which only LayeredPipeline can inflate
+    bool startsCompressed(const Context& context, const SplitFile& file) {
+        // Whole base64 groups covering the marker
+        const size_t PROBE_SIZE = 9;
+        size_t textLength = TextEncoding::encodedLength(context.encoding, PROBE_SIZE);
+        if (file.input.size() < file.textStart + textLength) {
+            return false;
+        }
+
+        uint8_t probe[PROBE_SIZE];
+        try {
+            TextEncoding::decode(context.encoding, (const char*)file.input.data() + file.textStart, textLength, probe);
+        }
+        catch (const invalid_argument&) {
+            // Reported by the split path with the file's real error
+            return false;
+        }
+        ParallelCtr::applyAt(context.key, file.iv, 0, probe, probe, LayeredPipeline::MARKER_SIZE);
+        return memcmp(probe, LayeredPipeline::MARKER, LayeredPipeline::MARKER_SIZE) == 0;
+    }
+
+    void processSplit(Context& context, WorkStealingPool& pool, const fs::path& inputPath,
+        const fs::path& outputPath, const string& relativePath) {
+        shared_ptr<SplitFile> file;
+        try {
+            file = make_shared<SplitFile>(context, inputPath.string());
+            file->relativePath = relativePath;
+            file->outputPath = outputPath.string();
+            file->partPath = file->outputPath + ".part";
+
+            // Same frame head LayeredPipeline writes: the nonce it holds is the file's IV
+            string head;
+            file->textStart = TextEncoding::encodedLength(context.encoding, LayeredPipeline::frameHeadLength(context.mode));
+            if (context.direction == CipherStream::Direction::ENCRYPT) {
+                head = LayeredPipeline::newFrameHead(context.mode);
+                file->iv = head.substr(1, ParallelCtr::IV_SIZE);
+            }
+            else {
+                file->iv = readFrameHead(context, file->input);
+            }
+
+            // Files the pipeline compresses have no fixed layout to split
+            bool whole = (context.direction == CipherStream::Direction::ENCRYPT)
+                ? LayeredPipeline::collidesWithMarker(context.table, file->input.data(), file->input.size())
+                : startsCompressed(context, *file);
+            if (whole) {
+                uint64_t size = file->input.size();
+                file.reset();
+                processWhole(context, inputPath, outputPath, relativePath, size);
+                return;
+            }
+            file->input.adviseSequential();
+
+            size_t chunkSize;
+            if (context.direction == CipherStream::Direction::ENCRYPT) {
+                file->inputLength = file->input.size();
+                file->outputLength = file->textStart + TextEncoding::encodedLength(context.encoding, file->inputLength);
+                chunkSize = DirectoryCrypt::CHUNK_SIZE;
+            }
+            else {
+                // Our own text output has no line breaks; allow a trailing one
+                Encoding encoding = context.encoding;
+                const char* text = (const char*)file->input.data();
+                size_t length = file->input.size();
+                while (TextEncoding::isText(encoding) && length > 0 && (text[length - 1] == '\n' || text[length - 1] == '\r')) {
+                    length--;
+                }
+                size_t unit = TextEncoding::unitSize(encoding);
+                if (length % unit != 0) {
+                    throw invalid_argument("Invalid " + string(TextEncoding::name(encoding)) +
+                        ": length is not a multiple of " + to_string(unit));
+                }
+                size_t padding = 0;
+                if (TextEncoding::isPadded(encoding)) {
+                    padding = (length > 0 && text[length - 1] == '=') + (length > 1 && text[length - 2] == '=');
+                }
+                if (length < file->textStart) {
+                    throw invalid_argument("Not a framed CTR message (wrong mode?)");
+                }
+                length -= file->textStart;
+                file->inputLength = length;
+                file->outputLength = length / unit * TextEncoding::groupSize(encoding) - padding;
+                chunkSize = context.textChunkSize;
+            }
+
+            file->output.reset(new OutputFile(file->partPath, file->outputLength));
+            if (!head.empty()) {
+                vector<char> headText(file->textStart);
+                TextEncoding::encode(context.encoding, (const uint8_t*)head.data(), head.size(), headText.data());
+                file->output->writeAt(0, headText.data(), headText.size());
+            }
+            file->chunkCount = (file->inputLength + chunkSize - 1) / chunkSize;
+            file->remaining = file->chunkCount;
+        }
+        catch (const exception& e) {
+            context.failed(relativePath, e.what());
+            return;
+        }
+
+        // Pushed onto this worker's deque; idle workers steal them
+        for (size_t i = 0; i < file->chunkCount; ++i) {
+            pool.submit([file, i] { processChunk(*file, i); });
+        }
+    }
+
+    bool isInside(const fs::path& child, const fs::path& parent) {
+        auto mismatch = std::mismatch(parent.begin(), parent.end(), child.begin(), child.end());
+        return mismatch.first == parent.end();
+    }
+}
+
+double DirectoryCrypt::Stats::megabytesPerSecond() const {
+    return seconds > 0 ? (double)bytesRead / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+string DirectoryCrypt::fileIV(const string& iv, const string& relativePath) {
+    string material = iv;
+    material.push_back('\0');
+    material += relativePath;
+
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256((const unsigned char*)material.data(), material.size(), hash);
+    return string((const char*)hash, 16);
+}
+
+DirectoryCrypt::Stats DirectoryCrypt::encryptTree(const SubstitutionTable& table, const string& key, const string& iv,
+    CipherMode mode, const string& inputDir, const string& outputDir, unsigned threads, BatchIo::Backend io,
+    Encoding encoding, Compression compression) {
+    return processTree(CipherStream::Direction::ENCRYPT, table, key, iv, mode, inputDir, outputDir, threads, io, encoding,
+        compression);
+}
+
+DirectoryCrypt::Stats DirectoryCrypt::decryptTree(const SubstitutionTable& table, const string& key, const string& iv,
+    CipherMode mode, const string& inputDir, const string& outputDir, unsigned threads, BatchIo::Backend io,
+    Encoding encoding) {
+    return processTree(CipherStream::Direction::DECRYPT, table, key, iv, mode, inputDir, outputDir, threads, io, encoding,
+        Compression::NONE);
+}
+
+DirectoryCrypt::Stats DirectoryCrypt::processTree(CipherStream::Direction direction, const SubstitutionTable& table,
+    const string& key, const string& iv, CipherMode mode, const string& inputDir, const string& outputDir,
+    unsigned threads, BatchIo::Backend io, Encoding encoding, Compression compression) {
+    if (io == BatchIo::Backend::URING && !BatchIo::uringAvailable()) {
+        throw runtime_error("io_uring is not available on this system");
+    }
+    if (!fs::is_directory(inputDir)) {
+        throw invalid_argument("Not a directory: " + inputDir);
+    }
+    fs::path inputRoot = fs::canonical(inputDir);
+    fs::path outputRoot = fs::weakly_canonical(outputDir);
+    if (isInside(outputRoot, inputRoot)) {
+        throw invalid_argument("Output directory must not be inside the input directory");
+    }
+    fs::create_directories(outputRoot);
+
+    auto start = chrono::steady_clock::now();
+    Context context(direction, table, key, iv, mode, io, encoding, compression);
+    {
+        WorkStealingPool pool(threads);
+        vector<SmallFile> batch;
+        auto submitBatch = [&] {
+            pool.submit([&context, files = move(batch)] { processBatch(context, files); });
+            batch.clear();
+        };
+
+        // Walk on this thread while the workers already process earlier files
+        auto options = fs::directory_options::skip_permission_denied;
+        for (auto it = fs::recursive_directory_iterator(inputRoot, options); it != fs::recursive_directory_iterator(); ++it) {
+            fs::path relative = it->path().lexically_relative(inputRoot);
+            fs::path target = outputRoot / relative;
+            string relativePath = relative.generic_string();
+
+            error_code ec;
+            if (it->is_directory(ec)) {
+                fs::create_directories(target, ec);
+                continue;
+            }
+            if (!it->is_regular_file(ec)) {
+                continue;
+            }
+
+            fs::path source = it->path();
+            uint64_t size = it->file_size(ec);
+            if (size <= SMALL_FILE_SIZE) {
+                batch.push_back({ source, target, relativePath, size });
+                if (batch.size() == BATCH_FILES) {
+                    submitBatch();
+                }
+            }
+            else if (mode == CipherMode::AES_256_CTR && size > SPLIT_THRESHOLD && compression == Compression::NONE) {
+                pool.submit([&context, &pool, source, target, relativePath] {
+                    processSplit(context, pool, source, target, relativePath);
+                });
+            }
+            else {
+                pool.submit([&context, source, target, relativePath, size] {
+                    processWhole(context, source, target, relativePath, size);
+                });
+            }
+        }
+        if (!batch.empty()) {
+            submitBatch();
+        }
+        pool.wait();
+    }
+
+    Stats stats;
+    stats.files = context.files;
+    stats.bytesRead = context.bytesRead;
+    stats.bytesWritten = context.bytesWritten;
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    stats.errors = move(context.errors);
+    stats.ioBackend = context.ioBackend;
+    stats.ioSyscalls = context.ioSyscalls;
+    sort(stats.errors.begin(), stats.errors.end());
+    return stats;
+}
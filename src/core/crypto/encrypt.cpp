@@ -1,60 +1,109 @@
 #include "encrypt.hpp"
+#include "cipherSession.hpp"
+#include "substitutionTable.hpp"
+#include "layeredPipeline.hpp"
+#include "parallelCtr.hpp"
+#include "base64.hpp"
+#include "container.hpp"
+#include "keyRing.hpp"
 #include <openssl/evp.h>
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
+#include <openssl/rand.h>
+#include <stdexcept>
 using namespace std;
 
 string Encrypt::encryptString(const map<char, char>& charMapping, const string& input) {
-    string encrypted;
-    for (char c : input) {
-        encrypted += charMapping.at(c);
-    }
-    return encrypted;
+    return encryptString(SubstitutionTable(charMapping), input);
 }
 
-string Encrypt::encryptAES(const string& plaintext, const string& key, const string& iv) {
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    unsigned char outbuf[1024];
-    int outlen;
+string Encrypt::encryptString(const SubstitutionTable& table, const string& input) {
+    return table.encrypt(input);
+}
 
+static string runEncrypt(CipherStream& stream, const string& plaintext) {
     string ciphertext;
+    ciphertext.reserve(plaintext.size() + EVP_MAX_BLOCK_LENGTH);
+    auto sink = [&ciphertext](const unsigned char* data, size_t length) {
+        ciphertext.append((const char*)data, length);
+    };
+
+    stream.update((const unsigned char*)plaintext.data(), plaintext.size(), sink);
+    stream.final(sink);
+    return ciphertext;
+}
 
-    EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, (unsigned char*)key.c_str(), (unsigned char*)iv.c_str());
-    EVP_EncryptUpdate(ctx, outbuf, &outlen, (unsigned char*)plaintext.c_str(), plaintext.size());
-    ciphertext.assign((char*)outbuf, outlen);
+string Encrypt::encryptAES(const string& plaintext, const string& key, const string& iv) {
+    CipherStream stream;
+    stream.init(CipherStream::Direction::ENCRYPT, key, iv);
+    return runEncrypt(stream, plaintext);
+}
 
-    EVP_EncryptFinal_ex(ctx, outbuf, &outlen);
-    ciphertext.append((char*)outbuf, outlen);
-    EVP_CIPHER_CTX_free(ctx);
+string Encrypt::encryptAES(CipherSession& session, const string& plaintext) {
+    return runEncrypt(session.encryptor(), plaintext);
+}
 
+string Encrypt::encryptAESParallel(const string& plaintext, const string& key, unsigned threads) {
+    // AES-256-CTR, so the payload can be split across threads; a fresh IV per
+    // message keeps two messages under one key from sharing a keystream
+    string ciphertext(ParallelCtr::IV_SIZE + plaintext.size(), '\0');
+    if (RAND_bytes((unsigned char*)&ciphertext[0], (int)ParallelCtr::IV_SIZE) != 1) {
+        throw runtime_error("Could not generate IV");
+    }
+    string iv = ciphertext.substr(0, ParallelCtr::IV_SIZE);
+    ParallelCtr::apply(key, iv, (const unsigned char*)plaintext.data(), (unsigned char*)&ciphertext[ParallelCtr::IV_SIZE],
+        plaintext.size(), threads);
     return ciphertext;
 }
 
 string Encrypt::base64Encode(const string& input) {
-    BIO* bio, * b64;
-    BUF_MEM* bufferPtr;
+    return Base64::encode(input);
+}
 
-    b64 = BIO_new(BIO_f_base64());
-    bio = BIO_new(BIO_s_mem());
-    BIO_push(b64, bio);
+static string runLayered(const SubstitutionTable& table, const string& input, CipherStream& stream, CipherMode mode,
+    Encoding encoding = Encoding::BASE64, Compression compression = Compression::NONE) {
+    // Compression, substitution, AES and encoding run block by block straight into the final output
+    string output;
+    if (compression == Compression::NONE) {
+        output.reserve(LayeredPipeline::encodedLength(mode, input.size(), encoding));
+    }
+    auto sink = [&output](const unsigned char* data, size_t length) {
+        output.append((const char*)data, length);
+    };
 
-    BIO_write(b64, input.data(), input.size());
-    BIO_flush(b64);
-    BIO_get_mem_ptr(b64, &bufferPtr);
+    LayeredPipeline pipeline(CipherStream::Direction::ENCRYPT, table, stream, encoding, compression);
+    pipeline.update((const unsigned char*)input.data(), input.size(), sink);
+    pipeline.final(sink);
+    return output;
+}
 
-    string output(bufferPtr->data, bufferPtr->length - 1);
-    BIO_free_all(b64);
+string Encrypt::encryptLayered(const map<char, char>& charMapping, const string& input, const string& aesKey, const string& iv,
+    CipherMode mode) {
+    CipherStream stream;
+    stream.init(CipherStream::Direction::ENCRYPT, aesKey, iv, mode);
+    return runLayered(SubstitutionTable(charMapping), input, stream, mode);
+}
 
-    return output;
+string Encrypt::encryptLayered(const KeyRing& ring, const string& input, const string& aesKey, const string& iv, CipherMode mode) {
+    const KeyRing::Generation& generation = ring.active();
+    CipherStream stream;
+    stream.init(CipherStream::Direction::ENCRYPT, generation.cipherKey(aesKey), iv, mode);
+    return KeyRing::prefix(generation.id) + runLayered(generation.table, input, stream, mode);
 }
 
-string Encrypt::encryptLayered(const map<char, char>& charMapping, const string& input, const string& aesKey, const string& iv) {
-    // Layer 1: Substitution cipher
-    string layer1 = encryptString(charMapping, input);
+string Encrypt::encryptLayered(const SubstitutionTable& table, const string& input, CipherSession& session) {
+    return runLayered(table, input, session.encryptor(), session.getMode());
+}
 
-    // Layer 2: AES encryption
-    string layer2 = encryptAES(layer1, aesKey, iv);
+string Encrypt::encryptLayered(const SubstitutionTable& table, const string& input, CipherSession& session, Encoding encoding,
+    Compression compression) {
+    return runLayered(table, input, session.encryptor(), session.getMode(), encoding, compression);
+}
 
-    // Base64 encode the final result
-    return base64Encode(layer2);
-}
\ No newline at end of file
+string Encrypt::encryptContainer(const SubstitutionTable& table, const string& input, const string& aesKey) {
+    string output;
+    ContainerWriter writer(table, aesKey, [&](const unsigned char* data, size_t length) {
+        output.append((const char*)data, length);
+    });
+    writer.write((const unsigned char*)input.data(), input.size());
+    writer.finish();
+    return output;
+}
@@ -0,0 +1,80 @@
+#include "fileCrypt.hpp"
+#include "layeredPipeline.hpp"
+#include "mappedFile.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+namespace {
+    // Large stdio buffer so the pipeline's small writes turn into few syscalls
+    const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+}
+
+void FileCrypt::process(CipherStream::Direction direction, const SubstitutionTable& table, CipherStream& stream,
+    const string& inputPath, const CipherStream::Sink& sink, Encoding encoding, Compression compression) {
+    MappedFile input(inputPath);
+    input.adviseSequential();
+
+    LayeredPipeline pipeline(direction, table, stream, encoding, compression);
+    for (size_t offset = 0; offset < input.size(); offset += CHUNK_SIZE) {
+        size_t chunk = min(CHUNK_SIZE, input.size() - offset);
+        pipeline.update(input.data() + offset, chunk, sink);
+        input.release(offset, chunk);
+    }
+
+    if (!pipeline.final(sink)) {
+        throw runtime_error("Decryption failed (wrong key or corrupted data): " + inputPath);
+    }
+}
+
+size_t FileCrypt::encryptFile(const SubstitutionTable& table, CipherStream& stream,
+    const string& inputPath, const string& outputPath, Encoding encoding, Compression compression) {
+    return processToFile(CipherStream::Direction::ENCRYPT, table, stream, inputPath, outputPath, encoding, compression);
+}
+
+size_t FileCrypt::decryptFile(const SubstitutionTable& table, CipherStream& stream,
+    const string& inputPath, const string& outputPath, Encoding encoding) {
+    return processToFile(CipherStream::Direction::DECRYPT, table, stream, inputPath, outputPath, encoding, Compression::NONE);
+}
+
+size_t FileCrypt::processToFile(CipherStream::Direction direction, const SubstitutionTable& table, CipherStream& stream,
+    const string& inputPath, const string& outputPath, Encoding encoding, Compression compression) {
+    error_code ec;
+    if (filesystem::equivalent(inputPath, outputPath, ec)) {
+        throw invalid_argument("Input and output are the same file: " + inputPath);
+    }
+
+    string partPath = outputPath + ".part";
+    unique_ptr<FILE, int (*)(FILE*)> out(fopen(partPath.c_str(), "wb"), fclose);
+    if (!out) {
+        throw runtime_error("Could not open output file: " + partPath);
+    }
+    vector<char> writeBuffer(WRITE_BUFFER_SIZE);
+    setvbuf(out.get(), writeBuffer.data(), _IOFBF, writeBuffer.size());
+
+    size_t written = 0;
+    FILE* outFile = out.get();
+    try {
+        process(direction, table, stream, inputPath, [&](const unsigned char* data, size_t length) {
+            if (fwrite(data, 1, length, outFile) != length) {
+                throw runtime_error("Write failed: " + partPath);
+            }
+            written += length;
+        }, encoding, compression);
+        if (fclose(out.release()) != 0) {
+            throw runtime_error("Write failed: " + partPath);
+        }
+    }
+    catch (...) {
+        out.reset();
+        filesystem::remove(partPath, ec);
+        throw;
+    }
+
+    filesystem::rename(partPath, outputPath);
+    return written;
+}
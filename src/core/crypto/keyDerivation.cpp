@@ -0,0 +1,235 @@
+#include "keyDerivation.hpp"
+#include "envmgr.hpp"
+#include <cstring>
+#include <future>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+using namespace std;
+
+namespace {
+    // A key, listed as soon as its derivation starts; ready is set once the key bytes are in
+    struct CacheEntry {
+        shared_ptr<KeyDerivation::Key> key;
+        shared_future<void> ready;
+    };
+
+    // Most recently used first, one entry per salt this process has seen.
+    // The lock only guards the list; derivations run without it.
+    mutex cacheLock;
+    list<CacheEntry> cache;
+}
+
+bool KeyDerivation::Params::operator==(const Params& other) const {
+    return algorithm == other.algorithm && cost == other.cost
+        && blockSize == other.blockSize && parallelism == other.parallelism;
+}
+
+KeyDerivation::Key::Key(const Params& params, const uint8_t* salt)
+    : derivedWith(params),
+    secret(KEY_SIZE + SHA256_DIGEST_LENGTH) {
+    memcpy(saltBytes.data(), salt, SALT_SIZE);
+}
+
+const KeyDerivation::Params& KeyDerivation::Key::params() const {
+    return derivedWith;
+}
+
+const uint8_t* KeyDerivation::Key::salt() const {
+    return saltBytes.data();
+}
+
+const uint8_t* KeyDerivation::Key::data() const {
+    return secret.data();
+}
+
+bool KeyDerivation::Key::isLocked() const {
+    return secret.isLocked();
+}
+
+bool KeyDerivation::parse(const string& name, Algorithm& algorithm) {
+    if (name == "scrypt") {
+        algorithm = Algorithm::SCRYPT;
+        return true;
+    }
+    if (name == "pbkdf2") {
+        algorithm = Algorithm::PBKDF2_SHA256;
+        return true;
+    }
+    return false;
+}
+
+const char* KeyDerivation::name(Algorithm algorithm) {
+    return algorithm == Algorithm::PBKDF2_SHA256 ? "pbkdf2" : "scrypt";
+}
+
+KeyDerivation::Params KeyDerivation::defaults(Algorithm algorithm) {
+    Params params;
+    params.algorithm = algorithm;
+    if (algorithm == Algorithm::PBKDF2_SHA256) {
+        params.cost = DEFAULT_PBKDF2_ITERATIONS;
+    }
+    return params;
+}
+
+KeyDerivation::Params KeyDerivation::configured() {
+    string kdfName = EnvManager::get("XCREEPTOR_KDF", "scrypt");
+    Algorithm algorithm;
+    if (!parse(kdfName, algorithm)) {
+        throw invalid_argument("Unknown XCREEPTOR_KDF: " + kdfName + " (use scrypt or pbkdf2)");
+    }
+    Params params = defaults(algorithm);
+
+    string cost = EnvManager::get("XCREEPTOR_KDF_COST");
+    if (!cost.empty()) {
+        if (cost.size() > 9 || cost.find_first_not_of("0123456789") != string::npos) {
+            throw invalid_argument("Invalid XCREEPTOR_KDF_COST: " + cost);
+        }
+        params.cost = (uint32_t)stoul(cost);
+    }
+    validate(params);
+    return params;
+}
+
+uint64_t KeyDerivation::scryptMemory(const Params& params) {
+    // OpenSSL's scrypt needs 128 * r * (N + 2) bytes of V plus 128 * r * p of B
+    uint64_t n = 1ull << params.cost;
+    return 128ull * params.blockSize * (n + 2 + params.parallelism);
+}
+
+void KeyDerivation::validate(const Params& params) {
+    switch (params.algorithm) {
+    case Algorithm::PBKDF2_SHA256:
+        if (params.cost < MIN_PBKDF2_ITERATIONS || params.cost > MAX_PBKDF2_ITERATIONS) {
+            throw invalid_argument("PBKDF2 iterations must be between " + to_string(MIN_PBKDF2_ITERATIONS)
+                + " and " + to_string(MAX_PBKDF2_ITERATIONS));
+        }
+        return;
+    case Algorithm::SCRYPT:
+        if (params.cost < MIN_SCRYPT_LOG_N || params.cost > MAX_SCRYPT_LOG_N) {
+            throw invalid_argument("scrypt cost must be between " + to_string(MIN_SCRYPT_LOG_N)
+                + " and " + to_string(MAX_SCRYPT_LOG_N) + " (log2 N)");
+        }
+        if (params.blockSize == 0 || params.parallelism == 0 || scryptMemory(params) > MAX_SCRYPT_MEMORY) {
+            throw invalid_argument("scrypt parameters need more memory than allowed");
+        }
+        return;
+    }
+    throw invalid_argument("Unknown key derivation algorithm " + to_string((int)params.algorithm));
+}
+
+void KeyDerivation::passwordDigest(const string& password, const uint8_t* salt, uint8_t* digest) {
+    unique_ptr<EVP_MD_CTX, void (*)(EVP_MD_CTX*)> context(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    if (!context || EVP_DigestInit_ex(context.get(), EVP_sha256(), nullptr) != 1
+        || EVP_DigestUpdate(context.get(), salt, SALT_SIZE) != 1
+        || EVP_DigestUpdate(context.get(), password.data(), password.size()) != 1
+        || EVP_DigestFinal_ex(context.get(), digest, nullptr) != 1) {
+        throw runtime_error("Could not hash the key password");
+    }
+}
+
+bool KeyDerivation::matches(const Key& key, const string& password) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    passwordDigest(password, key.salt(), digest);
+    bool same = CRYPTO_memcmp(digest, key.data() + KEY_SIZE, sizeof(digest)) == 0;
+    OPENSSL_cleanse(digest, sizeof(digest));
+    return same;
+}
+
+void KeyDerivation::compute(Key& key, const string& password) {
+    const Params& params = key.params();
+    uint8_t* out = key.secret.data();
+
+    int ok;
+    if (params.algorithm == Algorithm::PBKDF2_SHA256) {
+        ok = PKCS5_PBKDF2_HMAC(password.data(), (int)password.size(), key.salt(), (int)SALT_SIZE, (int)params.cost,
+            EVP_sha256(), (int)KEY_SIZE, out);
+    }
+    else {
+        ok = EVP_PBE_scrypt(password.data(), password.size(), key.salt(), SALT_SIZE, 1ull << params.cost,
+            params.blockSize, params.parallelism, scryptMemory(params), out, KEY_SIZE);
+    }
+    if (ok != 1) {
+        throw runtime_error(string("Key derivation failed (") + name(params.algorithm) + ")");
+    }
+}
+
+shared_ptr<const KeyDerivation::Key> KeyDerivation::lookup(const string& password, const Params& params, const uint8_t* salt) {
+    shared_future<void> ready;
+    shared_ptr<Key> key;
+    promise<void> derived;
+    {
+        lock_guard<mutex> lock(cacheLock);
+        for (auto it = cache.begin(); it != cache.end(); ++it) {
+            const Key& cached = *it->key;
+            bool same = cached.params() == params
+                && (salt == nullptr || memcmp(cached.salt(), salt, SALT_SIZE) == 0);
+            if (same && matches(cached, password)) {
+                cache.splice(cache.begin(), cache, it);
+                key = it->key;
+                ready = it->ready;
+                break;
+            }
+        }
+
+        if (!key) {
+            // Listed before deriving, so threads asking for the same key wait
+            // for this derivation instead of running their own
+            uint8_t freshSalt[SALT_SIZE];
+            if (salt == nullptr) {
+                if (RAND_bytes(freshSalt, (int)sizeof(freshSalt)) != 1) {
+                    throw runtime_error("Could not generate a salt");
+                }
+                salt = freshSalt;
+            }
+            shared_ptr<Key> placeholder = make_shared<Key>(params, salt);
+            passwordDigest(password, salt, placeholder->secret.data() + KEY_SIZE);
+            cache.push_front(CacheEntry { placeholder, derived.get_future().share() });
+            if (cache.size() > MAX_CACHED_KEYS) {
+                cache.pop_back();
+            }
+            // ready stays empty: this thread derives, the others wait on it
+            key = placeholder;
+        }
+    }
+
+    if (ready.valid()) {
+        // Rethrows if the derivation this thread waited for failed
+        ready.get();
+        return key;
+    }
+
+    try {
+        compute(*key, password);
+    }
+    catch (...) {
+        {
+            lock_guard<mutex> lock(cacheLock);
+            cache.remove_if([&](const CacheEntry& entry) { return entry.key == key; });
+        }
+        derived.set_exception(current_exception());
+        throw;
+    }
+    derived.set_value();
+    return key;
+}
+
+shared_ptr<const KeyDerivation::Key> KeyDerivation::derive(const string& password, const Params& params, const uint8_t* salt) {
+    validate(params);
+    return lookup(password, params, salt);
+}
+
+shared_ptr<const KeyDerivation::Key> KeyDerivation::forWriting(const string& password, const Params& params) {
+    validate(params);
+    return lookup(password, params, nullptr);
+}
+
+void KeyDerivation::clearCache() {
+    lock_guard<mutex> lock(cacheLock);
+    cache.clear();
+}
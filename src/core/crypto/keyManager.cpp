@@ -1,6 +1,11 @@
 #include "keyManager.hpp"
 #include "encrypt.hpp"
 #include "decrypt.hpp"
+#include "cipherSession.hpp"
+#include "keyDerivation.hpp"
+#include "atomicFile.hpp"
+#include "fileLock.hpp"
+#include "lockedBuffer.hpp"
 #include <fstream>
 #include <filesystem>
 #include <vector>
@@ -8,55 +13,126 @@
 #include <random>
 #include <iostream>
 #include <sstream>
+#include <memory>
+#include <cstring>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
 
 using namespace std;
 
-const string KeyManager::keyboardChars = "`1234567890-=~!@#$%^&*()_+[]{}|;:,./<>?abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+namespace {
+    // 0x89 is outside the base64 alphabet, so no legacy key file starts like this
+    const char KEY_FILE_MAGIC[4] = { (char)0x89, 'X', 'C', 'K' };
+    // Format 2 had only magic, version and a reserved field before the ciphertext
+    const size_t V2_HEADER_SIZE = 8;
+    const size_t IV_SIZE = 16;
+    const size_t KDF_OFFSET = 8;
+    const size_t SALT_OFFSET = 16;
+    const size_t IV_OFFSET = SALT_OFFSET + KeyDerivation::SALT_SIZE;
+    // In the algorithm byte: no derivation, the file is under the caller's wrapping key
+    const uint8_t KDF_WRAPPED = 0;
 
-string KeyManager::encryptKeyData(const string& data, const string& password) {
-    // Derive a 32-byte key and 16-byte IV from password
-    string key = password;
-    key.resize(32, 'x');  // Pad to 32 bytes
-    string iv = password.substr(0, 16);
-    iv.resize(16, 'x');   // Pad to 16 bytes
+    // AES-256-CBC under a KEY_SIZE file key; the key only leaves locked memory for the call
+    string applyFileKey(CipherStream::Direction direction, const uint8_t* fileKey, const char* iv,
+        const string& data) {
+        string key((const char*)fileKey, KeyDerivation::KEY_SIZE);
+        string ivText(iv, IV_SIZE);
+        string result = direction == CipherStream::Direction::ENCRYPT
+            ? Encrypt::encryptAES(data, key, ivText)
+            : Decrypt::decryptAES(data, key, ivText);
+        OPENSSL_cleanse(&key[0], key.size());
+        return result;
+    }
 
-    // Encrypt the data
-    return Encrypt::encryptAES(data, key, iv);
+    // Key data without its trailing SHA-256, checked first
+    string stripChecksum(string plain) {
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        size_t dataSize = plain.size() - min(plain.size(), sizeof(digest));
+        SHA256((const unsigned char*)plain.data(), dataSize, digest);
+        if (plain.size() < sizeof(digest) || CRYPTO_memcmp(digest, plain.data() + dataSize, sizeof(digest)) != 0) {
+            throw runtime_error("Key file checksum mismatch (wrong password or corrupted file)");
+        }
+        plain.resize(dataSize);
+        return plain;
+    }
 }
 
-string KeyManager::decryptKeyData(const string& data, const string& password) {
-    // Derive same key and IV
-    string key = password;
-    key.resize(32, 'x');
-    string iv = password.substr(0, 16);
-    iv.resize(16, 'x');
+const string KeyManager::keyboardChars = "`1234567890-=~!@#$%^&*()_+[]{}|;:,./<>?abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+CipherSession& KeyManager::legacySession(const string& password) {
+    // One cached session per thread, rebuilt only when the password changes
+    thread_local unique_ptr<CipherSession> session;
+    thread_local string sessionPassword;
+
+    if (!session || sessionPassword != password) {
+        // Derive a 32-byte key and 16-byte IV from password
+        string key = password;
+        key.resize(32, 'x');  // Pad to 32 bytes
+        string iv = password.substr(0, 16);
+        iv.resize(16, 'x');   // Pad to 16 bytes
+
+        session.reset(new CipherSession(key, iv));
+        sessionPassword = password;
+    }
+    return *session;
+}
 
-    // Decrypt the data
+string KeyManager::decryptLegacyKeyData(const string& data, const string& password) {
     string decoded = Decrypt::base64Decode(data);
-    return Decrypt::decryptAES(decoded, key, iv);
+    return Decrypt::decryptAES(legacySession(password), decoded);
 }
 
-void KeyManager::saveKeyToFile(const map<char, char>& key, const string& filename, const string& password) {
+void KeyManager::writeKeyData(const string& data, const string& filename, const string& password,
+    const LockedBuffer* wrappingKey) {
     try {
         // Create full directory path if needed
         filesystem::path filePath(filename);
-        filesystem::create_directories(filePath.parent_path());
-
-        string data;
-        for (const auto& pair : key) {
-            data.push_back(pair.first);
-            data.push_back(pair.second);
+        if (filePath.has_parent_path()) {
+            filesystem::create_directories(filePath.parent_path());
         }
 
-        // Open with explicit binary mode
-        ofstream file(filePath, ios::binary | ios::out);
-        if (!file) {
-            throw runtime_error("Could not open file: " + filePath.string());
+        char header[KEY_FILE_HEADER_SIZE] = {};
+        memcpy(header, KEY_FILE_MAGIC, sizeof(KEY_FILE_MAGIC));
+        header[4] = (char)(KEY_FILE_VERSION & 0xFF);
+        header[5] = (char)(KEY_FILE_VERSION >> 8);
+
+        // A wrapped file leaves the derivation block and salt zero
+        shared_ptr<const KeyDerivation::Key> derived;
+        const uint8_t* fileKey;
+        if (wrappingKey) {
+            header[KDF_OFFSET] = (char)KDF_WRAPPED;
+            fileKey = wrappingKey->data();
+        }
+        else {
+            // Derived once per process; later saves reuse the cached key and salt
+            KeyDerivation::Params params = KeyDerivation::configured();
+            derived = KeyDerivation::forWriting(password, params);
+            header[KDF_OFFSET] = (char)params.algorithm;
+            header[KDF_OFFSET + 1] = (char)params.blockSize;
+            header[KDF_OFFSET + 2] = (char)params.parallelism;
+            for (int i = 0; i < 4; ++i) {
+                header[KDF_OFFSET + 4 + i] = (char)(params.cost >> (8 * i));
+            }
+            memcpy(header + SALT_OFFSET, derived->salt(), KeyDerivation::SALT_SIZE);
+            fileKey = derived->data();
+        }
+        if (RAND_bytes((unsigned char*)header + IV_OFFSET, (int)IV_SIZE) != 1) {
+            throw runtime_error("Could not generate an IV");
         }
 
-        string encrypted = encryptKeyData(data, password);
-        file.write(encrypted.data(), encrypted.size());
-        file.close();
+        // The checksum rides inside the encryption, so it also catches a wrong password
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        SHA256((const unsigned char*)data.data(), data.size(), digest);
+        string plain = data;
+        plain.append((const char*)digest, sizeof(digest));
+        string encrypted = applyFileKey(CipherStream::Direction::ENCRYPT, fileKey, header + IV_OFFSET, plain);
+        OPENSSL_cleanse(&plain[0], plain.size());
+
+        // A concurrent reader (e.g. another TenantKeyStore) sees the old key or the new one, never half of each
+        string contents(header, sizeof(header));
+        contents += encrypted;
+        AtomicFile::write(filename, contents.data(), contents.size());
     }
     catch (const exception& e) {
         cerr << "Error saving key: " << e.what() << endl;
@@ -64,44 +140,181 @@ void KeyManager::saveKeyToFile(const map<char, char>& key, const string& filenam
     }
 }
 
-// In KeyManager::loadKeyFromFile
-map<char, char> KeyManager::loadKeyFromFile(const string& filename, const string& password) {
-    map<char, char> key;
-    try {
-        // Open with explicit binary mode
-        ifstream file(filename, ios::binary | ios::in);
-        if (!file) {
-            throw runtime_error("Could not open file: " + string(filename));
-        }
+string KeyManager::readKeyData(const string& filename, const string& password, const LockedBuffer* wrappingKey) {
+    // Open with explicit binary mode
+    ifstream file(filename, ios::binary | ios::in);
+    if (!file) {
+        throw runtime_error("Could not open file: " + string(filename));
+    }
 
-        // Read binary data properly
-        vector<char> buffer(filesystem::file_size(filename));
-        file.read(buffer.data(), buffer.size());
-        file.close();
+    // One read straight into the string that gets decrypted; sized from the
+    // open stream, since the path may already name a newer file
+    file.seekg(0, ios::end);
+    streamoff size = file.tellg();
+    file.seekg(0, ios::beg);
+    if (size < 0) {
+        throw runtime_error("Could not read file: " + string(filename));
+    }
+    string contents((size_t)size, '\0');
+    file.read(&contents[0], contents.size());
+    if ((size_t)file.gcount() != contents.size()) {
+        throw runtime_error("Could not read file: " + string(filename));
+    }
+    file.close();
 
-        string encrypted(buffer.begin(), buffer.end());
-        string decrypted = decryptKeyData(encrypted, password);
+    if (contents.size() < V2_HEADER_SIZE || memcmp(contents.data(), KEY_FILE_MAGIC, sizeof(KEY_FILE_MAGIC)) != 0) {
+        return decryptLegacyKeyData(contents, password);
+    }
+    unsigned version = (unsigned char)contents[4] | ((unsigned char)contents[5] << 8);
+    if (version == 2) {
+        contents.erase(0, V2_HEADER_SIZE);
+        return stripChecksum(Decrypt::decryptAES(legacySession(password), contents));
+    }
+    if (version != KEY_FILE_VERSION) {
+        throw runtime_error("Unsupported key file version " + to_string(version));
+    }
+    if (contents.size() < KEY_FILE_HEADER_SIZE) {
+        throw runtime_error("Truncated key file: " + string(filename));
+    }
 
-        // Parse decrypted data
-        if (decrypted.length() % 2 != 0) {
-            throw runtime_error("Corrupted key data");
+    const unsigned char* kdf = (const unsigned char*)contents.data() + KDF_OFFSET;
+    shared_ptr<const KeyDerivation::Key> derived;
+    const uint8_t* fileKey;
+    if (kdf[0] == KDF_WRAPPED) {
+        if (!wrappingKey) {
+            throw runtime_error("Key file is under a wrapping key, not a password: " + string(filename));
         }
+        fileKey = wrappingKey->data();
+    }
+    else {
+        KeyDerivation::Params params;
+        params.algorithm = (KeyDerivation::Algorithm)kdf[0];
+        params.blockSize = kdf[1];
+        params.parallelism = kdf[2];
+        params.cost = (uint32_t)kdf[4] | ((uint32_t)kdf[5] << 8) | ((uint32_t)kdf[6] << 16) | ((uint32_t)kdf[7] << 24);
+        derived = KeyDerivation::derive(password, params, (const uint8_t*)contents.data() + SALT_OFFSET);
+        fileKey = derived->data();
+    }
+
+    string iv = contents.substr(IV_OFFSET, IV_SIZE);
+    contents.erase(0, KEY_FILE_HEADER_SIZE);
+    return stripChecksum(applyFileKey(CipherStream::Direction::DECRYPT, fileKey, iv.data(), contents));
+}
+
+map<char, char> KeyManager::parseLegacyKey(const string& decrypted) {
+    // Parse decrypted data
+    if (decrypted.length() % 2 != 0) {
+        throw runtime_error("Corrupted key data");
+    }
+
+    map<char, char> key;
+    for (size_t i = 0; i < decrypted.length(); i += 2) {
+        key[decrypted[i]] = decrypted[i + 1];
+    }
 
-        for (size_t i = 0; i < decrypted.length(); i += 2) {
-            key[decrypted[i]] = decrypted[i + 1];
+    // Validate mapping
+    if (key.size() != keyboardChars.length()) {
+        throw runtime_error("Invalid key mapping size");
+    }
+    return key;
+}
+
+void KeyManager::saveKeyToFile(const map<char, char>& key, const string& filename, const string& password) {
+    saveKeyRing(KeyRing(SubstitutionTable(key)), filename, password);
+}
+
+SubstitutionTable KeyManager::readKeyFile(const string& filename, const string& password) {
+    return readKeyRing(filename, password).active().table;
+}
+
+void KeyManager::saveKeyRing(const KeyRing& ring, const string& filename, const string& password,
+    const LockedBuffer* wrappingKey) {
+    writeKeyData(ring.serialize(), filename, password, wrappingKey);
+}
+
+KeyRing KeyManager::readKeyRing(const string& filename, const string& password, const LockedBuffer* wrappingKey) {
+    string decrypted = readKeyData(filename, password, wrappingKey);
+    if (!KeyRing::matches(decrypted)) {
+        return KeyRing(SubstitutionTable(parseLegacyKey(decrypted)));
+    }
+
+    KeyRing ring = KeyRing::parse(decrypted);
+    for (const KeyRing::Generation& generation : ring.generations()) {
+        if (generation.table.size() != keyboardChars.length()) {
+            throw runtime_error("Invalid key mapping size in generation " + to_string(generation.id));
         }
+    }
+    return ring;
+}
 
-        // Validate mapping
-        if (key.size() != keyboardChars.length()) {
-            throw runtime_error("Invalid key mapping size");
+string KeyManager::lockFile(const string& filename) {
+    // The lock file sits next to the key file, which may not have a directory yet
+    filesystem::path filePath(filename);
+    if (filePath.has_parent_path()) {
+        filesystem::create_directories(filePath.parent_path());
+    }
+    return filename + ".lock";
+}
+
+string KeyManager::generateAesKey() {
+    string aesKey(GENERATED_AES_KEY_SIZE, '\0');
+    if (RAND_bytes((unsigned char*)&aesKey[0], (int)aesKey.size()) != 1) {
+        throw runtime_error("Could not generate an AES key");
+    }
+    return aesKey;
+}
+
+const KeyRing::Generation& KeyManager::rotateKey(KeyRing& ring, const string& filename, const string& password,
+    const LockedBuffer* wrappingKey) {
+    FileLock lock(lockFile(filename));
+
+    // Rotate what is on disk, not the caller's copy, so generations another writer added are kept
+    KeyRing rotated = filesystem::exists(filename) ? readKeyRing(filename, password, wrappingKey) : ring;
+    rotated.rotate(SubstitutionTable(generateKey()), generateAesKey());
+    // Saved before the caller can use it, so nothing is ever encrypted under an unsaved key
+    saveKeyRing(rotated, filename, password, wrappingKey);
+    ring = rotated;
+    return ring.active();
+}
+
+KeyRing KeyManager::createKeyRing(const string& filename, const string& password, const LockedBuffer* wrappingKey) {
+    FileLock lock(lockFile(filename));
+    if (filesystem::exists(filename)) {
+        throw runtime_error("Key file already exists: " + filename);
+    }
+
+    // Rotating an empty ring gives generation 0 with its own AES key
+    KeyRing ring;
+    ring.rotate(SubstitutionTable(generateKey()), generateAesKey());
+    saveKeyRing(ring, filename, password, wrappingKey);
+    return ring;
+}
+
+void KeyManager::openWrappingKey(const string& filename, const string& password, LockedBuffer& key) {
+    if (key.size() != KeyDerivation::KEY_SIZE) {
+        throw invalid_argument("A wrapping key has " + to_string(KeyDerivation::KEY_SIZE) + " bytes");
+    }
+    FileLock lock(lockFile(filename));
+
+    if (!filesystem::exists(filename)) {
+        if (RAND_bytes(key.data(), (int)key.size()) != 1) {
+            throw runtime_error("Could not generate a wrapping key");
         }
+        string data((const char*)key.data(), key.size());
+        writeKeyData(data, filename, password, nullptr);
+        OPENSSL_cleanse(&data[0], data.size());
+        return;
     }
-    catch (const exception& e) {
-        cerr << "Error loading key: " << e.what() << endl;
-        key = generateKey();
-        saveKeyToFile(key, filename, password);
+
+    string data = readKeyData(filename, password, nullptr);
+    bool valid = data.size() == key.size();
+    if (valid) {
+        memcpy(key.data(), data.data(), data.size());
+    }
+    OPENSSL_cleanse(&data[0], data.size());
+    if (!valid) {
+        throw runtime_error("Not a wrapping key file: " + filename);
     }
-    return key;
 }
 
 map<char, char> KeyManager::generateKey() {
@@ -0,0 +1,215 @@
+#include "keyRing.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+    const char RING_MAGIC[4] = { 'X', 'C', 'K', 'R' };
+    const char HEX_DIGITS[] = "0123456789abcdef";
+
+    void putLE(string& out, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out.push_back((char)(value >> (8 * i)));
+        }
+    }
+
+    // Reads from a serialized ring, throwing instead of running past its end
+    struct Reader {
+        const string& data;
+        size_t pos = 0;
+
+        explicit Reader(const string& data) : data(data) {
+        }
+
+        const char* take(size_t count) {
+            if (data.size() - pos < count) {
+                throw runtime_error("Truncated key ring");
+            }
+            const char* p = data.data() + pos;
+            pos += count;
+            return p;
+        }
+
+        uint64_t getLE(int bytes) {
+            const unsigned char* p = (const unsigned char*)take(bytes);
+            uint64_t value = 0;
+            for (int i = bytes - 1; i >= 0; --i) {
+                value = (value << 8) | p[i];
+            }
+            return value;
+        }
+    };
+
+    int hexValue(unsigned char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+}
+
+const string& KeyRing::Generation::cipherKey(const string& configuredKey) const {
+    return aesKey.empty() ? configuredKey : aesKey;
+}
+
+KeyRing::KeyRing() : activeId(0) {
+}
+
+KeyRing::KeyRing(const SubstitutionTable& legacyTable) : activeId(0) {
+    Generation legacy;
+    legacy.table = legacyTable;
+    add(legacy);
+}
+
+const KeyRing::Generation& KeyRing::active() const {
+    if (entries.empty()) {
+        throw logic_error("Key ring is empty");
+    }
+    return entries[byId.at(activeId)];
+}
+
+const KeyRing::Generation* KeyRing::find(uint32_t id) const {
+    auto it = byId.find(id);
+    return it == byId.end() ? nullptr : &entries[it->second];
+}
+
+const KeyRing::Generation& KeyRing::get(uint32_t id) const {
+    const Generation* generation = find(id);
+    if (!generation) {
+        throw runtime_error("Unknown key id " + to_string(id) + " (not in this key ring)");
+    }
+    return *generation;
+}
+
+const KeyRing::Generation& KeyRing::rotate(const SubstitutionTable& table, const string& aesKey) {
+    uint32_t next = 0;
+    for (const Generation& generation : entries) {
+        next = max(next, generation.id + 1);
+    }
+
+    Generation generation;
+    generation.id = next;
+    generation.created = (int64_t)time(nullptr);
+    generation.table = table;
+    generation.aesKey = aesKey;
+    add(generation);
+    activeId = next;
+    return entries.back();
+}
+
+const vector<KeyRing::Generation>& KeyRing::generations() const {
+    return entries;
+}
+
+bool KeyRing::empty() const {
+    return entries.empty();
+}
+
+void KeyRing::add(const Generation& generation) {
+    if (byId.count(generation.id)) {
+        throw runtime_error("Duplicate key id " + to_string(generation.id));
+    }
+    byId[generation.id] = entries.size();
+    entries.push_back(generation);
+}
+
+string KeyRing::serialize() const {
+    string out(RING_MAGIC, sizeof(RING_MAGIC));
+    putLE(out, VERSION, 2);
+    putLE(out, entries.size(), 2);
+    putLE(out, activeId, 4);
+    for (const Generation& generation : entries) {
+        if (generation.aesKey.size() > 255) {
+            throw invalid_argument("Key generation " + to_string(generation.id) + " is too large to store");
+        }
+        putLE(out, generation.id, 4);
+        putLE(out, (uint64_t)generation.created, 8);
+        putLE(out, generation.aesKey.size(), 1);
+        out += generation.aesKey;
+        size_t offset = out.size();
+        out.resize(offset + SubstitutionTable::SERIALIZED_SIZE);
+        generation.table.serialize((uint8_t*)&out[offset]);
+    }
+    return out;
+}
+
+KeyRing KeyRing::parse(const string& data) {
+    if (!matches(data)) {
+        throw runtime_error("Not a key ring");
+    }
+    Reader reader(data);
+    reader.take(sizeof(RING_MAGIC));
+    uint16_t version = (uint16_t)reader.getLE(2);
+    if (version != 1 && version != VERSION) {
+        throw runtime_error("Unsupported key ring version");
+    }
+    size_t count = (size_t)reader.getLE(2);
+
+    KeyRing ring;
+    ring.activeId = (uint32_t)reader.getLE(4);
+    for (size_t i = 0; i < count; ++i) {
+        Generation generation;
+        generation.id = (uint32_t)reader.getLE(4);
+        generation.created = (int64_t)reader.getLE(8);
+        size_t keyLength = (size_t)reader.getLE(1);
+        generation.aesKey.assign(reader.take(keyLength), keyLength);
+        try {
+            if (version == VERSION) {
+                generation.table = SubstitutionTable::parse((const uint8_t*)reader.take(SubstitutionTable::SERIALIZED_SIZE));
+            }
+            else {
+                size_t pairs = (size_t)reader.getLE(1);
+                const char* pairData = reader.take(pairs * 2);
+                map<char, char> mapping;
+                for (size_t p = 0; p < pairs; ++p) {
+                    mapping[pairData[2 * p]] = pairData[2 * p + 1];
+                }
+                generation.table = SubstitutionTable(mapping);
+            }
+        }
+        catch (const invalid_argument&) {
+            throw runtime_error("Corrupted key ring");
+        }
+        ring.add(generation);
+    }
+    if (reader.pos != data.size() || !ring.find(ring.activeId)) {
+        throw runtime_error("Corrupted key ring");
+    }
+    return ring;
+}
+
+bool KeyRing::matches(const string& data) {
+    // A legacy key starts with the pair of its lowest character, '!', never with 'X'
+    return data.size() >= sizeof(RING_MAGIC) && memcmp(data.data(), RING_MAGIC, sizeof(RING_MAGIC)) == 0;
+}
+
+string KeyRing::prefix(uint32_t id) {
+    if (id == 0) {
+        return string();
+    }
+    string out = "@k";
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        out.push_back(HEX_DIGITS[(id >> shift) & 0xF]);
+    }
+    out.push_back('.');
+    return out;
+}
+
+bool KeyRing::readPrefix(const unsigned char* text, size_t length, uint32_t& id) {
+    // '@' and '.' are in no text encoding's alphabet, so encoded output never starts like this
+    if (length < PREFIX_SIZE || text[0] != '@' || text[1] != 'k' || text[PREFIX_SIZE - 1] != '.') {
+        return false;
+    }
+    uint32_t value = 0;
+    for (size_t i = 2; i < PREFIX_SIZE - 1; ++i) {
+        int digit = hexValue(text[i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | (uint32_t)digit;
+    }
+    id = value;
+    return true;
+}
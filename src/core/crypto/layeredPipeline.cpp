@@ -0,0 +1,449 @@
+#include "layeredPipeline.hpp"
+#include "cipherBackend.hpp"
+#include "substitutionTable.hpp"
+#include "zlibStream.hpp"
+#include <openssl/rand.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+// Starts with a byte outside the keyboard alphabet, so nothing a strict
+// table produces can collide with it
+const unsigned char LayeredPipeline::MARKER[MARKER_SIZE] = { 0x89, 'X', 'C', 'Z', '\r', '\n', 0x1A, 0x01 };
+
+LayeredPipeline::LayeredPipeline(CipherStream::Direction direction, const SubstitutionTable& table, CipherStream& stream,
+    Encoding encoding, Compression compression)
+    : direction(direction),
+    table(table),
+    stream(stream),
+    encoding(encoding),
+    compression(compression),
+    authenticated(CipherStream::isAuthenticated(stream.getMode())),
+    framing(isFramed(stream.getMode())),
+    framed(false),
+    stage(Stage::PROBE),
+    substitution(&table) {
+}
+
+LayeredPipeline::~LayeredPipeline() = default;
+
+size_t LayeredPipeline::encodedLength(CipherMode mode, size_t plaintextLength, Encoding encoding) {
+    return TextEncoding::encodedLength(encoding, CipherStream::ciphertextLength(mode, plaintextLength) + framingLength(mode));
+}
+
+bool LayeredPipeline::isFramed(CipherMode mode) {
+    return mode != CipherMode::AES_256_CBC;
+}
+
+size_t LayeredPipeline::framingLength(CipherMode mode) {
+    if (!isFramed(mode)) {
+        return 0;
+    }
+    size_t tag = CipherStream::isAuthenticated(mode) ? CipherStream::TAG_SIZE : 0;
+    return frameHeadLength(mode) + tag;
+}
+
+size_t LayeredPipeline::frameHeadLength(CipherMode mode) {
+    if (!isFramed(mode)) {
+        return 0;
+    }
+    // 1 + 16 for CTR, padded to 18 so DirectoryCrypt can split its ciphertext on base64 groups
+    size_t padding = CipherStream::isAuthenticated(mode) ? 0 : 1;
+    return 1 + CipherStream::ivLength(mode) + padding;
+}
+
+string LayeredPipeline::newFrameHead(CipherMode mode) {
+    size_t nonceSize = CipherStream::ivLength(mode);
+    string frame(frameHeadLength(mode), '\0');
+    frame[0] = (char)CipherBackend::id(mode);
+    if (RAND_bytes((unsigned char*)&frame[1], (int)nonceSize) != 1) {
+        throw runtime_error("Could not generate nonce");
+    }
+    return frame;
+}
+
+string LayeredPipeline::frameNonce(CipherMode mode, const unsigned char* head) {
+    CipherMode found;
+    if (!CipherBackend::fromId(head[0], found) || !isFramed(found)) {
+        throw invalid_argument(CipherStream::isAuthenticated(mode) ? "Not an authenticated message (wrong mode?)" :
+            "Not a framed CTR message (wrong mode?)");
+    }
+    if (found != mode) {
+        throw runtime_error(string("Message was encrypted with ") + CipherBackend::name(found) +
+            ", not " + CipherBackend::name(mode));
+    }
+    size_t nonceSize = CipherStream::ivLength(mode);
+    for (size_t i = 1 + nonceSize; i < frameHeadLength(mode); ++i) {
+        if (head[i] != 0) {
+            throw invalid_argument("Not a framed CTR message (wrong mode?)");
+        }
+    }
+    return string((const char*)head + 1, nonceSize);
+}
+
+bool LayeredPipeline::framedMode(const unsigned char* text, size_t length, Encoding encoding, CipherMode& mode) {
+    // One unit of text decodes to at least the id byte
+    size_t unit = TextEncoding::unitSize(encoding);
+    if (length < unit) {
+        return false;
+    }
+    uint8_t decoded[4];
+    try {
+        if (TextEncoding::decode(encoding, (const char*)text, unit, decoded) == 0) {
+            return false;
+        }
+    }
+    catch (const invalid_argument&) {
+        return false;
+    }
+    CipherMode found;
+    if (!CipherBackend::fromId(decoded[0], found) || !CipherStream::isAuthenticated(found)) {
+        return false;
+    }
+    mode = found;
+    return true;
+}
+
+bool LayeredPipeline::collidesWithMarker(const SubstitutionTable& table, const unsigned char* data, size_t length) {
+    if (length < MARKER_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < MARKER_SIZE; ++i) {
+        // Unmapped bytes make the substitution layer fail anyway
+        if (!table.isMapped(data[i])) {
+            return false;
+        }
+    }
+    unsigned char probe[MARKER_SIZE];
+    table.encrypt(data, probe, MARKER_SIZE);
+    return memcmp(probe, MARKER, MARKER_SIZE) == 0;
+}
+
+void LayeredPipeline::update(const unsigned char* data, size_t length, const Sink& sink) {
+    if (direction == CipherStream::Direction::ENCRYPT) {
+        if (!framed) {
+            startFrame(sink);
+        }
+        if (stage == Stage::PROBE) {
+            size_t take = min(MARKER_SIZE - head.size(), length);
+            head.append((const char*)data, take);
+            data += take;
+            length -= take;
+            if (head.size() < MARKER_SIZE) {
+                return;
+            }
+            decide(sink);
+        }
+        encryptData(data, length, sink);
+        return;
+    }
+
+    size_t offset = 0;
+    while (offset < length) {
+        size_t slice = min(BLOCK_SIZE, length - offset);
+        decryptBlock(data + offset, slice, sink);
+        offset += slice;
+    }
+}
+
+bool LayeredPipeline::final(const Sink& sink) {
+    if (direction == CipherStream::Direction::ENCRYPT) {
+        if (!framed) {
+            startFrame(sink);
+        }
+        if (stage == Stage::PROBE) {
+            decide(sink);
+        }
+        if (stage == Stage::COMPRESSED) {
+            zlib->final([&](const unsigned char* packed, size_t packedLength) {
+                encryptBlock(packed, packedLength, sink);
+            });
+        }
+        bool ok = stream.final([&](const unsigned char* data, size_t length) {
+            encodeCiphertext(data, length, sink);
+        });
+        if (ok && authenticated) {
+            unsigned char tag[CipherStream::TAG_SIZE];
+            stream.getTag(tag);
+            encodeCiphertext(tag, sizeof(tag), sink);
+        }
+
+        // Last partial group gets padded
+        if (!pending.empty()) {
+            char tail[4];
+            size_t written = TextEncoding::encode(encoding, (const uint8_t*)pending.data(), pending.size(), tail);
+            pending.clear();
+            sink((const unsigned char*)tail, written);
+        }
+        return ok;
+    }
+
+    if (!pending.empty()) {
+        decodeText(pending.size(), sink);
+        pending.clear();
+    }
+    if (authenticated) {
+        // Cut short before the tag, or before any ciphertext at all
+        if (!framed || tagTail.size() < CipherStream::TAG_SIZE) {
+            return false;
+        }
+        stream.setTag((const unsigned char*)tagTail.data());
+    }
+    else if (framing && !framed) {
+        // Cut short inside the nonce
+        return false;
+    }
+    bool ok = stream.final([&](const unsigned char* data, size_t length) {
+        deliverPlaintext(data, length, sink);
+    });
+    if (!ok) {
+        return false;
+    }
+
+    // Messages shorter than the marker are never compressed
+    if (stage == Stage::PROBE) {
+        stage = Stage::PLAIN;
+        string first;
+        first.swap(head);
+        substitutePlaintext((const unsigned char*)first.data(), first.size(), sink);
+    }
+    else if (stage == Stage::COMPRESSED && !zlib->final(sink)) {
+        throw runtime_error("Compressed data is truncated");
+    }
+    return true;
+}
+
+bool LayeredPipeline::compressed() const {
+    return stage == Stage::COMPRESSED;
+}
+
+void LayeredPipeline::startFrame(const Sink& sink) {
+    framed = true;
+    if (!framing) {
+        return;
+    }
+
+    frameHead = newFrameHead(stream.getMode());
+    stream.reset(frameHead.substr(1, CipherStream::ivLength(stream.getMode())));
+    if (authenticated) {
+        stream.addAad((const unsigned char*)frameHead.data(), 1);
+    }
+    encodeCiphertext((const unsigned char*)frameHead.data(), frameHead.size(), sink);
+}
+
+void LayeredPipeline::decipher(const unsigned char* data, size_t length, const Sink& sink) {
+    auto deliver = [&](const unsigned char* plain, size_t plainLength) {
+        deliverPlaintext(plain, plainLength, sink);
+    };
+    if (!framing) {
+        stream.update(data, length, deliver);
+        return;
+    }
+
+    if (!framed) {
+        size_t headSize = frameHeadLength(stream.getMode());
+        size_t take = min(headSize - frameHead.size(), length);
+        frameHead.append((const char*)data, take);
+        data += take;
+        length -= take;
+        if (frameHead.size() < headSize) {
+            return;
+        }
+        stream.reset(frameNonce(stream.getMode(), (const unsigned char*)frameHead.data()));
+        if (authenticated) {
+            stream.addAad((const unsigned char*)frameHead.data(), 1);
+        }
+        framed = true;
+    }
+    if (!authenticated) {
+        stream.update(data, length, deliver);
+        return;
+    }
+
+    // Everything but the last TAG_SIZE bytes is ciphertext
+    size_t total = tagTail.size() + length;
+    if (total <= CipherStream::TAG_SIZE) {
+        tagTail.append((const char*)data, length);
+        return;
+    }
+    size_t release = total - CipherStream::TAG_SIZE;
+    size_t fromTail = min(release, tagTail.size());
+    if (fromTail > 0) {
+        stream.update((const unsigned char*)tagTail.data(), fromTail, deliver);
+        tagTail.erase(0, fromTail);
+    }
+    size_t fromData = release - fromTail;
+    stream.update(data, fromData, deliver);
+    tagTail.append((const char*)data + fromData, length - fromData);
+}
+
+void LayeredPipeline::decide(const Sink& sink) {
+    // Level 0 only wraps the data, enough to keep a colliding plaintext apart from the marker
+    bool colliding = collidesWithMarker(table, (const unsigned char*)head.data(), head.size());
+    if (compression == Compression::ZLIB || colliding) {
+        startCompressed(compression == Compression::ZLIB ? ZlibStream::DEFAULT_LEVEL : 0);
+        stream.update(MARKER, MARKER_SIZE, [&](const unsigned char* cipher, size_t cipherLength) {
+            encodeCiphertext(cipher, cipherLength, sink);
+        });
+    }
+    else {
+        stage = Stage::PLAIN;
+    }
+
+    string first;
+    first.swap(head);
+    encryptData((const unsigned char*)first.data(), first.size(), sink);
+}
+
+void LayeredPipeline::startCompressed(int level) {
+    if (table.size() < 256) {
+        binaryTable.reset(new SubstitutionTable(table.withPassthrough()));
+        substitution = binaryTable.get();
+    }
+    zlib.reset(new ZlibStream());
+    zlib->init(direction == CipherStream::Direction::ENCRYPT ? ZlibStream::Direction::COMPRESS : ZlibStream::Direction::DECOMPRESS,
+        level);
+    stage = Stage::COMPRESSED;
+}
+
+void LayeredPipeline::encryptData(const unsigned char* data, size_t length, const Sink& sink) {
+    if (stage == Stage::COMPRESSED) {
+        zlib->update(data, length, [&](const unsigned char* packed, size_t packedLength) {
+            encryptBlock(packed, packedLength, sink);
+        });
+        return;
+    }
+
+    size_t offset = 0;
+    while (offset < length) {
+        size_t slice = min(BLOCK_SIZE, length - offset);
+        encryptBlock(data + offset, slice, sink);
+        offset += slice;
+    }
+}
+
+void LayeredPipeline::encryptBlock(const unsigned char* data, size_t length, const Sink& sink) {
+    if (substituted.size() < length) {
+        substituted.resize(length);
+    }
+    substitution->encrypt(data, substituted.data(), length);
+    stream.update(substituted.data(), length, [&](const unsigned char* cipher, size_t cipherLength) {
+        encodeCiphertext(cipher, cipherLength, sink);
+    });
+}
+
+void LayeredPipeline::encodeCiphertext(const unsigned char* data, size_t length, const Sink& sink) {
+    if (encoding == Encoding::RAW) {
+        if (length > 0) {
+            sink(data, length);
+        }
+        return;
+    }
+
+    // Base64 works on 3-byte groups; up to 2 leftover bytes wait in `pending`. Hex has 1-byte groups
+    size_t group = TextEncoding::groupSize(encoding);
+    size_t offset = 0;
+    while (!pending.empty() && pending.size() < group && offset < length) {
+        pending.push_back((char)data[offset++]);
+    }
+
+    size_t groups = (length - offset) / group * group;
+    size_t needed = TextEncoding::encodedLength(encoding, groups) + 4;
+    if (encoded.size() < needed) {
+        encoded.resize(needed);
+    }
+
+    size_t written = 0;
+    if (!pending.empty() && pending.size() == group) {
+        written += TextEncoding::encode(encoding, (const uint8_t*)pending.data(), group, (char*)encoded.data());
+        pending.clear();
+    }
+    written += TextEncoding::encode(encoding, data + offset, groups, (char*)encoded.data() + written);
+    pending.append((const char*)data + offset + groups, length - offset - groups);
+
+    if (written > 0) {
+        sink(encoded.data(), written);
+    }
+}
+
+void LayeredPipeline::decryptBlock(const unsigned char* data, size_t length, const Sink& sink) {
+    if (encoding == Encoding::RAW) {
+        decipher(data, length, sink);
+        return;
+    }
+
+    // Older releases wrapped base64 at 64 columns; copy the runs between line breaks
+    const unsigned char* end = data + length;
+    while (data < end) {
+        const unsigned char* lineEnd = find_if(data, end, [](unsigned char c) { return c == '\r' || c == '\n'; });
+        pending.append((const char*)data, lineEnd - data);
+        data = (lineEnd < end) ? lineEnd + 1 : end;
+    }
+
+    if (!TextEncoding::isPadded(encoding)) {
+        size_t ready = pending.size() / TextEncoding::unitSize(encoding) * TextEncoding::unitSize(encoding);
+        if (ready > 0) {
+            decodeText(ready, sink);
+            pending.erase(0, ready);
+        }
+        return;
+    }
+
+    // Always keep the last quad back, only it may carry padding
+    if (pending.size() > 4) {
+        size_t ready = (pending.size() - 1) / 4 * 4;
+        if (pending[ready - 1] == '=') {
+            throw invalid_argument("Invalid base64: padding before the end of input");
+        }
+        decodeText(ready, sink);
+        pending.erase(0, ready);
+    }
+}
+
+void LayeredPipeline::decodeText(size_t length, const Sink& sink) {
+    size_t needed = TextEncoding::decodedMaxLength(encoding, length);
+    if (encoded.size() < needed) {
+        encoded.resize(needed);
+    }
+    size_t decoded = TextEncoding::decode(encoding, pending.data(), length, encoded.data());
+    decipher(encoded.data(), decoded, sink);
+}
+
+void LayeredPipeline::deliverPlaintext(const unsigned char* data, size_t length, const Sink& sink) {
+    if (stage == Stage::PROBE) {
+        size_t take = min(MARKER_SIZE - head.size(), length);
+        head.append((const char*)data, take);
+        data += take;
+        length -= take;
+        if (head.size() < MARKER_SIZE) {
+            return;
+        }
+
+        string first;
+        first.swap(head);
+        if (memcmp(first.data(), MARKER, MARKER_SIZE) == 0) {
+            startCompressed(ZlibStream::DEFAULT_LEVEL);
+        }
+        else {
+            stage = Stage::PLAIN;
+            substitutePlaintext((const unsigned char*)first.data(), first.size(), sink);
+        }
+    }
+    if (length > 0) {
+        substitutePlaintext(data, length, sink);
+    }
+}
+
+void LayeredPipeline::substitutePlaintext(const unsigned char* data, size_t length, const Sink& sink) {
+    if (substituted.size() < length) {
+        substituted.resize(length);
+    }
+    substitution->decrypt(data, substituted.data(), length);
+    if (stage == Stage::COMPRESSED) {
+        zlib->update(substituted.data(), length, sink);
+    }
+    else {
+        sink(substituted.data(), length);
+    }
+}
@@ -0,0 +1,95 @@
+#include "parallelCtr.hpp"
+#include "cipherStream.hpp"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+using namespace std;
+
+string ParallelCtr::counterAt(const string& iv, uint64_t blockIndex) {
+    string counter = iv.substr(0, 16);
+    counter.resize(16, '\0');
+
+    // Add with carry from the least significant byte
+    uint64_t carry = blockIndex;
+    for (int i = 15; i >= 0 && carry; --i) {
+        uint64_t sum = (uint8_t)counter[i] + (carry & 0xFF);
+        counter[i] = (char)(sum & 0xFF);
+        carry = (carry >> 8) + (sum >> 8);
+    }
+    return counter;
+}
+
+void ParallelCtr::applyAt(const string& key, const string& iv, uint64_t offset,
+    const unsigned char* input, unsigned char* output, size_t length) {
+    if (offset % 16 != 0) {
+        throw invalid_argument("CTR segment offset must be block aligned");
+    }
+
+    CipherStream stream;
+    stream.init(CipherStream::Direction::ENCRYPT, key, counterAt(iv, offset / 16), CipherMode::AES_256_CTR);
+    stream.update(input, length, output);
+}
+
+void ParallelCtr::apply(const string& key, const string& iv, const unsigned char* input,
+    unsigned char* output, size_t length, unsigned threads) {
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+
+    // Block-aligned segments, never smaller than MIN_SEGMENT
+    size_t segments = min((size_t)threads, max((size_t)1, length / MIN_SEGMENT));
+    size_t segmentSize = ((length + segments - 1) / segments + 15) / 16 * 16;
+    if (segments <= 1) {
+        applyAt(key, iv, 0, input, output, length);
+        return;
+    }
+
+    vector<exception_ptr> errors(segments);
+    auto runSegment = [&](size_t s) {
+        size_t begin = s * segmentSize;
+        if (begin >= length) {
+            return;
+        }
+        try {
+            applyAt(key, iv, begin, input + begin, output + begin, min(segmentSize, length - begin));
+        }
+        catch (...) {
+            errors[s] = current_exception();
+        }
+    };
+
+    {
+        // Joins on every exit, so a failed thread start never leaves a joinable thread behind
+        vector<thread> workers;
+        struct Joiner {
+            vector<thread>& threads;
+            ~Joiner() {
+                for (thread& worker : threads) {
+                    if (worker.joinable()) {
+                        worker.join();
+                    }
+                }
+            }
+        } joiner{ workers };
+
+        // Segment 0 runs on the calling thread; a segment that gets no thread of its own does too
+        for (size_t s = 1; s < segments; ++s) {
+            try {
+                workers.emplace_back(runSegment, s);
+            }
+            catch (const system_error&) {
+                runSegment(s);
+            }
+        }
+        runSegment(0);
+    }
+
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,258 @@
+#include "pipelinedCrypt.hpp"
+#include "layeredPipeline.hpp"
+#include "spscRing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+using namespace std;
+
+namespace {
+    const size_t CHUNK_ALIGNMENT = 4096;
+    const int SPIN_LIMIT = 256;
+
+    using Clock = chrono::steady_clock;
+
+    struct Chunk {
+        unsigned char* data = nullptr;
+        size_t length = 0;
+        // Marks the end of the stream; data may still carry bytes
+        bool last = false;
+    };
+
+    // Thrown inside a stage when another stage has already failed
+    struct Aborted {};
+
+    struct Shared {
+        SpscRing<Chunk> readFull;
+        SpscRing<Chunk> readFree;
+        SpscRing<Chunk> writeFull;
+        SpscRing<Chunk> writeFree;
+
+        atomic<bool> aborted{ false };
+        mutex errorLock;
+        exception_ptr error;
+
+        explicit Shared(size_t depth)
+            : readFull(depth), readFree(depth), writeFull(depth), writeFree(depth) {
+        }
+
+        void fail(exception_ptr stageError) {
+            lock_guard<mutex> guard(errorLock);
+            if (!error) {
+                error = stageError;
+            }
+            aborted = true;
+        }
+    };
+
+    // Retry op until it succeeds, counting the wait once if it did not succeed at first
+    template <typename Op>
+    void waitUntil(Shared& shared, uint64_t& counter, double& waitSeconds, Op op) {
+        if (op()) {
+            return;
+        }
+        counter++;
+        auto start = Clock::now();
+        for (int spins = 0; !op(); ++spins) {
+            if (shared.aborted) {
+                throw Aborted();
+            }
+            if (spins >= SPIN_LIMIT) {
+                this_thread::yield();
+            }
+        }
+        waitSeconds += chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    template <typename Stage>
+    void runStage(Shared& shared, Stage stage) {
+        try {
+            stage();
+        }
+        catch (const Aborted&) {
+        }
+        catch (...) {
+            shared.fail(current_exception());
+        }
+    }
+}
+
+PipelinedCrypt::Stats PipelinedCrypt::run(CipherStream::Direction direction, const SubstitutionTable& table,
+    CipherStream& stream, FILE* input, FILE* output, const Config& config) {
+    if (config.chunkSize == 0 || config.queueDepth == 0) {
+        throw invalid_argument("Chunk size and queue depth must be positive");
+    }
+
+    // Stages read and write straight from the chunks, stdio buffering would copy twice
+    setvbuf(input, nullptr, _IONBF, 0);
+    setvbuf(output, nullptr, _IONBF, 0);
+
+    Shared shared(config.queueDepth);
+    size_t depth = shared.readFree.capacity();
+    size_t chunkSize = (config.chunkSize + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+
+    // One block for all chunks, allocated up front
+    unique_ptr<unsigned char, void (*)(unsigned char*)> memory(
+        (unsigned char*)::operator new(2 * depth * chunkSize, align_val_t(CHUNK_ALIGNMENT)),
+        [](unsigned char* block) { ::operator delete(block, align_val_t(CHUNK_ALIGNMENT)); });
+    for (size_t i = 0; i < depth; ++i) {
+        Chunk readChunk;
+        readChunk.data = memory.get() + i * chunkSize;
+        shared.readFree.tryPush(readChunk);
+
+        Chunk writeChunk;
+        writeChunk.data = memory.get() + (depth + i) * chunkSize;
+        shared.writeFree.tryPush(writeChunk);
+    }
+
+    Stats stats;
+    uint64_t readQueueSamples = 0;
+    uint64_t writeQueueSamples = 0;
+    double readQueueTotal = 0;
+    double writeQueueTotal = 0;
+    auto start = Clock::now();
+
+    thread reader([&] {
+        runStage(shared, [&] {
+            while (true) {
+                Chunk chunk;
+                waitUntil(shared, stats.reader.blocked, stats.reader.waitSeconds, [&] { return shared.readFree.tryPop(chunk); });
+
+                chunk.length = fread(chunk.data, 1, chunkSize, input);
+                if (ferror(input)) {
+                    throw runtime_error("Read failed");
+                }
+                chunk.last = chunk.length < chunkSize && feof(input);
+                stats.bytesRead += chunk.length;
+
+                // Never fails: there are only `depth` read chunks in total
+                shared.readFull.tryPush(chunk);
+                if (chunk.last) {
+                    return;
+                }
+            }
+        });
+    });
+
+    thread writer([&] {
+        runStage(shared, [&] {
+            while (true) {
+                Chunk chunk;
+                waitUntil(shared, stats.writer.starved, stats.writer.waitSeconds, [&] { return shared.writeFull.tryPop(chunk); });
+
+                size_t queued = shared.writeFull.size() + 1;
+                writeQueueTotal += queued;
+                writeQueueSamples++;
+                stats.maxWriteQueueDepth = max(stats.maxWriteQueueDepth, queued);
+
+                if (chunk.length > 0 && fwrite(chunk.data, 1, chunk.length, output) != chunk.length) {
+                    throw runtime_error("Write failed");
+                }
+                stats.bytesWritten += chunk.length;
+                if (chunk.last) {
+                    return;
+                }
+                shared.writeFree.tryPush(chunk);
+            }
+        });
+    });
+
+    // Crypto stage on the calling thread
+    runStage(shared, [&] {
+        LayeredPipeline pipeline(direction, table, stream, config.encoding, config.compression);
+
+        Chunk out;
+        waitUntil(shared, stats.crypto.blocked, stats.crypto.waitSeconds, [&] { return shared.writeFree.tryPop(out); });
+        out.length = 0;
+
+        auto flush = [&](bool last) {
+            out.last = last;
+            shared.writeFull.tryPush(out);
+            if (last) {
+                return;
+            }
+            waitUntil(shared, stats.crypto.blocked, stats.crypto.waitSeconds, [&] { return shared.writeFree.tryPop(out); });
+            out.length = 0;
+        };
+
+        auto sink = [&](const unsigned char* data, size_t length) {
+            while (length > 0) {
+                size_t part = min(length, chunkSize - out.length);
+                memcpy(out.data + out.length, data, part);
+                out.length += part;
+                data += part;
+                length -= part;
+                if (out.length == chunkSize) {
+                    flush(false);
+                }
+            }
+        };
+
+        sink((const unsigned char*)config.outputLead.data(), config.outputLead.size());
+        pipeline.update((const unsigned char*)config.inputLead.data(), config.inputLead.size(), sink);
+
+        while (true) {
+            Chunk in;
+            waitUntil(shared, stats.crypto.starved, stats.crypto.waitSeconds, [&] { return shared.readFull.tryPop(in); });
+
+            size_t queued = shared.readFull.size() + 1;
+            readQueueTotal += queued;
+            readQueueSamples++;
+            stats.maxReadQueueDepth = max(stats.maxReadQueueDepth, queued);
+
+            pipeline.update(in.data, in.length, sink);
+            bool last = in.last;
+            shared.readFree.tryPush(in);
+
+            if (last) {
+                if (!pipeline.final(sink)) {
+                    throw runtime_error("Decryption failed (wrong key or corrupted data)");
+                }
+                flush(true);
+                return;
+            }
+        }
+    });
+
+    reader.join();
+    writer.join();
+    stats.seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    if (shared.error) {
+        rethrow_exception(shared.error);
+    }
+    if (fflush(output) != 0) {
+        throw runtime_error("Write failed");
+    }
+
+    stats.averageReadQueueDepth = readQueueSamples ? readQueueTotal / readQueueSamples : 0;
+    stats.averageWriteQueueDepth = writeQueueSamples ? writeQueueTotal / writeQueueSamples : 0;
+    return stats;
+}
+
+PipelinedCrypt::Stats PipelinedCrypt::run(CipherStream::Direction direction, const SubstitutionTable& table,
+    CipherStream& stream, FILE* input, FILE* output) {
+    return run(direction, table, stream, input, output, Config());
+}
+
+void PipelinedCrypt::printStats(const Stats& stats, FILE* target) {
+    double mb = 1024.0 * 1024.0;
+    fprintf(target, "read %.1f MB, wrote %.1f MB in %.3f s (%.1f MB/s)\n",
+        stats.bytesRead / mb, stats.bytesWritten / mb, stats.seconds,
+        stats.seconds > 0 ? stats.bytesRead / mb / stats.seconds : 0.0);
+    fprintf(target, "reader: %llu blocked, %.3f s waiting\n",
+        (unsigned long long)stats.reader.blocked, stats.reader.waitSeconds);
+    fprintf(target, "crypto: %llu starved, %llu blocked, %.3f s waiting\n",
+        (unsigned long long)stats.crypto.starved, (unsigned long long)stats.crypto.blocked, stats.crypto.waitSeconds);
+    fprintf(target, "writer: %llu starved, %.3f s waiting\n",
+        (unsigned long long)stats.writer.starved, stats.writer.waitSeconds);
+    fprintf(target, "queue depth: read avg %.2f max %zu, write avg %.2f max %zu\n",
+        stats.averageReadQueueDepth, stats.maxReadQueueDepth,
+        stats.averageWriteQueueDepth, stats.maxWriteQueueDepth);
+}
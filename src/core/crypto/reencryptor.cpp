@@ -0,0 +1,531 @@
+#include "reencryptor.hpp"
+#include "container.hpp"
+#include "layeredPipeline.hpp"
+#include "mappedFile.hpp"
+#include "workStealingPool.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+    const char CHECKPOINT_MAGIC[4] = { 'X', 'C', 'R', 'W' };
+    const uint16_t CHECKPOINT_VERSION = 1;
+    const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+
+    // Thrown out of pace() once the job was asked to stop
+    struct Stopped {};
+
+    // Leftovers of other jobs, never data files of their own
+    bool isScratchFile(const fs::path& path) {
+        string extension = path.extension().string();
+        return extension == ".part" || extension == ".ckpt" || extension == ".tmp";
+    }
+
+    // Flush stdio and the OS cache, so a rename never publishes data that is not on disk yet
+    void syncFile(FILE* file, const string& path) {
+        bool ok = fflush(file) == 0;
+#if defined(_WIN32)
+        ok = ok && _commit(_fileno(file)) == 0;
+#else
+        ok = ok && fsync(fileno(file)) == 0;
+#endif
+        if (!ok) {
+            throw runtime_error("Write failed: " + path);
+        }
+    }
+
+    // Make a rename into directory durable; NTFS journals renames itself, so only POSIX needs this
+    void syncDirectory(const fs::path& directory) {
+#if !defined(_WIN32)
+        int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Could not open directory: " + directory.string());
+        }
+        bool ok = fsync(fd) == 0;
+        close(fd);
+        if (!ok) {
+            throw runtime_error("Could not sync directory: " + directory.string());
+        }
+#else
+        (void)directory;
+#endif
+    }
+
+    /**
+     * Layout (little-endian): "XCRW", u16 version, u16 0, u32 target key id,
+     * u32 path length, then the relative path of the last file up to which
+     * every file is done.
+     */
+    void saveCheckpoint(const string& path, uint32_t keyId, const string& lastDone) {
+        string data(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        uint32_t fields[2] = { keyId, (uint32_t)lastDone.size() };
+        data.push_back((char)CHECKPOINT_VERSION);
+        data.push_back((char)(CHECKPOINT_VERSION >> 8));
+        data.append(2, '\0');
+        for (uint32_t field : fields) {
+            for (int i = 0; i < 4; ++i) {
+                data.push_back((char)(field >> (8 * i)));
+            }
+        }
+        data += lastDone;
+
+        // Through a temporary file, so a crash leaves the old or the new checkpoint
+        string tempPath = path + ".tmp";
+        FILE* file = fopen(tempPath.c_str(), "wb");
+        if (!file) {
+            throw runtime_error("Could not write checkpoint: " + tempPath);
+        }
+        bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+        try {
+            syncFile(file, tempPath);
+        }
+        catch (const runtime_error&) {
+            ok = false;
+        }
+        ok = (fclose(file) == 0) && ok;
+        if (!ok) {
+            throw runtime_error("Could not write checkpoint: " + tempPath);
+        }
+        fs::rename(tempPath, path);
+    }
+
+    // @return false if there is no usable checkpoint at path
+    bool loadCheckpoint(const string& path, uint32_t& keyId, string& lastDone) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        unsigned char head[16];
+        bool ok = fread(head, 1, sizeof(head), file) == sizeof(head)
+            && memcmp(head, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0
+            && (head[4] | (head[5] << 8)) == CHECKPOINT_VERSION;
+        if (ok) {
+            keyId = head[8] | (head[9] << 8) | (head[10] << 16) | ((uint32_t)head[11] << 24);
+            uint32_t length = head[12] | (head[13] << 8) | (head[14] << 16) | ((uint32_t)head[15] << 24);
+            lastDone.assign(length, '\0');
+            ok = length == 0 || fread(&lastDone[0], 1, length, file) == length;
+        }
+        fclose(file);
+        return ok;
+    }
+
+    // "<path>.part", replacing path once commit() succeeds and removed otherwise
+    class PartFile {
+    public:
+        explicit PartFile(const string& target)
+            : target(target), partPath(target + ".part"), buffer(WRITE_BUFFER_SIZE),
+            file(fopen(partPath.c_str(), "wb"), fclose) {
+            if (!file) {
+                throw runtime_error("Could not open output file: " + partPath);
+            }
+            setvbuf(file.get(), buffer.data(), _IOFBF, buffer.size());
+        }
+
+        ~PartFile() {
+            if (file) {
+                file.reset();
+                error_code ignored;
+                fs::remove(partPath, ignored);
+            }
+        }
+
+        void write(const unsigned char* data, size_t length) {
+            if (fwrite(data, 1, length, file.get()) != length) {
+                throw runtime_error("Write failed: " + partPath);
+            }
+        }
+
+        // The original is replaced only once the new contents are on disk, so a
+        // crash leaves one complete version of the file
+        void commit() {
+            syncFile(file.get(), partPath);
+            if (fclose(file.release()) != 0) {
+                error_code ignored;
+                fs::remove(partPath, ignored);
+                throw runtime_error("Write failed: " + partPath);
+            }
+            fs::rename(partPath, target);
+            syncDirectory(fs::path(target).parent_path());
+        }
+
+    private:
+        string target;
+        string partPath;
+        // Declared first so it outlives the FILE that buffers into it
+        vector<char> buffer;
+        unique_ptr<FILE, int (*)(FILE*)> file;
+    };
+}
+
+double Reencryptor::Progress::megabytesPerSecond() const {
+    return seconds > 0 ? bytesRead / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+Reencryptor::Reencryptor(const KeyRing& ring, const string& aesKey, const string& iv, const Options& options)
+    : ring(ring), aesKey(aesKey), iv(iv), options(options), stopping(false), finished(false),
+    files(0), done(0), reencrypted(0), current(0), failed(0), bytesRead(0), bytesWritten(0),
+    throttledNanoseconds(0), elapsedNanoseconds(0) {
+    if (!(options.cpuShare > 0.0 && options.cpuShare <= 1.0)) {
+        throw invalid_argument("CPU share must be in (0, 1]");
+    }
+    // Built once, every worker substitutes through them
+    for (const KeyRing::Generation& generation : ring.generations()) {
+        tables.emplace(generation.id, generation.table.withPassthrough());
+    }
+}
+
+Reencryptor::~Reencryptor() {
+    stop();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void Reencryptor::start(const string& directory) {
+    if (worker.joinable()) {
+        throw logic_error("Re-encryption is already running");
+    }
+    stopping = false;
+    finished = false;
+    failure = nullptr;
+    startTime = Clock::now();
+    worker = thread([this, directory] {
+        try {
+            process(directory);
+        }
+        catch (...) {
+            failure = current_exception();
+        }
+        elapsedNanoseconds = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - startTime).count();
+        finished = true;
+    });
+}
+
+void Reencryptor::stop() {
+    stopping = true;
+}
+
+Reencryptor::Progress Reencryptor::wait() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (failure) {
+        rethrow_exception(failure);
+    }
+    return progress();
+}
+
+Reencryptor::Progress Reencryptor::run(const string& directory) {
+    start(directory);
+    return wait();
+}
+
+Reencryptor::Progress Reencryptor::progress() const {
+    Progress snapshot;
+    snapshot.files = files;
+    snapshot.done = done;
+    snapshot.reencrypted = reencrypted;
+    snapshot.current = current;
+    snapshot.failed = failed;
+    snapshot.bytesRead = bytesRead;
+    snapshot.bytesWritten = bytesWritten;
+    snapshot.throttledSeconds = throttledNanoseconds / 1e9;
+    snapshot.finished = finished;
+    snapshot.seconds = finished
+        ? elapsedNanoseconds / 1e9
+        : chrono::duration<double>(Clock::now() - startTime).count();
+    return snapshot;
+}
+
+vector<string> Reencryptor::errors() const {
+    lock_guard<mutex> guard(errorLock);
+    return errorList;
+}
+
+void Reencryptor::process(const string& directory) {
+    if (!fs::is_directory(directory)) {
+        throw runtime_error("Not a directory: " + directory);
+    }
+
+    fs::path checkpointFile;
+    if (!options.checkpointPath.empty()) {
+        checkpointFile = fs::absolute(options.checkpointPath).lexically_normal();
+    }
+    vector<string> paths;
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator(directory)) {
+        if (!entry.is_regular_file() || isScratchFile(entry.path())
+            || fs::absolute(entry.path()).lexically_normal() == checkpointFile) {
+            continue;
+        }
+        paths.push_back(fs::relative(entry.path(), directory).generic_string());
+    }
+    sort(paths.begin(), paths.end());
+    files = paths.size();
+
+    // Files up to the checkpoint were all moved to this generation already
+    uint32_t target = ring.active().id;
+    size_t first = 0;
+    uint32_t checkpointKey;
+    string lastDone;
+    if (!checkpointFile.empty() && loadCheckpoint(checkpointFile.string(), checkpointKey, lastDone)
+        && checkpointKey == target) {
+        first = upper_bound(paths.begin(), paths.end(), lastDone) - paths.begin();
+        current += first;
+        done += first;
+    }
+
+    mutex progressLock;
+    vector<char> completed(paths.size() - first, 0);
+    // Every file before this index is done
+    size_t watermark = first;
+    Clock::time_point lastSave = Clock::now();
+    auto complete = [&](size_t index) {
+        lock_guard<mutex> guard(progressLock);
+        completed[index - first] = 1;
+        while (watermark < paths.size() && completed[watermark - first]) {
+            watermark++;
+        }
+        if (!checkpointFile.empty() && watermark > first
+            && Clock::now() - lastSave >= chrono::seconds(CHECKPOINT_SECONDS)) {
+            lastSave = Clock::now();
+            try {
+                saveCheckpoint(checkpointFile.string(), target, paths[watermark - 1]);
+            }
+            catch (const exception& e) {
+                lock_guard<mutex> errors(errorLock);
+                errorList.push_back(string("checkpoint: ") + e.what());
+            }
+        }
+    };
+
+    {
+        WorkStealingPool pool(options.threads);
+        // One puller per worker, so files are started in sorted order and the watermark keeps moving
+        atomic<size_t> next{ first };
+        for (unsigned t = 0; t < pool.threadCount(); ++t) {
+            pool.submit([&] {
+                size_t i;
+                while (!stopping && (i = next++) < paths.size()) {
+                    Pacer pacer{ Clock::now() };
+                    fs::path path = fs::path(directory) / paths[i];
+                    try {
+                        rewrite(path.string(), pacer);
+                    }
+                    catch (const Stopped&) {
+                        return;
+                    }
+                    catch (const exception& e) {
+                        // A failed file holds the checkpoint back, so a restart retries it
+                        failed++;
+                        done++;
+                        lock_guard<mutex> guard(errorLock);
+                        errorList.push_back(paths[i] + ": " + e.what());
+                        continue;
+                    }
+                    done++;
+                    complete(i);
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    if (checkpointFile.empty()) {
+        return;
+    }
+    if (watermark == paths.size()) {
+        error_code ignored;
+        fs::remove(checkpointFile, ignored);
+    }
+    else if (watermark > first) {
+        saveCheckpoint(checkpointFile.string(), target, paths[watermark - 1]);
+    }
+}
+
+void Reencryptor::rewrite(const string& path, Pacer& pacer) {
+    // Enough for a container header, which holds more than a text prefix
+    unsigned char head[ContainerHeader::SIZE];
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        throw runtime_error("Could not open file");
+    }
+    size_t got = fread(head, 1, sizeof(head), file);
+    fclose(file);
+
+    bool container = ContainerHeader::matches(head, got);
+    uint32_t keyId = 0;
+    bool prefixed = false;
+    if (container) {
+        keyId = ContainerHeader::parse(head, got).keyId;
+    }
+    else {
+        prefixed = KeyRing::readPrefix(head, got, keyId);
+    }
+
+    if (keyId == ring.active().id) {
+        current++;
+        return;
+    }
+    const KeyRing::Generation& from = ring.get(keyId);
+    if (container) {
+        rewriteContainer(path, from, pacer);
+    }
+    else {
+        rewriteText(path, from, prefixed, pacer);
+    }
+    reencrypted++;
+}
+
+void Reencryptor::rewriteContainer(const string& path, const KeyRing::Generation& from, Pacer& pacer) {
+    const KeyRing::Generation& to = ring.active();
+    uint64_t moved = 0;
+    PartFile part(path);
+
+    // Scoped so the input is unmapped before the new file replaces it
+    {
+        ContainerReader reader(tableFor(from), from.cipherKey(aesKey), path);
+        const ContainerHeader& header = reader.header();
+        ContainerWriter::Options writerOptions;
+        writerOptions.mode = header.mode;
+        writerOptions.chunkSize = header.chunkSize;
+        writerOptions.keyId = to.id;
+        writerOptions.substitution = (header.layers & ContainerHeader::LAYER_SUBSTITUTION) != 0;
+        ContainerWriter writer(tableFor(to), to.cipherKey(aesKey), writerOptions,
+            [&](const unsigned char* data, size_t length) {
+                part.write(data, length);
+                moved += length;
+                bytesWritten += length;
+            });
+
+        // Whole chunks at a time, so every chunk is decrypted once
+        vector<unsigned char> plain(max<size_t>(header.chunkSize, 1));
+        for (uint64_t offset = 0; offset < reader.size(); ) {
+            size_t count = reader.read(offset, plain.size(), plain.data());
+            writer.write(plain.data(), count);
+            offset += count;
+            bytesRead += count;
+            moved += count;
+            if (moved >= CHUNK_SIZE) {
+                pace(pacer, moved);
+                moved = 0;
+            }
+        }
+        writer.finish();
+    }
+    pace(pacer, moved);
+    part.commit();
+}
+
+void Reencryptor::rewriteText(const string& path, const KeyRing::Generation& from, bool prefixed, Pacer& pacer) {
+    const KeyRing::Generation& to = ring.active();
+    uint64_t moved = 0;
+    PartFile part(path);
+    auto sink = [&](const unsigned char* data, size_t length) {
+        part.write(data, length);
+        moved += length;
+        bytesWritten += length;
+    };
+
+    // Scoped so the input is unmapped before the new file replaces it
+    {
+        MappedFile input(path);
+        input.adviseSequential();
+        size_t skip = prefixed ? KeyRing::PREFIX_SIZE : 0;
+        const unsigned char* text = input.data() + skip;
+        size_t length = input.size() - skip;
+
+        // Same cipher as the message; the authenticated ones say which they are
+        CipherMode mode = options.mode;
+        if (CipherStream::isAuthenticated(mode)) {
+            LayeredPipeline::framedMode(text, length, options.encoding, mode);
+        }
+        CipherStream decryptor;
+        decryptor.init(CipherStream::Direction::DECRYPT, from.cipherKey(aesKey), iv, mode);
+        // Only CBC keeps iv; the framed modes swap in a fresh random nonce for every file
+        CipherStream encryptor;
+        encryptor.init(CipherStream::Direction::ENCRYPT, to.cipherKey(aesKey), iv, mode);
+
+        LayeredPipeline decrypting(CipherStream::Direction::DECRYPT, tableFor(from), decryptor, options.encoding);
+        // Created at the first plaintext, once it is known whether the message was compressed
+        unique_ptr<LayeredPipeline> encrypting;
+        auto startEncrypting = [&] {
+            Compression compression = decrypting.compressed() ? Compression::ZLIB : Compression::NONE;
+            encrypting.reset(new LayeredPipeline(CipherStream::Direction::ENCRYPT, tableFor(to), encryptor,
+                options.encoding, compression));
+        };
+        auto reencrypt = [&](const unsigned char* data, size_t count) {
+            if (!encrypting) {
+                startEncrypting();
+            }
+            encrypting->update(data, count, sink);
+        };
+
+        string newPrefix = KeyRing::prefix(to.id);
+        sink((const unsigned char*)newPrefix.data(), newPrefix.size());
+        for (size_t offset = 0; offset < length; offset += CHUNK_SIZE) {
+            size_t count = min(CHUNK_SIZE, length - offset);
+            decrypting.update(text + offset, count, reencrypt);
+            input.release(skip + offset, count);
+            bytesRead += count;
+            pace(pacer, moved + count);
+            moved = 0;
+        }
+        // The original is only replaced once the tag (or padding) checked out
+        if (!decrypting.final(reencrypt)) {
+            throw runtime_error("Decryption failed (wrong key or corrupted data)");
+        }
+        if (!encrypting) {
+            startEncrypting();
+        }
+        encrypting->final(sink);
+    }
+    // Text output ends with a newline, as the CLI writes it
+    if (TextEncoding::isText(options.encoding)) {
+        sink((const unsigned char*)"\n", 1);
+    }
+    part.commit();
+}
+
+void Reencryptor::pace(Pacer& pacer, uint64_t bytes) {
+    if (stopping) {
+        throw Stopped();
+    }
+
+    Clock::time_point now = Clock::now();
+    Clock::time_point until = now;
+    if (options.cpuShare < 1.0) {
+        // Idle share / busy share of the time worked since the last pause
+        auto busy = chrono::duration<double>(now - pacer.since);
+        until += chrono::duration_cast<Clock::duration>(busy * ((1.0 - options.cpuShare) / options.cpuShare));
+    }
+    if (options.bytesPerSecond > 0) {
+        lock_guard<mutex> guard(budgetLock);
+        // Budget left unused while idle is saved up for at most a second
+        nextSlot = max(nextSlot, now - chrono::seconds(1));
+        nextSlot += chrono::duration_cast<Clock::duration>(chrono::duration<double>((double)bytes / options.bytesPerSecond));
+        until = max(until, nextSlot);
+    }
+
+    if (until > now) {
+        this_thread::sleep_until(until);
+        throttledNanoseconds += chrono::duration_cast<chrono::nanoseconds>(Clock::now() - now).count();
+    }
+    pacer.since = Clock::now();
+}
+
+const SubstitutionTable& Reencryptor::tableFor(const KeyRing::Generation& generation) const {
+    return tables.at(generation.id);
+}
@@ -0,0 +1,232 @@
+#include "resumableCrypt.hpp"
+#include "mappedFile.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+    const char CHECKPOINT_MAGIC[4] = { 'X', 'C', 'R', 'K' };
+    // Input handed to the writer per step, released from memory afterwards
+    const size_t INPUT_STEP = 4 * 1024 * 1024;
+    const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+
+    void putU64(unsigned char* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            p[i] = (unsigned char)(v >> (8 * i));
+        }
+    }
+
+    uint64_t getU64(const unsigned char* p) {
+        uint64_t v = 0;
+        for (int i = 7; i >= 0; --i) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    // Flush stdio and the OS cache, so a checkpoint never points past durable data
+    void syncFile(FILE* file, const string& path) {
+        bool ok = fflush(file) == 0;
+#if defined(_WIN32)
+        ok = ok && _commit(_fileno(file)) == 0;
+#else
+        ok = ok && fsync(fileno(file)) == 0;
+#endif
+        if (!ok) {
+            throw runtime_error("Write failed: " + path);
+        }
+    }
+
+    int64_t modificationTime(const string& path) {
+        return (int64_t)filesystem::last_write_time(path).time_since_epoch().count();
+    }
+}
+
+void ResumableCrypt::Checkpoint::save(const string& path) const {
+    unsigned char data[SIZE] = {};
+    memcpy(data, CHECKPOINT_MAGIC, 4);
+    data[4] = (unsigned char)VERSION;
+    data[5] = (unsigned char)(VERSION >> 8);
+    header.serialize(data + 8);
+    unsigned char* tail = data + 8 + ContainerHeader::SIZE;
+    putU64(tail, chunks);
+    putU64(tail + 8, inputSize);
+    putU64(tail + 16, (uint64_t)inputTime);
+
+    string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        throw runtime_error("Could not write checkpoint: " + tempPath);
+    }
+    bool ok = fwrite(data, 1, SIZE, file) == SIZE;
+    try {
+        syncFile(file, tempPath);
+    }
+    catch (const runtime_error&) {
+        ok = false;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        throw runtime_error("Could not write checkpoint: " + tempPath);
+    }
+    filesystem::rename(tempPath, path);
+}
+
+ResumableCrypt::Checkpoint ResumableCrypt::Checkpoint::load(const string& path) {
+    unsigned char data[SIZE];
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        throw runtime_error("Could not open checkpoint: " + path);
+    }
+    size_t got = fread(data, 1, SIZE, file);
+    fclose(file);
+    if (got != SIZE || memcmp(data, CHECKPOINT_MAGIC, 4) != 0) {
+        throw runtime_error("Invalid checkpoint: " + path);
+    }
+    if ((data[4] | (data[5] << 8)) != VERSION) {
+        throw runtime_error("Unsupported checkpoint version: " + path);
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.header = ContainerHeader::parse(data + 8, ContainerHeader::SIZE);
+    const unsigned char* tail = data + 8 + ContainerHeader::SIZE;
+    checkpoint.chunks = getU64(tail);
+    checkpoint.inputSize = getU64(tail + 8);
+    checkpoint.inputTime = (int64_t)getU64(tail + 16);
+    return checkpoint;
+}
+
+string ResumableCrypt::partPath(const string& outputPath) {
+    return outputPath + ".part";
+}
+
+string ResumableCrypt::checkpointPath(const string& outputPath) {
+    return outputPath + ".ckpt";
+}
+
+uint64_t ResumableCrypt::verify(const SubstitutionTable& table, const string& key, const Checkpoint& checkpoint,
+    const string& inputPath, const string& partPath) {
+    uint64_t chunkSize = checkpoint.header.chunkSize;
+    uint64_t resumed = checkpoint.chunks * chunkSize;
+    if (resumed > checkpoint.inputSize) {
+        throw runtime_error("Checkpoint covers more than the input");
+    }
+    if (!filesystem::exists(partPath)) {
+        throw runtime_error("Nothing to resume, " + partPath + " is missing");
+    }
+
+    MappedFile input(inputPath);
+    MappedFile part(partPath);
+    input.adviseSequential();
+    part.adviseSequential();
+    ContainerReader reader(table, key, part.data(), part.size(), checkpoint.header, checkpoint.chunks);
+
+    // Decrypting proves the key and, in the authenticated modes, every tag;
+    // comparing proves the chunks belong to this input
+    vector<unsigned char> plain((size_t)chunkSize);
+    for (uint64_t i = 0; i < checkpoint.chunks; ++i) {
+        uint64_t offset = i * chunkSize;
+        reader.read(offset, plain.size(), plain.data());
+        if (memcmp(plain.data(), input.data() + offset, plain.size()) != 0) {
+            throw runtime_error("Chunk " + to_string(i) + " of " + partPath + " does not match the input (wrong key?)");
+        }
+        const ContainerReader::Chunk& chunk = reader.chunk((size_t)i);
+        input.release((size_t)offset, plain.size());
+        part.release((size_t)chunk.offset, chunk.storedLength + 4);
+    }
+    return resumed;
+}
+
+ResumableCrypt::Result ResumableCrypt::encryptFile(const SubstitutionTable& table, const string& key,
+    const ContainerWriter::Options& options, const string& inputPath, const string& outputPath, bool resume,
+    uint64_t interval) {
+    error_code ec;
+    if (filesystem::equivalent(inputPath, outputPath, ec)) {
+        throw invalid_argument("Input and output are the same file: " + inputPath);
+    }
+
+    string part = partPath(outputPath);
+    string checkpointFile = checkpointPath(outputPath);
+    MappedFile input(inputPath);
+    uint64_t inputSize = input.size();
+    int64_t inputTime = modificationTime(inputPath);
+
+    Result result;
+    Checkpoint checkpoint;
+    bool resuming = resume && filesystem::exists(checkpointFile);
+    if (resuming) {
+        checkpoint = Checkpoint::load(checkpointFile);
+        if (checkpoint.inputSize != inputSize || checkpoint.inputTime != inputTime) {
+            throw runtime_error("Input changed since the checkpoint, remove " + checkpointFile + " to start over");
+        }
+        if (checkpoint.header.keyId != options.keyId) {
+            throw runtime_error("Checkpoint was written under key " + to_string(checkpoint.header.keyId)
+                + ", not " + to_string(options.keyId));
+        }
+        result.resumedBytes = verify(table, key, checkpoint, inputPath, part);
+        // Bytes past the checkpoint may be torn or not on disk
+        filesystem::resize_file(part, ContainerWriter::sizeAfter(checkpoint.header, checkpoint.chunks));
+    }
+    else {
+        filesystem::remove(checkpointFile, ec);
+    }
+
+    // Declared first so it outlives the FILE that buffers into it
+    vector<char> writeBuffer(WRITE_BUFFER_SIZE);
+    unique_ptr<FILE, int (*)(FILE*)> out(fopen(part.c_str(), resuming ? "r+b" : "wb"), fclose);
+    if (!out || (resuming && fseek(out.get(), 0, SEEK_END) != 0)) {
+        throw runtime_error("Could not open output file: " + part);
+    }
+    setvbuf(out.get(), writeBuffer.data(), _IOFBF, writeBuffer.size());
+
+    FILE* outFile = out.get();
+    auto sink = [&](const unsigned char* data, size_t length) {
+        if (fwrite(data, 1, length, outFile) != length) {
+            throw runtime_error("Write failed: " + part);
+        }
+        result.bytesWritten += length;
+    };
+    unique_ptr<ContainerWriter> writer(resuming
+        ? new ContainerWriter(table, key, checkpoint.header, checkpoint.chunks, sink)
+        : new ContainerWriter(table, key, options, sink));
+
+    checkpoint.header = writer->header();
+    checkpoint.inputSize = inputSize;
+    checkpoint.inputTime = inputTime;
+    uint64_t checkpointed = writer->committedSize();
+
+    input.adviseSequential();
+    for (uint64_t offset = result.resumedBytes; offset < inputSize; offset += INPUT_STEP) {
+        size_t step = (size_t)min<uint64_t>(INPUT_STEP, inputSize - offset);
+        writer->write(input.data() + offset, step);
+        input.release((size_t)offset, step);
+
+        if (writer->committedSize() - checkpointed >= interval) {
+            syncFile(outFile, part);
+            checkpoint.chunks = writer->committedChunks();
+            checkpoint.save(checkpointFile);
+            checkpointed = writer->committedSize();
+            result.checkpoints++;
+        }
+    }
+    writer->finish();
+
+    if (fclose(out.release()) != 0) {
+        throw runtime_error("Write failed: " + part);
+    }
+    filesystem::rename(part, outputPath);
+    filesystem::remove(checkpointFile, ec);
+    return result;
+}
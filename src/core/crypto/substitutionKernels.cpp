@@ -0,0 +1,200 @@
+#include "substitutionKernels.hpp"
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XCREEPTOR_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace SubstitutionKernels {
+    namespace {
+        bool translateScalar(const uint8_t* table, const uint8_t* input, uint8_t* output, size_t length) {
+            uint8_t valid = 1;
+            for (size_t i = 0; i < length; ++i) {
+                uint8_t c = table[input[i]];
+                output[i] = c;
+                valid &= (c != 0);
+            }
+            return valid != 0;
+        }
+
+#ifdef XCREEPTOR_X86_KERNELS
+        // Rows (groups of 16 entries sharing a high nibble) that contain at least one
+        // mapped entry. All-zero rows contribute nothing to the OR-reduction, so the
+        // 94-symbol keyboard alphabet (0x21..0x7E) only needs 6 of the 16 lookups.
+        int activeRows(const uint8_t* table, int rows[16]) {
+            int count = 0;
+            for (int row = 0; row < 16; ++row) {
+                uint8_t any = 0;
+                for (int i = 0; i < 16; ++i) {
+                    any |= table[row * 16 + i];
+                }
+                if (any) {
+                    rows[count++] = row;
+                }
+            }
+            return count;
+        }
+
+        // Nibble-split lookup: for row r, (x - 16r) lands in [0,16) only for bytes in
+        // that row; adding 0x70 with unsigned saturation keeps those indices below
+        // 0x80 and pushes every other byte to >= 0x80, which pshufb turns into 0.
+        __attribute__((target("ssse3")))
+        bool translateSsse3(const uint8_t* table, const uint8_t* input, uint8_t* output, size_t length) {
+            int rows[16];
+            int rowCount = activeRows(table, rows);
+            __m128i lut[16], base[16];
+            for (int i = 0; i < rowCount; ++i) {
+                lut[i] = _mm_loadu_si128((const __m128i*)(table + rows[i] * 16));
+                base[i] = _mm_set1_epi8((char)(rows[i] * 16));
+            }
+
+            const __m128i bias = _mm_set1_epi8(0x70);
+            const __m128i zero = _mm_setzero_si128();
+            __m128i invalid = zero;
+
+            size_t i = 0;
+            for (; i + 16 <= length; i += 16) {
+                __m128i x = _mm_loadu_si128((const __m128i*)(input + i));
+                __m128i result = zero;
+                for (int r = 0; r < rowCount; ++r) {
+                    __m128i index = _mm_adds_epu8(_mm_sub_epi8(x, base[r]), bias);
+                    result = _mm_or_si128(result, _mm_shuffle_epi8(lut[r], index));
+                }
+                invalid = _mm_or_si128(invalid, _mm_cmpeq_epi8(result, zero));
+                _mm_storeu_si128((__m128i*)(output + i), result);
+            }
+
+            bool valid = _mm_movemask_epi8(invalid) == 0;
+            return translateScalar(table, input + i, output + i, length - i) && valid;
+        }
+
+        __attribute__((target("avx2")))
+        bool translateAvx2(const uint8_t* table, const uint8_t* input, uint8_t* output, size_t length) {
+            int rows[16];
+            int rowCount = activeRows(table, rows);
+            __m256i lut[16], base[16];
+            for (int i = 0; i < rowCount; ++i) {
+                lut[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table + rows[i] * 16)));
+                base[i] = _mm256_set1_epi8((char)(rows[i] * 16));
+            }
+
+            const __m256i bias = _mm256_set1_epi8(0x70);
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i invalid = zero;
+
+            size_t i = 0;
+            for (; i + 32 <= length; i += 32) {
+                __m256i x = _mm256_loadu_si256((const __m256i*)(input + i));
+                __m256i result = zero;
+                for (int r = 0; r < rowCount; ++r) {
+                    __m256i index = _mm256_adds_epu8(_mm256_sub_epi8(x, base[r]), bias);
+                    result = _mm256_or_si256(result, _mm256_shuffle_epi8(lut[r], index));
+                }
+                invalid = _mm256_or_si256(invalid, _mm256_cmpeq_epi8(result, zero));
+                _mm256_storeu_si256((__m256i*)(output + i), result);
+            }
+
+            bool valid = _mm256_movemask_epi8(invalid) == 0;
+            return translateScalar(table, input + i, output + i, length - i) && valid;
+        }
+
+        // vpermi2b indexes 128 bytes with the low 7 bits, so two lookups cover the
+        // whole table and bit 7 of the input picks between them.
+        __attribute__((target("avx512f,avx512bw,avx512vbmi,bmi2")))
+        bool translateAvx512Vbmi(const uint8_t* table, const uint8_t* input, uint8_t* output, size_t length) {
+            const __m512i t0 = _mm512_loadu_si512((const void*)(table));
+            const __m512i t1 = _mm512_loadu_si512((const void*)(table + 64));
+            const __m512i t2 = _mm512_loadu_si512((const void*)(table + 128));
+            const __m512i t3 = _mm512_loadu_si512((const void*)(table + 192));
+            __mmask64 invalid = 0;
+
+            size_t i = 0;
+            for (; i + 64 <= length; i += 64) {
+                __m512i x = _mm512_loadu_si512((const void*)(input + i));
+                __m512i low = _mm512_permutex2var_epi8(t0, x, t1);
+                __m512i high = _mm512_permutex2var_epi8(t2, x, t3);
+                __m512i result = _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), low, high);
+                invalid |= _mm512_testn_epi8_mask(result, result);
+                _mm512_storeu_si512((void*)(output + i), result);
+            }
+
+            // Masked tail instead of a scalar loop
+            if (i < length) {
+                __mmask64 tail = _bzhi_u64(~0ULL, (unsigned)(length - i));
+                __m512i x = _mm512_maskz_loadu_epi8(tail, input + i);
+                __m512i low = _mm512_permutex2var_epi8(t0, x, t1);
+                __m512i high = _mm512_permutex2var_epi8(t2, x, t3);
+                __m512i result = _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), low, high);
+                invalid |= _mm512_mask_testn_epi8_mask(tail, result, result);
+                _mm512_mask_storeu_epi8(output + i, tail, result);
+            }
+            return invalid == 0;
+        }
+#endif
+    }
+
+    bool isSupported(Isa isa) {
+        switch (isa) {
+        case Isa::SCALAR:
+            return true;
+#ifdef XCREEPTOR_X86_KERNELS
+        case Isa::SSSE3:
+            return __builtin_cpu_supports("ssse3");
+        case Isa::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case Isa::AVX512_VBMI:
+            return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi")
+                && __builtin_cpu_supports("bmi2");
+#endif
+        default:
+            return false;
+        }
+    }
+
+    Isa detect() {
+        static const Isa best = [] {
+            const Isa order[] = { Isa::AVX512_VBMI, Isa::AVX2, Isa::SSSE3 };
+            for (Isa isa : order) {
+                if (isSupported(isa)) {
+                    return isa;
+                }
+            }
+            return Isa::SCALAR;
+        }();
+        return best;
+    }
+
+    const char* name(Isa isa) {
+        switch (isa) {
+        case Isa::SCALAR: return "scalar";
+        case Isa::SSSE3: return "ssse3";
+        case Isa::AVX2: return "avx2";
+        case Isa::AVX512_VBMI: return "avx512vbmi";
+        }
+        return "unknown";
+    }
+
+    bool translate(Isa isa, const uint8_t* table, const uint8_t* input, uint8_t* output, size_t length) {
+        switch (isa) {
+        case Isa::SCALAR:
+            return translateScalar(table, input, output, length);
+#ifdef XCREEPTOR_X86_KERNELS
+        case Isa::SSSE3:
+            return translateSsse3(table, input, output, length);
+        case Isa::AVX2:
+            return translateAvx2(table, input, output, length);
+        case Isa::AVX512_VBMI:
+            return translateAvx512Vbmi(table, input, output, length);
+#endif
+        default:
+            throw invalid_argument("Substitution kernel not available on this platform");
+        }
+    }
+
+    bool translate(const uint8_t* table, const uint8_t* input, uint8_t* output, size_t length) {
+        return translate(detect(), table, input, output, length);
+    }
+}
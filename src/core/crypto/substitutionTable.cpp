@@ -0,0 +1,178 @@
+#include "substitutionTable.hpp"
+#include "substitutionKernels.hpp"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+SubstitutionTable::SubstitutionTable()
+    : mappedCount(0) {
+    forward.fill(0);
+    inverse.fill(0);
+    forwardMapped.fill(0);
+    inverseMapped.fill(0);
+}
+
+SubstitutionTable::SubstitutionTable(const map<char, char>& charMapping)
+    : SubstitutionTable() {
+    for (const auto& pair : charMapping) {
+        uint8_t plain = (uint8_t)pair.first;
+        uint8_t cipher = (uint8_t)pair.second;
+
+        if (inverseMapped[cipher]) {
+            throw invalid_argument("Substitution mapping is not one-to-one");
+        }
+        forward[plain] = cipher;
+        forwardMapped[plain] = 1;
+        inverse[cipher] = plain;
+        inverseMapped[cipher] = 1;
+    }
+    mappedCount = charMapping.size();
+}
+
+SubstitutionTable SubstitutionTable::withPassthrough() const {
+    SubstitutionTable total(*this);
+    for (int c = 0; c < 256; ++c) {
+        if (forwardMapped[c] != inverseMapped[c]) {
+            throw invalid_argument("Passthrough needs a key that permutes its own alphabet");
+        }
+        if (!forwardMapped[c]) {
+            total.forward[c] = (uint8_t)c;
+            total.forwardMapped[c] = 1;
+            total.inverse[c] = (uint8_t)c;
+            total.inverseMapped[c] = 1;
+        }
+    }
+    total.mappedCount = 256;
+    return total;
+}
+
+void SubstitutionTable::throwUnmapped(const uint8_t* data, size_t length, const array<uint8_t, 256>& mapped) {
+    for (size_t i = 0; i < length; ++i) {
+        if (!mapped[data[i]]) {
+            char message[64];
+            snprintf(message, sizeof(message), "No substitution for byte 0x%02x at offset %zu", data[i], i);
+            throw out_of_range(message);
+        }
+    }
+    throw logic_error("Unmapped byte reported but not found");
+}
+
+void SubstitutionTable::encrypt(const uint8_t* input, uint8_t* output, size_t length) const {
+    // Every byte is mapped, a 0 in the output is a real value and not a miss
+    if (mappedCount == 256) {
+        SubstitutionKernels::translate(forward.data(), input, output, length);
+        return;
+    }
+
+    // Unmapped entries are 0, so the vector kernels can flag them as long as
+    // no byte legitimately encrypts to 0
+    if (!inverseMapped[0]) {
+        if (!SubstitutionKernels::translate(forward.data(), input, output, length)) {
+            throwUnmapped(input, length, forwardMapped);
+        }
+        return;
+    }
+
+    // Branch-free loop; unmapped bytes are only located after the fact
+    uint8_t valid = 1;
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t c = input[i];
+        output[i] = forward[c];
+        valid &= forwardMapped[c];
+    }
+    if (!valid) {
+        throwUnmapped(input, length, forwardMapped);
+    }
+}
+
+string SubstitutionTable::encrypt(const string& input) const {
+    string output(input.size(), '\0');
+    encrypt((const uint8_t*)input.data(), (uint8_t*)&output[0], input.size());
+    return output;
+}
+
+void SubstitutionTable::decrypt(const uint8_t* input, uint8_t* output, size_t length) const {
+    if (mappedCount == 256) {
+        SubstitutionKernels::translate(inverse.data(), input, output, length);
+        return;
+    }
+
+    if (!forwardMapped[0]) {
+        if (!SubstitutionKernels::translate(inverse.data(), input, output, length)) {
+            throwUnmapped(input, length, inverseMapped);
+        }
+        return;
+    }
+
+    uint8_t valid = 1;
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t c = input[i];
+        output[i] = inverse[c];
+        valid &= inverseMapped[c];
+    }
+    if (!valid) {
+        throwUnmapped(input, length, inverseMapped);
+    }
+}
+
+string SubstitutionTable::decrypt(const string& input) const {
+    string output(input.size(), '\0');
+    decrypt((const uint8_t*)input.data(), (uint8_t*)&output[0], input.size());
+    return output;
+}
+
+bool SubstitutionTable::isMapped(unsigned char c) const {
+    return forwardMapped[c] != 0;
+}
+
+size_t SubstitutionTable::size() const {
+    return mappedCount;
+}
+
+const array<uint8_t, 256>& SubstitutionTable::forwardTable() const {
+    return forward;
+}
+
+const array<uint8_t, 256>& SubstitutionTable::inverseTable() const {
+    return inverse;
+}
+
+
+void SubstitutionTable::serialize(uint8_t* out) const {
+    memset(out, 0, 32);
+    for (int c = 0; c < 256; ++c) {
+        out[c >> 3] |= (uint8_t)(forwardMapped[c] << (c & 7));
+    }
+    memcpy(out + 32, forward.data(), 256);
+    memcpy(out + 32 + 256, inverse.data(), 256);
+}
+
+SubstitutionTable SubstitutionTable::parse(const uint8_t* data) {
+    SubstitutionTable table;
+    memcpy(table.forward.data(), data + 32, 256);
+    memcpy(table.inverse.data(), data + 32 + 256, 256);
+
+    // Unmapped entries must stay 0, encrypt and decrypt rely on it
+    bool valid = true;
+    for (int c = 0; c < 256; ++c) {
+        uint8_t mapped = (data[c >> 3] >> (c & 7)) & 1;
+        uint8_t cipher = table.forward[c];
+        table.forwardMapped[c] = mapped;
+        if (mapped) {
+            valid = valid && !table.inverseMapped[cipher] && table.inverse[cipher] == (uint8_t)c;
+            table.inverseMapped[cipher] = 1;
+            table.mappedCount++;
+        }
+        else {
+            valid = valid && cipher == 0;
+        }
+    }
+    for (int c = 0; c < 256; ++c) {
+        valid = valid && (table.inverseMapped[c] || table.inverse[c] == 0);
+    }
+    if (!valid) {
+        throw invalid_argument("Stored substitution tables are inconsistent");
+    }
+    return table;
+}
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "tenantKeyStore.hpp"
+#include "keyDerivation.hpp"
+#include "keyManager.hpp"
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+
+const char* const TenantKeyStore::STORE_KEY_FILE = ".store.key";
+
+TenantKeyStore::TenantKeyStore(const string& directory, const string& password)
+    : TenantKeyStore(directory, password, Options()) {
+}
+
+TenantKeyStore::TenantKeyStore(const string& directory, const string& password, const Options& options)
+    : directory(directory),
+    password(password),
+    storeKey(KeyDerivation::KEY_SIZE),
+    shardCount(1),
+    perShard(0) {
+    if (options.capacity == 0 || options.shards == 0) {
+        throw invalid_argument("Tenant key store needs a capacity and at least one shard");
+    }
+    while (shardCount < options.shards) {
+        shardCount *= 2;
+    }
+    while (shardCount > 1 && shardCount > options.capacity) {
+        shardCount /= 2;
+    }
+    perShard = (options.capacity + shardCount - 1) / shardCount;
+    shards.reset(new Shard[shardCount]);
+
+    // The store's only key derivation
+    KeyManager::openWrappingKey((filesystem::path(directory) / STORE_KEY_FILE).string(), password, storeKey);
+}
+
+bool TenantKeyStore::isValidTenantId(const string& tenantId) {
+    if (tenantId.empty() || tenantId.size() > MAX_TENANT_ID_SIZE || tenantId[0] == '.') {
+        return false;
+    }
+    for (char c : tenantId) {
+        bool allowed = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+            || c == '.' || c == '_' || c == '-';
+        if (!allowed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TenantKeyStore::requireValid(const string& tenantId) {
+    // Tenant ids become file names, so nothing that could leave the directory
+    if (!isValidTenantId(tenantId)) {
+        throw invalid_argument("Invalid tenant id: " + tenantId.substr(0, MAX_TENANT_ID_SIZE));
+    }
+}
+
+string TenantKeyStore::keyFile(const string& tenantId) const {
+    requireValid(tenantId);
+    return (filesystem::path(directory) / (tenantId + ".key")).string();
+}
+
+TenantKeyStore::Shard& TenantKeyStore::shardFor(const string& tenantId) const {
+    return shards[hash<string>()(tenantId) & (shardCount - 1)];
+}
+
+shared_ptr<const KeyRing> TenantKeyStore::store(Shard& shard, const string& tenantId, shared_ptr<const KeyRing> ring) {
+    auto it = shard.index.find(tenantId);
+    if (it != shard.index.end()) {
+        it->second->second = ring;
+        shard.order.splice(shard.order.begin(), shard.order, it->second);
+        return ring;
+    }
+
+    shard.order.emplace_front(tenantId, ring);
+    shard.index.emplace(tenantId, shard.order.begin());
+    if (shard.order.size() > perShard) {
+        shard.index.erase(shard.order.back().first);
+        shard.order.pop_back();
+        shard.evictions++;
+    }
+    return ring;
+}
+
+shared_ptr<const KeyRing> TenantKeyStore::get(const string& tenantId) {
+    requireValid(tenantId);
+    Shard& shard = shardFor(tenantId);
+    {
+        lock_guard<mutex> lock(shard.lock);
+        auto it = shard.index.find(tenantId);
+        if (it != shard.index.end()) {
+            shard.order.splice(shard.order.begin(), shard.order, it->second);
+            shard.hits++;
+            return it->second->second;
+        }
+    }
+
+    // Read without the lock so other tenants of this shard are not held up;
+    // two threads missing on the same tenant at once both read, and the first one in wins
+    shared_ptr<const KeyRing> ring
+        = make_shared<const KeyRing>(KeyManager::readKeyRing(keyFile(tenantId), password, &storeKey));
+
+    lock_guard<mutex> lock(shard.lock);
+    shard.misses++;
+    auto it = shard.index.find(tenantId);
+    if (it != shard.index.end()) {
+        shard.order.splice(shard.order.begin(), shard.order, it->second);
+        return it->second->second;
+    }
+    return store(shard, tenantId, ring);
+}
+
+shared_ptr<const KeyRing> TenantKeyStore::create(const string& tenantId) {
+    string path = keyFile(tenantId);
+    Shard& shard = shardFor(tenantId);
+    lock_guard<mutex> write(shard.writeLock);
+
+    // createKeyRing checks for the file under its file lock, so another process creating the same tenant can't slip in
+    shared_ptr<const KeyRing> created;
+    try {
+        created = make_shared<const KeyRing>(KeyManager::createKeyRing(path, password, &storeKey));
+    }
+    catch (const runtime_error&) {
+        if (exists(tenantId)) {
+            throw runtime_error("Tenant already exists: " + tenantId);
+        }
+        throw;
+    }
+    lock_guard<mutex> lock(shard.lock);
+    return store(shard, tenantId, created);
+}
+
+shared_ptr<const KeyRing> TenantKeyStore::rotate(const string& tenantId) {
+    string path = keyFile(tenantId);
+    Shard& shard = shardFor(tenantId);
+    lock_guard<mutex> write(shard.writeLock);
+
+    // rotateKey works from the file, not the cache, so a ring replaced on disk is not rolled back
+    KeyRing ring;
+    KeyManager::rotateKey(ring, path, password, &storeKey);
+
+    shared_ptr<const KeyRing> rotated = make_shared<const KeyRing>(move(ring));
+    lock_guard<mutex> lock(shard.lock);
+    return store(shard, tenantId, rotated);
+}
+
+bool TenantKeyStore::exists(const string& tenantId) const {
+    error_code ec;
+    return filesystem::exists(keyFile(tenantId), ec);
+}
+
+void TenantKeyStore::evict(const string& tenantId) {
+    Shard& shard = shardFor(tenantId);
+    lock_guard<mutex> lock(shard.lock);
+    auto it = shard.index.find(tenantId);
+    if (it != shard.index.end()) {
+        shard.order.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+TenantKeyStore::Stats TenantKeyStore::stats() const {
+    Stats total;
+    for (size_t i = 0; i < shardCount; ++i) {
+        lock_guard<mutex> lock(shards[i].lock);
+        total.hits += shards[i].hits;
+        total.misses += shards[i].misses;
+        total.evictions += shards[i].evictions;
+        total.cached += shards[i].order.size();
+    }
+    return total;
+}
@@ -0,0 +1,119 @@
+#include "atomicFile.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+#if defined(_WIN32)
+    int createUnique(string& path) {
+        vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        if (_mktemp_s(name.data(), name.size()) != 0) {
+            return -1;
+        }
+        path.assign(name.data());
+        int descriptor = -1;
+        _sopen_s(&descriptor, path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _SH_DENYNO,
+            _S_IREAD | _S_IWRITE);
+        return descriptor;
+    }
+
+    bool writeAll(int descriptor, const char* bytes, size_t length) {
+        while (length > 0) {
+            int written = _write(descriptor, bytes, (unsigned)min<size_t>(length, 1u << 30));
+            if (written <= 0) {
+                return false;
+            }
+            bytes += written;
+            length -= (size_t)written;
+        }
+        return true;
+    }
+
+    bool syncAndClose(int descriptor) {
+        bool ok = _commit(descriptor) == 0;
+        return (_close(descriptor) == 0) && ok;
+    }
+
+    // NTFS journals the rename itself
+    void syncDirectory(const fs::path&) {
+    }
+#else
+    int createUnique(string& path) {
+        vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        int descriptor = mkstemp(name.data());
+        path.assign(name.data());
+        return descriptor;
+    }
+
+    bool writeAll(int descriptor, const char* bytes, size_t length) {
+        while (length > 0) {
+            ssize_t written = ::write(descriptor, bytes, length);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            bytes += written;
+            length -= (size_t)written;
+        }
+        return true;
+    }
+
+    bool syncAndClose(int descriptor) {
+        bool ok = fsync(descriptor) == 0;
+        return (close(descriptor) == 0) && ok;
+    }
+
+    void syncDirectory(const fs::path& directory) {
+        int descriptor = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0) {
+            throw runtime_error("Could not open directory: " + directory.string());
+        }
+        bool ok = fsync(descriptor) == 0;
+        close(descriptor);
+        if (!ok) {
+            throw runtime_error("Could not sync directory: " + directory.string());
+        }
+    }
+#endif
+}
+
+void AtomicFile::write(const string& path, const void* data, size_t size) {
+    string tempPath = path + ".XXXXXX";
+    int descriptor = createUnique(tempPath);
+    if (descriptor < 0) {
+        throw runtime_error("Could not create a temporary file next to " + path);
+    }
+
+    bool ok = writeAll(descriptor, (const char*)data, size);
+    ok = syncAndClose(descriptor) && ok;
+    error_code ec;
+    if (ok) {
+        fs::rename(tempPath, path, ec);
+    }
+    if (!ok || ec) {
+        error_code ignored;
+        fs::remove(tempPath, ignored);
+        throw runtime_error("Could not write file: " + path);
+    }
+    syncDirectory(fs::path(path).parent_path());
+}
@@ -0,0 +1,339 @@
+#include "base64.hpp"
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XCREEPTOR_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+    const char encodeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const uint8_t INVALID = 0xFF;
+
+    struct DecodeTable {
+        uint8_t values[256];
+        DecodeTable() {
+            for (uint8_t& v : values) {
+                v = INVALID;
+            }
+            for (int i = 0; i < 64; ++i) {
+                values[(uint8_t)encodeTable[i]] = (uint8_t)i;
+            }
+        }
+    };
+    const DecodeTable decodeTable;
+
+    // Encodes whole 3-byte groups, returns the number of input bytes consumed
+    size_t encodeScalar(const uint8_t* input, size_t length, char* output) {
+        size_t i = 0;
+        for (; i + 3 <= length; i += 3) {
+            uint32_t v = (input[i] << 16) | (input[i + 1] << 8) | input[i + 2];
+            *output++ = encodeTable[(v >> 18) & 0x3F];
+            *output++ = encodeTable[(v >> 12) & 0x3F];
+            *output++ = encodeTable[(v >> 6) & 0x3F];
+            *output++ = encodeTable[v & 0x3F];
+        }
+        return i;
+    }
+
+    [[noreturn]] void throwInvalid(const char* reason, size_t offset) {
+        throw invalid_argument(string("Invalid base64: ") + reason + " at offset " + to_string(offset));
+    }
+
+    // Decodes whole quads without padding, returns the number of chars consumed
+    size_t decodeScalar(const char* input, size_t length, uint8_t* output, size_t baseOffset) {
+        size_t i = 0;
+        for (; i + 4 <= length; i += 4) {
+            uint8_t a = decodeTable.values[(uint8_t)input[i]];
+            uint8_t b = decodeTable.values[(uint8_t)input[i + 1]];
+            uint8_t c = decodeTable.values[(uint8_t)input[i + 2]];
+            uint8_t d = decodeTable.values[(uint8_t)input[i + 3]];
+            // Alphabet values fit in 6 bits, INVALID does not
+            if ((a | b | c | d) & 0xC0) {
+                for (size_t j = i; j < i + 4; ++j) {
+                    if (decodeTable.values[(uint8_t)input[j]] == INVALID) {
+                        throwInvalid("unexpected character", baseOffset + j);
+                    }
+                }
+            }
+            uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+            *output++ = (uint8_t)(v >> 16);
+            *output++ = (uint8_t)(v >> 8);
+            *output++ = (uint8_t)v;
+        }
+        return i;
+    }
+
+#ifdef XCREEPTOR_X86_KERNELS
+    // Vector kernels after Muła and Lemire, "Faster Base64 Encoding and Decoding
+    // using AVX2 Instructions". Each step packs 3 bytes into four 6-bit fields
+    // (or back) and translates them with a nibble-indexed pshufb offset table.
+
+    __attribute__((target("ssse3")))
+    inline __m128i encodeReshuffle(__m128i in) {
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        return _mm_or_si128(t1, t3);
+    }
+
+    __attribute__((target("ssse3")))
+    inline __m128i encodeTranslate(__m128i in) {
+        const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+        __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+        __m128i mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+        indices = _mm_sub_epi8(indices, mask);
+        return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+    }
+
+    __attribute__((target("ssse3")))
+    size_t encodeSsse3(const uint8_t* input, size_t length, char* output) {
+        size_t i = 0;
+        // Each step reads 16 bytes but consumes 12
+        for (; i + 16 <= length; i += 12) {
+            __m128i in = _mm_loadu_si128((const __m128i*)(input + i));
+            _mm_storeu_si128((__m128i*)output, encodeTranslate(encodeReshuffle(in)));
+            output += 16;
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    size_t encodeAvx2(const uint8_t* input, size_t length, char* output) {
+        const __m256i shuffle = _mm256_setr_epi8(
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m256i lut = _mm256_setr_epi8(
+            65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+            65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+
+        size_t i = 0;
+        // Each step reads 12 bytes into each 128-bit lane, 28 bytes in total, and consumes 24
+        for (; i + 28 <= length; i += 24) {
+            __m256i in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(input + i))),
+                _mm_loadu_si128((const __m128i*)(input + i + 12)), 1);
+            in = _mm256_shuffle_epi8(in, shuffle);
+
+            __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+            __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+            __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+            __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+            __m256i indices6 = _mm256_or_si256(t1, t3);
+
+            __m256i indices = _mm256_subs_epu8(indices6, _mm256_set1_epi8(51));
+            __m256i mask = _mm256_cmpgt_epi8(indices6, _mm256_set1_epi8(25));
+            indices = _mm256_sub_epi8(indices, mask);
+            __m256i result = _mm256_add_epi8(indices6, _mm256_shuffle_epi8(lut, indices));
+
+            _mm256_storeu_si256((__m256i*)output, result);
+            output += 32;
+        }
+        return i;
+    }
+
+    // Decoding stops at the first vector holding a character outside the
+    // alphabet; the scalar path then takes over and reports its exact offset.
+    __attribute__((target("ssse3")))
+    size_t decodeSsse3(const char* input, size_t length, uint8_t* output) {
+        const __m128i lutLo = _mm_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lutHi = _mm_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i mask2F = _mm_set1_epi8(0x2f);
+
+        size_t i = 0;
+        // Each step writes 16 bytes of which 12 are valid
+        for (; i + 24 <= length; i += 16) {
+            __m128i str = _mm_loadu_si128((const __m128i*)(input + i));
+            __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+            __m128i loNibbles = _mm_and_si128(str, mask2F);
+            __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+            __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF) {
+                break;
+            }
+            __m128i eq2F = _mm_cmpeq_epi8(str, mask2F);
+            __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+            str = _mm_add_epi8(str, roll);
+
+            __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+            __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+            packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            _mm_storeu_si128((__m128i*)output, packed);
+            output += 12;
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    size_t decodeAvx2(const char* input, size_t length, uint8_t* output) {
+        const __m256i lutLo = _mm256_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m256i lutHi = _mm256_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i lutRoll = _mm256_setr_epi8(
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i mask2F = _mm256_set1_epi8(0x2f);
+
+        size_t i = 0;
+        // Each step writes 32 bytes of which 24 are valid
+        for (; i + 44 <= length; i += 32) {
+            __m256i str = _mm256_loadu_si256((const __m256i*)(input + i));
+            __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+            __m256i loNibbles = _mm256_and_si256(str, mask2F);
+            __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+            __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+            if (!_mm256_testz_si256(lo, hi)) {
+                break;
+            }
+            __m256i eq2F = _mm256_cmpeq_epi8(str, mask2F);
+            __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+            str = _mm256_add_epi8(str, roll);
+
+            __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+            __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+            packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+            _mm256_storeu_si256((__m256i*)output, packed);
+            output += 24;
+        }
+        return i;
+    }
+#endif
+
+    enum class Kernel {
+        SCALAR,
+        SSSE3,
+        AVX2
+    };
+
+    Kernel detectKernel() {
+        static const Kernel best = [] {
+#ifdef XCREEPTOR_X86_KERNELS
+            if (__builtin_cpu_supports("avx2")) return Kernel::AVX2;
+            if (__builtin_cpu_supports("ssse3")) return Kernel::SSSE3;
+#endif
+            return Kernel::SCALAR;
+        }();
+        return best;
+    }
+}
+
+size_t Base64::encodedLength(size_t length) {
+    return (length + 2) / 3 * 4;
+}
+
+size_t Base64::decodedMaxLength(size_t length) {
+    return length / 4 * 3;
+}
+
+size_t Base64::encode(const uint8_t* input, size_t length, char* output) {
+    size_t consumed = 0;
+#ifdef XCREEPTOR_X86_KERNELS
+    switch (detectKernel()) {
+    case Kernel::AVX2:
+        consumed = encodeAvx2(input, length, output);
+        break;
+    case Kernel::SSSE3:
+        consumed = encodeSsse3(input, length, output);
+        break;
+    case Kernel::SCALAR:
+        break;
+    }
+#endif
+    char* out = output + consumed / 3 * 4;
+    consumed += encodeScalar(input + consumed, length - consumed, out);
+    out = output + consumed / 3 * 4;
+
+    size_t remaining = length - consumed;
+    if (remaining > 0) {
+        uint32_t v = input[consumed] << 16;
+        if (remaining == 2) {
+            v |= input[consumed + 1] << 8;
+        }
+        *out++ = encodeTable[(v >> 18) & 0x3F];
+        *out++ = encodeTable[(v >> 12) & 0x3F];
+        *out++ = (remaining == 2) ? encodeTable[(v >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+    return out - output;
+}
+
+size_t Base64::decode(const char* input, size_t length, uint8_t* output) {
+    if (length % 4 != 0) {
+        throwInvalid("length is not a multiple of 4", length);
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    // Everything but the last quad is plain alphabet; the last quad may carry padding
+    size_t body = length - 4;
+    size_t consumed = 0;
+#ifdef XCREEPTOR_X86_KERNELS
+    switch (detectKernel()) {
+    case Kernel::AVX2:
+        consumed = decodeAvx2(input, body, output);
+        break;
+    case Kernel::SSSE3:
+        consumed = decodeSsse3(input, body, output);
+        break;
+    case Kernel::SCALAR:
+        break;
+    }
+#endif
+    consumed += decodeScalar(input + consumed, body - consumed, output + consumed / 4 * 3, consumed);
+    uint8_t* out = output + consumed / 4 * 3;
+
+    const char* last = input + body;
+    size_t padding = (last[3] == '=') ? ((last[2] == '=') ? 2 : 1) : 0;
+    uint8_t values[4] = { 0, 0, 0, 0 };
+    for (size_t j = 0; j < 4 - padding; ++j) {
+        values[j] = decodeTable.values[(uint8_t)last[j]];
+        if (values[j] == INVALID) {
+            throwInvalid(last[j] == '=' ? "misplaced padding" : "unexpected character", body + j);
+        }
+    }
+
+    uint32_t v = (values[0] << 18) | (values[1] << 12) | (values[2] << 6) | values[3];
+    if ((padding == 1 && (v & 0xFF)) || (padding == 2 && (v & 0xFFFF))) {
+        throwInvalid("non-zero trailing bits", length - padding - 1);
+    }
+
+    *out++ = (uint8_t)(v >> 16);
+    if (padding < 2) *out++ = (uint8_t)(v >> 8);
+    if (padding < 1) *out++ = (uint8_t)v;
+    return out - output;
+}
+
+string Base64::encode(const string& input) {
+    string output(encodedLength(input.size()), '\0');
+    output.resize(encode((const uint8_t*)input.data(), input.size(), &output[0]));
+    return output;
+}
+
+string Base64::decode(const string& input) {
+    string output(decodedMaxLength(input.size()), '\0');
+    output.resize(decode(input.data(), input.size(), (uint8_t*)&output[0]));
+    return output;
+}
+
+const char* Base64::kernelName() {
+    switch (detectKernel()) {
+    case Kernel::AVX2: return "avx2";
+    case Kernel::SSSE3: return "ssse3";
+    case Kernel::SCALAR: return "scalar";
+    }
+    return "unknown";
+}
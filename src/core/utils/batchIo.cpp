@@ -0,0 +1,466 @@
+#include "batchIo.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define XCREEPTOR_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <deque>
+#endif
+
+using namespace std;
+
+namespace {
+    const size_t BUFFER_ALIGNMENT = 4096;
+
+    struct Operation {
+        enum Kind { OPEN, READ, WRITE, CLOSE } kind;
+        string path;
+        int fd;
+        int flags;
+        int mode;
+        size_t buffer;
+        size_t length;
+        uint64_t offset;
+        uint64_t tag;
+    };
+
+    // One syscall per operation, plus retries for short transfers
+    class PosixBatchIo : public BatchIo {
+    public:
+        PosixBatchIo(size_t bufferCount, size_t bufferSize)
+            : BatchIo(bufferCount, bufferSize) {
+        }
+
+        void queueOpen(const string& path, int flags, int mode, uint64_t tag) override {
+            queued.push_back({ Operation::OPEN, path, -1, flags, mode, 0, 0, 0, tag });
+        }
+
+        void queueRead(int fd, size_t buffer, size_t length, uint64_t offset, uint64_t tag) override {
+            queued.push_back({ Operation::READ, string(), fd, 0, 0, buffer, length, offset, tag });
+        }
+
+        void queueWrite(int fd, size_t buffer, size_t length, uint64_t offset, uint64_t tag) override {
+            queued.push_back({ Operation::WRITE, string(), fd, 0, 0, buffer, length, offset, tag });
+        }
+
+        void queueClose(int fd, uint64_t tag) override {
+            queued.push_back({ Operation::CLOSE, string(), fd, 0, 0, 0, 0, 0, tag });
+        }
+
+        void submit(vector<Completion>& completions) override {
+            for (const Operation& op : queued) {
+                completions.push_back({ op.tag, run(op) });
+            }
+            queued.clear();
+        }
+
+        const char* name() const override {
+            return "posix";
+        }
+
+    private:
+        vector<Operation> queued;
+
+        int64_t run(const Operation& op) {
+            switch (op.kind) {
+            case Operation::OPEN: {
+                syscallCount++;
+#if defined(_WIN32)
+                int fd = _open(op.path.c_str(), op.flags | _O_BINARY, op.mode);
+#else
+                int fd = open(op.path.c_str(), op.flags | O_CLOEXEC, op.mode);
+#endif
+                return fd < 0 ? -errno : fd;
+            }
+            case Operation::CLOSE:
+                syscallCount++;
+#if defined(_WIN32)
+                return _close(op.fd) < 0 ? -errno : 0;
+#else
+                return close(op.fd) < 0 ? -errno : 0;
+#endif
+            case Operation::READ:
+            case Operation::WRITE:
+                return transfer(op);
+            }
+            return -EINVAL;
+        }
+
+        int64_t transfer(const Operation& op) {
+            unsigned char* data = buffer(op.buffer);
+            size_t done = 0;
+            while (done < op.length) {
+                syscallCount++;
+#if defined(_WIN32)
+                // No pread/pwrite; the descriptor belongs to this batch alone
+                if (_lseeki64(op.fd, (long long)(op.offset + done), SEEK_SET) < 0) {
+                    return -errno;
+                }
+                unsigned part = (unsigned)min<size_t>(op.length - done, 1u << 30);
+                int got = (op.kind == Operation::READ)
+                    ? _read(op.fd, data + done, part)
+                    : _write(op.fd, data + done, part);
+#else
+                ssize_t got = (op.kind == Operation::READ)
+                    ? pread(op.fd, data + done, op.length - done, (off_t)(op.offset + done))
+                    : pwrite(op.fd, data + done, op.length - done, (off_t)(op.offset + done));
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+#endif
+                if (got < 0) {
+                    return -errno;
+                }
+                if (got == 0) {
+                    break;
+                }
+                done += (size_t)got;
+            }
+            return (int64_t)done;
+        }
+    };
+
+#ifdef XCREEPTOR_IO_URING
+    int uringSetup(unsigned entries, io_uring_params* params) {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    int uringRegister(int fd, unsigned opcode, const void* arg, unsigned args) {
+        return (int)syscall(__NR_io_uring_register, fd, opcode, arg, args);
+    }
+
+    class UringBatchIo : public BatchIo {
+    public:
+        UringBatchIo(unsigned entries, size_t bufferCount, size_t bufferSize)
+            : BatchIo(bufferCount, bufferSize),
+            ringFd(-1),
+            sqRing(nullptr), cqRing(nullptr), sqes(nullptr),
+            sqRingSize(0), cqRingSize(0), sqesSize(0),
+            registered(false),
+            pending(0), inFlight(0) {
+            io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            ringFd = uringSetup(entries, &params);
+            if (ringFd < 0) {
+                throw runtime_error("io_uring_setup failed: " + string(strerror(errno)));
+            }
+
+            try {
+                mapRings(params);
+            }
+            catch (...) {
+                unmapRings();
+                close(ringFd);
+                throw;
+            }
+
+            // Registered buffers are pinned once instead of on every operation.
+            // This can fail under a low RLIMIT_MEMLOCK; plain READ/WRITE still work.
+            vector<iovec> vectors(bufferCount);
+            for (size_t i = 0; i < bufferCount; ++i) {
+                vectors[i].iov_base = buffer(i);
+                vectors[i].iov_len = bufferSize;
+            }
+            registered = bufferCount > 0
+                && uringRegister(ringFd, IORING_REGISTER_BUFFERS, vectors.data(), (unsigned)bufferCount) == 0;
+        }
+
+        ~UringBatchIo() override {
+            unmapRings();
+            if (ringFd >= 0) {
+                close(ringFd);
+            }
+        }
+
+        void queueOpen(const string& path, int flags, int mode, uint64_t tag) override {
+            // The kernel reads the path when the operation runs, keep it alive until then
+            paths.push_back(path);
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)paths.back().c_str();
+            sqe->len = (uint32_t)mode;
+            sqe->open_flags = (uint32_t)(flags | O_CLOEXEC);
+            sqe->user_data = tag;
+        }
+
+        void queueRead(int fd, size_t index, size_t length, uint64_t offset, uint64_t tag) override {
+            queueTransfer(registered ? IORING_OP_READ_FIXED : IORING_OP_READ, fd, index, length, offset, tag);
+        }
+
+        void queueWrite(int fd, size_t index, size_t length, uint64_t offset, uint64_t tag) override {
+            queueTransfer(registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, fd, index, length, offset, tag);
+        }
+
+        void queueClose(int fd, uint64_t tag) override {
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = fd;
+            sqe->user_data = tag;
+        }
+
+        void submit(vector<Completion>& completions) override {
+            while (pending > 0 || inFlight > 0) {
+                enter(completions);
+            }
+            paths.clear();
+        }
+
+        const char* name() const override {
+            return registered ? "io_uring (registered buffers)" : "io_uring";
+        }
+
+    private:
+        int ringFd;
+        void* sqRing;
+        void* cqRing;
+        io_uring_sqe* sqes;
+        size_t sqRingSize;
+        size_t cqRingSize;
+        size_t sqesSize;
+        bool registered;
+
+        atomic<unsigned>* sqHead;
+        atomic<unsigned>* sqTail;
+        unsigned sqMask;
+        unsigned sqEntries;
+        unsigned* sqArray;
+
+        atomic<unsigned>* cqHead;
+        atomic<unsigned>* cqTail;
+        unsigned cqMask;
+        io_uring_cqe* cqes;
+
+        unsigned pending;
+        unsigned inFlight;
+        deque<string> paths;
+
+        void mapRings(const io_uring_params& params) {
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) {
+                sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+            }
+
+            sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+            if (sqRing == MAP_FAILED) {
+                sqRing = nullptr;
+                throw runtime_error("Could not map io_uring submission ring");
+            }
+            if (single) {
+                cqRing = sqRing;
+            }
+            else {
+                cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+                if (cqRing == MAP_FAILED) {
+                    cqRing = nullptr;
+                    throw runtime_error("Could not map io_uring completion ring");
+                }
+            }
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            void* entries = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+            if (entries == MAP_FAILED) {
+                throw runtime_error("Could not map io_uring submission entries");
+            }
+            sqes = (io_uring_sqe*)entries;
+
+            char* sq = (char*)sqRing;
+            sqHead = (atomic<unsigned>*)(sq + params.sq_off.head);
+            sqTail = (atomic<unsigned>*)(sq + params.sq_off.tail);
+            sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+            sqEntries = params.sq_entries;
+            sqArray = (unsigned*)(sq + params.sq_off.array);
+
+            char* cq = (char*)cqRing;
+            cqHead = (atomic<unsigned>*)(cq + params.cq_off.head);
+            cqTail = (atomic<unsigned>*)(cq + params.cq_off.tail);
+            cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+            cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        }
+
+        void unmapRings() {
+            if (sqes) {
+                munmap(sqes, sqesSize);
+                sqes = nullptr;
+            }
+            if (cqRing && cqRing != sqRing) {
+                munmap(cqRing, cqRingSize);
+            }
+            cqRing = nullptr;
+            if (sqRing) {
+                munmap(sqRing, sqRingSize);
+                sqRing = nullptr;
+            }
+        }
+
+        io_uring_sqe* nextSqe() {
+            // Callers queue at most `entries` operations between submits
+            if (pending + inFlight >= sqEntries) {
+                throw length_error("io_uring queue is full, submit() first");
+            }
+            unsigned tail = sqTail->load(memory_order_relaxed);
+            unsigned index = tail & sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            sqTail->store(tail + 1, memory_order_release);
+            pending++;
+            return sqe;
+        }
+
+        void queueTransfer(uint8_t opcode, int fd, size_t index, size_t length, uint64_t offset, uint64_t tag) {
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = opcode;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t)(uintptr_t)buffer(index);
+            sqe->len = (uint32_t)length;
+            sqe->off = offset;
+            sqe->buf_index = (uint16_t)index;
+            sqe->user_data = tag;
+        }
+
+        // Submit everything pending and wait for all in-flight operations in one call
+        void enter(vector<Completion>& completions) {
+            unsigned toSubmit = pending;
+            unsigned waitFor = pending + inFlight;
+            syscallCount++;
+            int submitted = uringEnter(ringFd, toSubmit, waitFor, IORING_ENTER_GETEVENTS);
+            if (submitted < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                    reap(completions);
+                    return;
+                }
+                throw runtime_error("io_uring_enter failed: " + string(strerror(errno)));
+            }
+            pending -= (unsigned)submitted;
+            inFlight += (unsigned)submitted;
+            reap(completions);
+        }
+
+        void reap(vector<Completion>& completions) {
+            unsigned head = cqHead->load(memory_order_relaxed);
+            unsigned tail = cqTail->load(memory_order_acquire);
+            while (head != tail) {
+                const io_uring_cqe& cqe = cqes[head & cqMask];
+                completions.push_back({ cqe.user_data, (int64_t)cqe.res });
+                head++;
+                inFlight--;
+            }
+            cqHead->store(head, memory_order_release);
+        }
+    };
+
+    bool probeUring() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = uringSetup(4, &params);
+        if (fd < 0) {
+            return false;
+        }
+
+        // Every opcode used above must be supported (OPENAT/CLOSE need 5.6)
+        const unsigned ops = 256;
+        vector<unsigned char> storage(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = (io_uring_probe*)storage.data();
+        bool ok = uringRegister(fd, IORING_REGISTER_PROBE, probe, ops) == 0;
+        if (ok) {
+            const unsigned needed[] = { IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_READ, IORING_OP_WRITE,
+                IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED };
+            for (unsigned op : needed) {
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                    ok = false;
+                }
+            }
+        }
+        close(fd);
+        return ok;
+    }
+#endif
+}
+
+BatchIo::BatchIo(size_t bufferCount, size_t bufferSize)
+    : arena(nullptr),
+    count(bufferCount),
+    size((bufferSize + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT),
+    syscallCount(0) {
+    if (count > 0) {
+        arena = (unsigned char*)::operator new(count * size, align_val_t(BUFFER_ALIGNMENT));
+    }
+}
+
+BatchIo::~BatchIo() {
+    if (arena) {
+        ::operator delete(arena, align_val_t(BUFFER_ALIGNMENT));
+    }
+}
+
+unsigned char* BatchIo::buffer(size_t index) {
+    return arena + index * size;
+}
+
+size_t BatchIo::bufferSize() const {
+    return size;
+}
+
+size_t BatchIo::bufferCount() const {
+    return count;
+}
+
+uint64_t BatchIo::syscalls() const {
+    return syscallCount;
+}
+
+bool BatchIo::uringAvailable() {
+#ifdef XCREEPTOR_IO_URING
+    static const bool available = probeUring();
+    return available;
+#else
+    return false;
+#endif
+}
+
+BatchIo::Backend BatchIo::parseBackend(const string& name, bool& ok) {
+    ok = true;
+    if (name.empty() || name == "auto") {
+        return Backend::AUTO;
+    }
+    if (name == "uring" || name == "io_uring") {
+        return Backend::URING;
+    }
+    if (name == "posix") {
+        return Backend::POSIX;
+    }
+    ok = false;
+    return Backend::AUTO;
+}
+
+unique_ptr<BatchIo> BatchIo::create(Backend backend, unsigned entries, size_t bufferCount, size_t bufferSize) {
+    if (backend == Backend::URING && !uringAvailable()) {
+        throw runtime_error("io_uring is not available on this system");
+    }
+#ifdef XCREEPTOR_IO_URING
+    if (backend != Backend::POSIX && uringAvailable()) {
+        return unique_ptr<BatchIo>(new UringBatchIo(entries, bufferCount, bufferSize));
+    }
+#endif
+    return unique_ptr<BatchIo>(new PosixBatchIo(bufferCount, bufferSize));
+}
@@ -0,0 +1,60 @@
+#include "fileLock.hpp"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#if defined(_WIN32)
+
+FileLock::FileLock(const string& path)
+    : handle(INVALID_HANDLE_VALUE) {
+    handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Could not open lock file: " + path);
+    }
+    OVERLAPPED whole = {};
+    if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &whole)) {
+        CloseHandle(handle);
+        throw runtime_error("Could not lock: " + path);
+    }
+}
+
+FileLock::~FileLock() {
+    OVERLAPPED whole = {};
+    UnlockFileEx(handle, 0, MAXDWORD, MAXDWORD, &whole);
+    CloseHandle(handle);
+}
+
+#else
+
+FileLock::FileLock(const string& path)
+    : descriptor(-1) {
+    descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (descriptor < 0) {
+        throw runtime_error("Could not open lock file: " + path);
+    }
+    int result;
+    do {
+        result = flock(descriptor, LOCK_EX);
+    } while (result != 0 && errno == EINTR);
+    if (result != 0) {
+        close(descriptor);
+        throw runtime_error("Could not lock: " + path);
+    }
+}
+
+FileLock::~FileLock() {
+    // Closing the descriptor releases the lock
+    close(descriptor);
+}
+
+#endif
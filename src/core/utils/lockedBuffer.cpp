@@ -0,0 +1,92 @@
+#include "lockedBuffer.hpp"
+#include <new>
+#include <openssl/crypto.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#if defined(_WIN32)
+
+LockedBuffer::LockedBuffer(size_t size)
+    : pages(nullptr),
+    length(size),
+    allocated(0),
+    locked(false) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    size_t pageSize = info.dwPageSize;
+    allocated = (size + pageSize - 1) / pageSize * pageSize;
+    if (allocated == 0) {
+        allocated = pageSize;
+    }
+
+    pages = (uint8_t*)VirtualAlloc(nullptr, allocated, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!pages) {
+        throw bad_alloc();
+    }
+    locked = VirtualLock(pages, allocated) != 0;
+}
+
+LockedBuffer::~LockedBuffer() {
+    OPENSSL_cleanse(pages, allocated);
+    if (locked) {
+        VirtualUnlock(pages, allocated);
+    }
+    VirtualFree(pages, 0, MEM_RELEASE);
+}
+
+#else
+
+LockedBuffer::LockedBuffer(size_t size)
+    : pages(nullptr),
+    length(size),
+    allocated(0),
+    locked(false) {
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    allocated = (size + pageSize - 1) / pageSize * pageSize;
+    if (allocated == 0) {
+        allocated = pageSize;
+    }
+
+    void* mapping = mmap(nullptr, allocated, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw bad_alloc();
+    }
+    pages = (uint8_t*)mapping;
+    locked = mlock(pages, allocated) == 0;
+#if defined(MADV_DONTDUMP)
+    madvise(pages, allocated, MADV_DONTDUMP);
+#endif
+}
+
+LockedBuffer::~LockedBuffer() {
+    OPENSSL_cleanse(pages, allocated);
+    if (locked) {
+        munlock(pages, allocated);
+    }
+    munmap(pages, allocated);
+}
+
+#endif
+
+uint8_t* LockedBuffer::data() {
+    return pages;
+}
+
+const uint8_t* LockedBuffer::data() const {
+    return pages;
+}
+
+size_t LockedBuffer::size() const {
+    return length;
+}
+
+bool LockedBuffer::isLocked() const {
+    return locked;
+}
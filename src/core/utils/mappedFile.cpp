@@ -0,0 +1,150 @@
+#include "mappedFile.hpp"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const string& path)
+    : mapping(nullptr),
+    length(0),
+    pageSize(0),
+    fileHandle(INVALID_HANDLE_VALUE),
+    mappingHandle(nullptr) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    pageSize = info.dwPageSize;
+
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Could not open file: " + path);
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        CloseHandle(fileHandle);
+        throw runtime_error("Could not read file size: " + path);
+    }
+    length = (size_t)fileSize.QuadPart;
+
+    // Empty files cannot be mapped
+    if (length == 0) {
+        return;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle) {
+        mapping = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!mapping) {
+        if (mappingHandle) {
+            CloseHandle(mappingHandle);
+        }
+        CloseHandle(fileHandle);
+        throw runtime_error("Could not map file: " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (mapping) {
+        UnmapViewOfFile(mapping);
+    }
+    if (mappingHandle) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(fileHandle);
+    }
+}
+
+void MappedFile::adviseSequential() {
+    // Covered by FILE_FLAG_SEQUENTIAL_SCAN when the file is opened
+}
+
+void MappedFile::release(size_t offset, size_t count) {
+    size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t end = (offset + count) / pageSize * pageSize;
+    if (mapping && begin < end) {
+        // Unlocking pages that were never locked trims them from the working set
+        VirtualUnlock((LPVOID)(mapping + begin), end - begin);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const string& path)
+    : mapping(nullptr),
+    length(0),
+    pageSize((size_t)sysconf(_SC_PAGESIZE)),
+    descriptor(-1) {
+    descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        throw runtime_error("Could not open file: " + path);
+    }
+
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(descriptor);
+        throw runtime_error("Not a regular file: " + path);
+    }
+    length = (size_t)info.st_size;
+
+    // Empty files cannot be mapped
+    if (length == 0) {
+        return;
+    }
+
+    void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (address == MAP_FAILED) {
+        close(descriptor);
+        throw runtime_error("Could not map file: " + path);
+    }
+    mapping = (const uint8_t*)address;
+}
+
+MappedFile::~MappedFile() {
+    if (mapping) {
+        munmap((void*)mapping, length);
+    }
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+}
+
+void MappedFile::adviseSequential() {
+    if (mapping) {
+        madvise((void*)mapping, length, MADV_SEQUENTIAL);
+    }
+}
+
+void MappedFile::release(size_t offset, size_t count) {
+    size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t end = (offset + count) / pageSize * pageSize;
+    if (offset + count >= length) {
+        end = length;
+    }
+    if (mapping && begin < end) {
+        // Clean file-backed pages, so they are simply re-read if touched again
+        madvise((void*)(mapping + begin), end - begin, MADV_DONTNEED);
+    }
+}
+
+#endif
+
+const uint8_t* MappedFile::data() const {
+    return mapping;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
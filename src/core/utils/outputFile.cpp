@@ -0,0 +1,115 @@
+#include "outputFile.hpp"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#if defined(_WIN32)
+
+OutputFile::OutputFile(const string& path, uint64_t size)
+    : path(path),
+    handle(INVALID_HANDLE_VALUE) {
+    handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Could not open output file: " + path);
+    }
+
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(handle, end, nullptr, FILE_BEGIN) || !SetEndOfFile(handle)) {
+        CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+        throw runtime_error("Could not size output file: " + path);
+    }
+}
+
+OutputFile::~OutputFile() {
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+    }
+}
+
+void OutputFile::writeAt(uint64_t offset, const void* data, size_t length) {
+    const char* bytes = (const char*)data;
+    while (length > 0) {
+        DWORD part = (DWORD)min<size_t>(length, 1u << 30);
+        OVERLAPPED position = {};
+        position.Offset = (DWORD)offset;
+        position.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD written = 0;
+        if (!WriteFile(handle, bytes, part, &written, &position) || written == 0) {
+            throw runtime_error("Write failed: " + path);
+        }
+        bytes += written;
+        offset += written;
+        length -= written;
+    }
+}
+
+void OutputFile::close() {
+    if (handle != INVALID_HANDLE_VALUE) {
+        BOOL ok = CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+        if (!ok) {
+            throw runtime_error("Write failed: " + path);
+        }
+    }
+}
+
+#else
+
+OutputFile::OutputFile(const string& path, uint64_t size)
+    : path(path),
+    descriptor(-1) {
+    descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor < 0) {
+        throw runtime_error("Could not open output file: " + path);
+    }
+    if (ftruncate(descriptor, (off_t)size) != 0) {
+        ::close(descriptor);
+        descriptor = -1;
+        throw runtime_error("Could not size output file: " + path);
+    }
+}
+
+OutputFile::~OutputFile() {
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+}
+
+void OutputFile::writeAt(uint64_t offset, const void* data, size_t length) {
+    const char* bytes = (const char*)data;
+    while (length > 0) {
+        ssize_t written = pwrite(descriptor, bytes, length, (off_t)offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            throw runtime_error("Write failed: " + path);
+        }
+        bytes += written;
+        offset += (uint64_t)written;
+        length -= (size_t)written;
+    }
+}
+
+void OutputFile::close() {
+    if (descriptor >= 0) {
+        int result = ::close(descriptor);
+        descriptor = -1;
+        if (result != 0) {
+            throw runtime_error("Write failed: " + path);
+        }
+    }
+}
+
+#endif
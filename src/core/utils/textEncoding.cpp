@@ -0,0 +1,214 @@
+#include "textEncoding.hpp"
+#include "base64.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+namespace {
+    const char HEX_DIGITS[] = "0123456789abcdef";
+
+    // 0xFF marks characters that are not hex digits
+    struct HexTables {
+        uint16_t pairs[256];
+        uint8_t nibbles[256];
+
+        HexTables() {
+            for (int i = 0; i < 256; ++i) {
+                char pair[2] = { HEX_DIGITS[i >> 4], HEX_DIGITS[i & 15] };
+                memcpy(&pairs[i], pair, 2);
+                nibbles[i] = 0xFF;
+            }
+            for (int i = 0; i < 10; ++i) {
+                nibbles['0' + i] = (uint8_t)i;
+            }
+            for (int i = 0; i < 6; ++i) {
+                nibbles['a' + i] = (uint8_t)(10 + i);
+                nibbles['A' + i] = (uint8_t)(10 + i);
+            }
+        }
+    };
+
+    const HexTables& hexTables() {
+        static const HexTables tables;
+        return tables;
+    }
+
+    size_t encodeHex(const uint8_t* input, size_t length, char* output) {
+        const uint16_t* pairs = hexTables().pairs;
+        for (size_t i = 0; i < length; ++i) {
+            memcpy(output + 2 * i, &pairs[input[i]], 2);
+        }
+        return 2 * length;
+    }
+
+    size_t decodeHex(const char* input, size_t length, uint8_t* output) {
+        if (length % 2 != 0) {
+            throw invalid_argument("Invalid hex: odd length");
+        }
+        const uint8_t* nibbles = hexTables().nibbles;
+        uint8_t invalid = 0;
+        for (size_t i = 0; i < length / 2; ++i) {
+            uint8_t high = nibbles[(unsigned char)input[2 * i]];
+            uint8_t low = nibbles[(unsigned char)input[2 * i + 1]];
+            invalid |= (high | low) & 0xF0;
+            output[i] = (uint8_t)((high << 4) | (low & 15));
+        }
+        if (invalid) {
+            // Only locate the offending character on the error path
+            for (size_t i = 0; i < length; ++i) {
+                if (nibbles[(unsigned char)input[i]] == 0xFF) {
+                    throw invalid_argument("Invalid hex: unexpected character at offset " + to_string(i));
+                }
+            }
+        }
+        return length / 2;
+    }
+
+    // base64url is base64 with '-' and '_' in place of '+' and '/'. Both
+    // directions go through a byte table so the loop vectorizes
+    struct UrlTables {
+        char toUrl[256];
+        char fromUrl[256];
+
+        UrlTables() {
+            for (int i = 0; i < 256; ++i) {
+                toUrl[i] = fromUrl[i] = (char)i;
+            }
+            toUrl['+'] = '-';
+            toUrl['/'] = '_';
+            fromUrl['-'] = '+';
+            fromUrl['_'] = '/';
+            // Not part of this alphabet; '*' makes the base64 decoder reject them
+            fromUrl['+'] = '*';
+            fromUrl['/'] = '*';
+        }
+    };
+
+    const UrlTables& urlTables() {
+        static const UrlTables tables;
+        return tables;
+    }
+
+    void translate(const char* input, char* output, size_t length, const char* table) {
+        for (size_t i = 0; i < length; ++i) {
+            output[i] = table[(unsigned char)input[i]];
+        }
+    }
+
+    size_t decodeBase64Url(const char* input, size_t length, uint8_t* output) {
+        thread_local vector<char> standard;
+        standard.resize(length);
+        translate(input, standard.data(), length, urlTables().fromUrl);
+        return Base64::decode(standard.data(), length, output);
+    }
+}
+
+size_t TextEncoding::encodedLength(Encoding encoding, size_t length) {
+    switch (encoding) {
+    case Encoding::RAW: return length;
+    case Encoding::HEX: return 2 * length;
+    case Encoding::BASE64:
+    case Encoding::BASE64URL: return Base64::encodedLength(length);
+    }
+    return 0;
+}
+
+size_t TextEncoding::decodedMaxLength(Encoding encoding, size_t length) {
+    switch (encoding) {
+    case Encoding::RAW: return length;
+    case Encoding::HEX: return length / 2;
+    case Encoding::BASE64:
+    case Encoding::BASE64URL: return Base64::decodedMaxLength(length);
+    }
+    return 0;
+}
+
+size_t TextEncoding::groupSize(Encoding encoding) {
+    return (encoding == Encoding::BASE64 || encoding == Encoding::BASE64URL) ? 3 : 1;
+}
+
+size_t TextEncoding::unitSize(Encoding encoding) {
+    switch (encoding) {
+    case Encoding::RAW: return 1;
+    case Encoding::HEX: return 2;
+    case Encoding::BASE64:
+    case Encoding::BASE64URL: return 4;
+    }
+    return 1;
+}
+
+bool TextEncoding::isPadded(Encoding encoding) {
+    return encoding == Encoding::BASE64 || encoding == Encoding::BASE64URL;
+}
+
+bool TextEncoding::isText(Encoding encoding) {
+    return encoding != Encoding::RAW;
+}
+
+size_t TextEncoding::encode(Encoding encoding, const uint8_t* input, size_t length, char* output) {
+    switch (encoding) {
+    case Encoding::RAW:
+        memcpy(output, input, length);
+        return length;
+    case Encoding::HEX:
+        return encodeHex(input, length, output);
+    case Encoding::BASE64:
+        return Base64::encode(input, length, output);
+    case Encoding::BASE64URL: {
+        size_t written = Base64::encode(input, length, output);
+        translate(output, output, written, urlTables().toUrl);
+        return written;
+    }
+    }
+    return 0;
+}
+
+size_t TextEncoding::decode(Encoding encoding, const char* input, size_t length, uint8_t* output) {
+    switch (encoding) {
+    case Encoding::RAW:
+        memcpy(output, input, length);
+        return length;
+    case Encoding::HEX:
+        return decodeHex(input, length, output);
+    case Encoding::BASE64:
+        return Base64::decode(input, length, output);
+    case Encoding::BASE64URL:
+        return decodeBase64Url(input, length, output);
+    }
+    return 0;
+}
+
+string TextEncoding::encode(Encoding encoding, const string& input) {
+    string output(encodedLength(encoding, input.size()), '\0');
+    encode(encoding, (const uint8_t*)input.data(), input.size(), &output[0]);
+    return output;
+}
+
+string TextEncoding::decode(Encoding encoding, const string& input) {
+    string output(decodedMaxLength(encoding, input.size()), '\0');
+    size_t written = decode(encoding, input.data(), input.size(), (uint8_t*)&output[0]);
+    output.resize(written);
+    return output;
+}
+
+const char* TextEncoding::name(Encoding encoding) {
+    switch (encoding) {
+    case Encoding::RAW: return "raw";
+    case Encoding::BASE64: return "base64";
+    case Encoding::BASE64URL: return "base64url";
+    case Encoding::HEX: return "hex";
+    }
+    return "unknown";
+}
+
+bool TextEncoding::parse(const string& name, Encoding& encoding) {
+    const Encoding all[] = { Encoding::RAW, Encoding::BASE64, Encoding::BASE64URL, Encoding::HEX };
+    for (Encoding candidate : all) {
+        if (name == TextEncoding::name(candidate)) {
+            encoding = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,146 @@
+#include "workStealingPool.hpp"
+using namespace std;
+
+namespace {
+    // Pool and worker index of the calling thread, so nested submits stay local
+    thread_local const WorkStealingPool* currentPool = nullptr;
+    thread_local unsigned currentWorker = 0;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount)
+    : queued(0),
+    unfinished(0),
+    sleepers(0),
+    stopping(false),
+    nextWorker(0) {
+    if (threadCount == 0) {
+        threadCount = max(1u, thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.emplace_back(new Worker());
+    }
+    try {
+        for (unsigned i = 0; i < threadCount; ++i) {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        }
+    }
+    catch (...) {
+        // The destructor won't run; the workers already started must not outlive the pool
+        stop();
+        throw;
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stop();
+}
+
+void WorkStealingPool::stop() {
+    {
+        lock_guard<mutex> guard(stateLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (thread& worker : threads) {
+        worker.join();
+    }
+}
+
+unsigned WorkStealingPool::threadCount() const {
+    return (unsigned)workers.size();
+}
+
+void WorkStealingPool::submit(Task task) {
+    unsigned target = (currentPool == this)
+        ? currentWorker
+        : (unsigned)(nextWorker.fetch_add(1, memory_order_relaxed) % workers.size());
+
+    // Counted first, so the task can never finish before it is counted
+    unfinished.fetch_add(1);
+    queued.fetch_add(1);
+    {
+        lock_guard<mutex> guard(workers[target]->lock);
+        workers[target]->tasks.push_back(move(task));
+    }
+
+    // A worker raises sleepers under stateLock before it checks queued, so
+    // either it sees this task or this sees it and wakes it
+    if (sleepers.load() > 0) {
+        lock_guard<mutex> guard(stateLock);
+        workAvailable.notify_one();
+    }
+}
+
+void WorkStealingPool::wait() {
+    unique_lock<mutex> guard(stateLock);
+    allDone.wait(guard, [this] { return unfinished.load() == 0; });
+
+    if (firstError) {
+        exception_ptr error = firstError;
+        firstError = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+bool WorkStealingPool::takeTask(unsigned index, Task& task) {
+    // Own deque from the back (newest)
+    {
+        Worker& own = *workers[index];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // Steal from the front (oldest) of the others
+    for (size_t step = 1; step < workers.size(); ++step) {
+        Worker& victim = *workers[(index + step) % workers.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(unsigned index) {
+    currentPool = this;
+    currentWorker = index;
+
+    while (true) {
+        Task task;
+        if (!takeTask(index, task)) {
+            // Nothing to take: park until a submit counts a task or the pool stops.
+            // A task counted but not pushed yet only makes this loop come round again.
+            unique_lock<mutex> guard(stateLock);
+            sleepers.fetch_add(1);
+            workAvailable.wait(guard, [this] { return stopping || queued.load() > 0; });
+            sleepers.fetch_sub(1);
+            if (stopping && queued.load() == 0) {
+                return;
+            }
+            continue;
+        }
+
+        try {
+            task();
+        }
+        catch (...) {
+            lock_guard<mutex> guard(stateLock);
+            if (!firstError) {
+                firstError = current_exception();
+            }
+        }
+
+        if (unfinished.fetch_sub(1) == 1) {
+            lock_guard<mutex> guard(stateLock);
+            allDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#include "zlibStream.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+ZlibStream::ZlibStream()
+    : zs(),
+    direction(Direction::COMPRESS),
+    level(DEFAULT_LEVEL),
+    active(false),
+    ended(false),
+    outbuf(CHUNK_SIZE) {
+}
+
+ZlibStream::~ZlibStream() {
+    close();
+}
+
+void ZlibStream::close() {
+    if (!active) {
+        return;
+    }
+    if (direction == Direction::COMPRESS) {
+        deflateEnd(&zs);
+    }
+    else {
+        inflateEnd(&zs);
+    }
+    active = false;
+}
+
+void ZlibStream::init(Direction direction, int level) {
+    // Reuse the allocated state when the stream goes the same way
+    if (active && this->direction == direction && (direction == Direction::DECOMPRESS || this->level == level)) {
+        int result = (direction == Direction::COMPRESS) ? deflateReset(&zs) : inflateReset(&zs);
+        if (result != Z_OK) {
+            throw runtime_error("zlib reset failed");
+        }
+        ended = false;
+        return;
+    }
+
+    close();
+    zs = z_stream();
+    int result = (direction == Direction::COMPRESS)
+        ? deflateInit(&zs, level)
+        : inflateInit(&zs);
+    if (result != Z_OK) {
+        throw runtime_error("zlib initialization failed");
+    }
+    this->direction = direction;
+    this->level = level;
+    active = true;
+    ended = false;
+}
+
+void ZlibStream::update(const unsigned char* data, size_t length, const Sink& sink) {
+    if (!active) {
+        throw logic_error("ZlibStream::update called before init");
+    }
+    // avail_in is 32-bit, so very large inputs go in slices
+    while (length > 0) {
+        if (ended) {
+            throw runtime_error("Unexpected data after the end of the compressed stream");
+        }
+        uInt slice = (uInt)min(length, (size_t)1 << 30);
+        zs.next_in = const_cast<Bytef*>(data);
+        zs.avail_in = slice;
+        run(Z_NO_FLUSH, sink);
+        // Inflate stops at the end of the stream with input left over
+        size_t consumed = slice - zs.avail_in;
+        data += consumed;
+        length -= consumed;
+    }
+}
+
+bool ZlibStream::final(const Sink& sink) {
+    if (!active) {
+        throw logic_error("ZlibStream::final called before init");
+    }
+    zs.next_in = nullptr;
+    zs.avail_in = 0;
+    if (direction == Direction::COMPRESS) {
+        run(Z_FINISH, sink);
+        return true;
+    }
+    return ended;
+}
+
+size_t ZlibStream::compressedBound(size_t length) {
+    return compressBound((uLong)length);
+}
+
+void ZlibStream::run(int flush, const Sink& sink) {
+    while (true) {
+        zs.next_out = outbuf.data();
+        zs.avail_out = (uInt)outbuf.size();
+        int result = (direction == Direction::COMPRESS) ? deflate(&zs, flush) : inflate(&zs, Z_NO_FLUSH);
+
+        size_t produced = outbuf.size() - zs.avail_out;
+        if (produced > 0) {
+            sink(outbuf.data(), produced);
+        }
+
+        if (result == Z_STREAM_END) {
+            ended = true;
+            return;
+        }
+        if (result == Z_BUF_ERROR) {
+            // No progress possible: all input consumed and output flushed
+            return;
+        }
+        if (result != Z_OK) {
+            throw runtime_error(string("Corrupt compressed data: ") + (zs.msg ? zs.msg : "zlib error"));
+        }
+        // Output buffer not filled means zlib wants more input
+        if (zs.avail_out != 0 && flush != Z_FINISH) {
+            return;
+        }
+    }
+}
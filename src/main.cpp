@@ -1,8 +1,14 @@
 #include "mainWindow.hpp"
+#include "commandLine.hpp"
 #include <iostream>
 #include <filesystem>
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Any argument selects the headless CLI; no window or graphics stack is set up
+    if (argc > 1) {
+        return CommandLine::run(argc, argv);
+    }
+
     try {
         // Check if assets directory exists
         if (!std::filesystem::exists("assets")) {
@@ -1,6 +1,7 @@
 #define RAYGUI_IMPLEMENTATION
 #include "mainWindow.hpp"
 #include "envmgr.hpp"
+#include "cipherBackend.hpp"
 #include "encrypt.hpp"
 #include "decrypt.hpp"
 #include "keyManager.hpp"
@@ -30,6 +31,10 @@ MainWindow::MainWindow()
     keyPassword = EnvManager::get("XCREEPTOR_PASS_KEY");
     aesKey = EnvManager::get("XCREEPTOR_AES_KEY");
     iv = EnvManager::get("XCREEPTOR_VI_KEY");
+    // Same names as the CLI's -m; "auto" runs the backend microbenchmark once here
+    if (!CipherBackend::parse(EnvManager::get("XCREEPTOR_CIPHER"), cipherMode)) {
+        cipherMode = CipherMode::AES_256_CBC;
+    }
 
     // Clear text buffers
     memset(inputBuffer, 0, sizeof(inputBuffer));
@@ -158,6 +163,10 @@ void MainWindow::setupGeneratePasswordUI() {
 void MainWindow::renderMainApp() {
     renderSidebar();
     renderContent();
+
+    if (!keyError.empty()) {
+        DrawText(keyError.c_str(), (int)contentArea.x + 10, (int)(contentArea.y + contentArea.height) - 50, 14, RED);
+    }
 }
 
 void MainWindow::renderSidebar() {
@@ -195,7 +204,7 @@ void MainWindow::renderSidebar() {
         clearBuffers();
     }
 
-    if (GuiButton(regenKeyBtn, "Regenerate Key")) {
+    if (GuiButton(regenKeyBtn, "Rotate Key")) {
         showRegenerateModal = true;
     }
 
@@ -230,7 +239,7 @@ void MainWindow::renderHomePage() {
     GuiLabel({ contentArea.x + 20, contentArea.y + 50, 500, 30 }, "Choose a feature to get started:");
 
     // Feature cards
-    const char* cardTitles[] = { "Encrypt Text", "Decrypt Text", "Generate Password", "Regenerate Key" };
+    const char* cardTitles[] = { "Encrypt Text", "Decrypt Text", "Generate Password", "Rotate Key" };
     const char* cardDescriptions[] = {
         "Encrypt your text\nwith advanced\nencryption",
         "Decrypt your\nencrypted text\nback to original",
@@ -404,19 +413,19 @@ void MainWindow::renderOutputArea(Rectangle outputBox) {
 
 void MainWindow::performEncryption() {
     std::string input(inputBuffer);
-    if (input.empty()) return;
+    if (input.empty() || !requireKey()) return;
 
-    std::string encrypted = Encrypt::encryptLayered(charMapping, input, aesKey, iv);
+    std::string encrypted = Encrypt::encryptLayered(keyRing, input, aesKey, iv, cipherMode);
     strncpy(outputBuffer, encrypted.c_str(), sizeof(outputBuffer) - 1);
     outputBuffer[sizeof(outputBuffer) - 1] = '\0';
 }
 
 void MainWindow::performDecryption() {
     std::string input(inputBuffer);
-    if (input.empty()) return;
+    if (input.empty() || !requireKey()) return;
 
     try {
-        std::string decrypted = Decrypt::decryptLayered(charMapping, input, aesKey, iv);
+        std::string decrypted = Decrypt::decryptLayered(keyRing, input, aesKey, iv, cipherMode);
         strncpy(outputBuffer, decrypted.c_str(), sizeof(outputBuffer) - 1);
         outputBuffer[sizeof(outputBuffer) - 1] = '\0';
     }
@@ -428,10 +437,11 @@ void MainWindow::performDecryption() {
 }
 
 void MainWindow::performPasswordGeneration() {
+    if (!requireKey()) return;
     std::string password = Utils::generateRandomString(passwordLength);
     std::string output = "Generated Password: " + password + "\n\n";
 
-    std::string substitutionEncrypted = Encrypt::encryptString(charMapping, password);
+    std::string substitutionEncrypted = Encrypt::encryptString(keyRing.active().table, password);
     output += "Substitution Encrypted: " + substitutionEncrypted + "\n\n";
 
     std::string aesEncrypted = Encrypt::encryptAES(password, aesKey, iv);
@@ -467,23 +477,33 @@ void MainWindow::renderRegenerateModal() {
     DrawRectangleLinesEx(modalRect, 2, BLACK);
 
     // Title
-    GuiLabel({ modalRect.x + 20, modalRect.y + 20, 460, 30 }, "Regenerate Encryption Key");
+    GuiLabel({ modalRect.x + 20, modalRect.y + 20, 460, 30 }, "Rotate Encryption Key");
 
     // Warning message
-    const char* warningText = "This will generate a new encryption key.\n\nAll previously encrypted data will become unreadable.\n\nThis action cannot be undone.\n\nAre you sure you want to continue?";
+    const char* warningText = "This will add a new encryption key and use it from now on.\n\nPreviously encrypted data stays readable: every message\nnames the key it was encrypted with.\n\nAre you sure you want to continue?";
     GuiLabel({ modalRect.x + 20, modalRect.y + 60, 460, 120 }, warningText);
 
     // Buttons
     Rectangle yesButton = { modalRect.x + 80, modalRect.y + 190, 150, 35 };
     Rectangle noButton = { modalRect.x + 270, modalRect.y + 190, 150, 35 };
 
-    if (GuiButton(yesButton, "Yes, Regenerate")) {
-        // Proceed with regeneration
-        charMapping = KeyManager::generateKey();
-        KeyManager::saveKeyToFile(charMapping, keyFile, keyPassword);
+    if (GuiButton(yesButton, "Yes, Rotate")) {
+        // Only the key file is rewritten, older generations stay in the ring
+        std::string successMsg;
+        try {
+            // Rotating an empty ring would write a fresh file over the unreadable one
+            if (keyRing.empty()) {
+                throw std::runtime_error(keyError);
+            }
+            const KeyRing::Generation& generation = KeyManager::rotateKey(keyRing, keyFile, keyPassword);
+            successMsg = "Encryption key rotated successfully!\nAll new encryptions will use key " + std::to_string(generation.id)
+                + ".\nPreviously encrypted data still decrypts with its own key.";
+        }
+        catch (const std::exception& e) {
+            successMsg = std::string("Key rotation failed: ") + e.what();
+        }
 
         // Show success message
-        std::string successMsg = "Encryption key regenerated successfully!\nAll new encryptions will use the new key.\nPreviously encrypted data is now unreadable.";
         strncpy(outputBuffer, successMsg.c_str(), sizeof(outputBuffer) - 1);
         outputBuffer[sizeof(outputBuffer) - 1] = '\0';
 
@@ -626,12 +646,30 @@ bool MainWindow::processCreateAccount(const char* username, const char* pin) {
 }
 
 void MainWindow::initializeKey() {
-    std::ifstream testFile(keyFile);
-    if (!testFile) {
-        charMapping = KeyManager::generateKey();
-        KeyManager::saveKeyToFile(charMapping, keyFile, keyPassword);
+    keyError.clear();
+    std::error_code ec;
+    try {
+        // Only a missing file gets a new key; an unreadable one may hold the only copy of older keys
+        if (!std::filesystem::exists(keyFile, ec)) {
+            keyRing = KeyRing(SubstitutionTable(KeyManager::generateKey()));
+            KeyManager::saveKeyRing(keyRing, keyFile, keyPassword);
+        }
+        else {
+            keyRing = KeyManager::readKeyRing(keyFile, keyPassword);
+        }
+    }
+    catch (const std::exception& e) {
+        keyRing = KeyRing();
+        keyError = "Could not load " + keyFile + ": " + e.what()
+            + "\nCheck XCREEPTOR_PASS_KEY. The key file was left untouched.";
     }
-    else {
-        charMapping = KeyManager::loadKeyFromFile(keyFile, keyPassword);
+}
+
+bool MainWindow::requireKey() {
+    if (!keyRing.empty()) {
+        return true;
     }
+    strncpy(outputBuffer, keyError.c_str(), sizeof(outputBuffer) - 1);
+    outputBuffer[sizeof(outputBuffer) - 1] = '\0';
+    return false;
 }
\ No newline at end of file